@@ -0,0 +1,105 @@
+/**
+ * Granular dynamics with a soft-sphere contact model.
+ *
+ * This example is the same setup as the granulardynamics example 
+ * but uses a spring-dashpot (soft-sphere) contact model instead of
+ * instantaneous hard-sphere collisions. The contact forces are 
+ * calculated every timestep from a Verlet neighbour list which is 
+ * only rebuilt once particles have moved more than half the skin distance.
+ * Two boundary layers made of particles simulate shearing walls. 
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include "rebound.h"
+
+void additional_forces(struct reb_simulation* r);
+void heartbeat(struct reb_simulation* r);
+
+int main(int argc, char* argv[]){
+	struct reb_simulation* r = reb_create_simulation();
+	// Setup constants
+	r->dt 			= 2e-3;	
+	r->gravity		= REB_GRAVITY_NONE;
+	r->integrator		= REB_INTEGRATOR_LEAPFROG;
+	r->collision		= REB_COLLISION_SOFTSPHERE;
+	r->boundary		= REB_BOUNDARY_PERIODIC;
+	// Contact model. The contact time is about 0.07, i.e. ~35 timesteps.
+	// gamma is chosen to give a coefficient of restitution of about 0.15.
+	r->softsphere.k		= 1e3;
+	r->softsphere.gamma	= 23.;
+	r->softsphere.skin	= 0.2;
+	// Keep border particles from moving in response to contacts. 
+	r->additional_forces	= additional_forces;
+	r->heartbeat		= heartbeat;
+	reb_configure_box(r, 20., 1, 1, 4);
+	
+	r->nghostx = 1; r->nghosty = 1; r->nghostz = 0; 	
+	
+	double N_part 	= 0.00937*r->boxsize.x*r->boxsize.y*r->boxsize.z;
+
+	// Add Border Particles
+	double radius 		= 1;
+	double mass		= 1;
+	double border_spacing_x = r->boxsize.x/(floor(r->boxsize.x/radius/2.)-1.);
+	double border_spacing_y = r->boxsize.y/(floor(r->boxsize.y/radius/2.)-1.);
+	struct reb_particle pt = {0};
+	pt.r 		= radius;
+	pt.m 		= mass;
+	pt.hash		= 1;
+	for(double x = -r->boxsize.x/2.; x<r->boxsize.x/2.-border_spacing_x/2.;x+=border_spacing_x){
+		for(double y = -r->boxsize.y/2.; y<r->boxsize.y/2.-border_spacing_y/2.;y+=border_spacing_y){
+			pt.x 		= x;
+			pt.y 		= y;
+			
+			// Add particle to bottom
+			pt.z 		= -r->boxsize.z/2.+radius;
+			pt.vy 		= 1;
+			reb_add(r, pt);
+
+			// Add particle to top
+			pt.z 		= r->boxsize.z/2.-radius;
+			pt.vy 		= -1;
+			reb_add(r, pt);
+		}
+	}
+
+	// Add real particles
+	int N_border = r->N;
+	while(r->N-N_border<N_part){
+		struct reb_particle pt = {0};
+		pt.x 		= reb_random_uniform(-r->boxsize.x/2.,r->boxsize.x/2.);
+		pt.y 		= reb_random_uniform(-r->boxsize.y/2.,r->boxsize.y/2.);
+		pt.z 		= 0.758*reb_random_uniform(-r->boxsize.z/2.,r->boxsize.z/2.);
+		pt.vx 		= reb_random_normal(0.001);
+		pt.vy 		= reb_random_normal(0.001);
+		pt.vz 		= reb_random_normal(0.001);
+		pt.r 		= radius;						// m
+		pt.m 		= 1;
+		pt.hash		= 2;
+		reb_add(r, pt);
+	}
+
+	reb_integrate(r, INFINITY);
+}
+
+void additional_forces(struct reb_simulation* r){
+	// Contact forces have already been added at this point.
+	// Border particles move with a constant velocity.
+	struct reb_particle* const particles = r->particles;
+	for (int i=0;i<r->N;i++){
+		if (particles[i].hash==1){
+			particles[i].ax = 0;
+			particles[i].ay = 0;
+			particles[i].az = 0;
+		}
+	}
+}
+
+void heartbeat(struct reb_simulation* r){
+	if (reb_output_check(r, 100.*r->dt)){
+		reb_output_timing(r, 0);
+		printf("  Neighbour list rebuilds: %ld\n", r->softsphere.rebuilds_N);
+	}
+}
@@ -1,4 +1,4 @@
-from ctypes import Structure, c_double, POINTER, c_int, c_uint, c_uint32, c_long, c_ulong, c_ulonglong, c_void_p, c_char_p, CFUNCTYPE, byref
+from ctypes import Structure, c_double, POINTER, c_int, c_uint, c_uint32, c_uint64, c_long, c_ulong, c_ulonglong, c_void_p, c_char_p, CFUNCTYPE, byref, pointer
 from . import clibrebound, Escape, NoParticles, Encounter, SimulationError, ParticleNotFound
 from .particle import Particle
 from .units import units_convert_particle, check_units, convert_G
@@ -20,7 +20,24 @@ import types
 INTEGRATORS = {"ias15": 0, "whfast": 1, "sei": 2, "wh": 3, "leapfrog": 4, "hermes": 5, "none": 6}
 BOUNDARIES = {"none": 0, "open": 1, "periodic": 2, "shear": 3}
 GRAVITIES = {"none": 0, "basic": 1, "compensated": 2, "tree": 3}
-COLLISIONS = {"none": 0, "direct": 1, "tree": 2}
+COLLISIONS = {"none": 0, "direct": 1, "tree": 2, "softsphere": 3, "bvh": 4}
+WHFAST_COORDINATES = {"jacobi": 0, "democraticheliocentric": 1, "whds": 2}
+SPLITTINGS = {"leapfrog": 0, "yoshida4": 1, "yoshida6": 2, "yoshida8": 3, "saba2": 4, "saba3": 5, "saba4": 6, "sbab2": 7, "sbab3": 8, "sbab4": 9}
+
+def _splitting_name(i):
+    for name, _i in SPLITTINGS.items():
+        if i==_i:
+            return name
+    return i
+
+def _splitting_value(value):
+    if isinstance(value, int):
+        return c_int(value)
+    elif isinstance(value, basestring):
+        value = value.lower()
+        if value in SPLITTINGS: 
+            return SPLITTINGS[value]
+    raise ValueError("Warning. Splitting scheme not found.")
 
 class reb_hash_pointer_pair(Structure):
     _fields_ = [("hash", c_uint32),
@@ -55,9 +72,35 @@ class reb_collision(Structure):
                 ("time", c_double),
                 ("ri", c_int)]
 
+class reb_simulation_integrator_leapfrog(Structure):
+    """
+    This class is an abstraction of the C-struct reb_simulation_integrator_leapfrog.
+    It controls the behaviour of the LEAPFROG integrator.
+    
+    This struct should be accessed via the simulation class only. Here is an 
+    example:
+
+    >>> sim = rebound.Simulation()
+    >>> sim.ri_leapfrog.splitting = "yoshida4"
+    
+    :ivar str splitting:
+        The splitting scheme. The default is the second order scheme ``'leapfrog'``.
+        Higher order schemes are ``'yoshida4'``, ``'yoshida6'`` and ``'yoshida8'``.
+        These require 3, 7 and 15 force evaluations per timestep respectively.
+    """
+    @property
+    def splitting(self):
+        return _splitting_name(self._splitting)
+    @splitting.setter
+    def splitting(self, value):
+        self._splitting = _splitting_value(value)
+
+    _fields_ = [("_splitting", c_int)]
+
 class reb_simulation_integrator_wh(Structure):
     _fields_ = [(("allocatedN"), c_int),
-                ("eta", POINTER(c_double))]
+                ("eta", POINTER(c_double)),
+                ("mu", POINTER(c_double))]
 
 class reb_simulation_integrator_sei(Structure):
     """
@@ -91,7 +134,9 @@ class reb_simulation_integrator_ias15(Structure):
     _fields_ = [("epsilon", c_double),
                 ("min_dt", c_double),
                 ("epsilon_global", c_uint),
+                ("block_levels", c_uint),
                 ("iterations_max_exceeded", c_ulong),
+                ("block_unsupported", c_ulong),
                 ("allocatedN", c_int),
                 ("at", POINTER(c_double)),
                 ("x0", POINTER(c_double)),
@@ -105,7 +150,54 @@ class reb_simulation_integrator_ias15(Structure):
                 ("csb", reb_dp7),
                 ("e", reb_dp7),
                 ("br", reb_dp7),
-                ("er", reb_dp7)]
+                ("er", reb_dp7),
+                ("_block_allocatedN", c_int),
+                ("_block_level", POINTER(c_int)),
+                ("_block_level_next", POINTER(c_int)),
+                ("_block_active", POINTER(c_int)),
+                ("_block_dt", POINTER(c_double)),
+                ("_block_save", POINTER(c_double)),
+                ("_block_rec", POINTER(c_double)),
+                ("_block_rec_allocatedN", c_int)]
+
+class reb_simulation_collision_softsphere(Structure):
+    """
+    This class is an abstraction of the C-struct reb_simulation_collision_softsphere.
+    It controls the behaviour of the soft-sphere (spring-dashpot) contact model
+    which is used when the collision module is set to ``'softsphere'``.
+    
+    This struct should be accessed via the simulation class only. Here is an 
+    example:
+
+    >>> sim = rebound.Simulation()
+    >>> sim.collision = "softsphere"
+    >>> sim.softsphere.k = 1e4
+    >>> sim.softsphere.skin = 0.1
+    
+    :ivar float k:      
+        Spring constant of the contact force (default 0). 
+    :ivar float gamma:      
+        Damping coefficient of the contact force (default 0), in units of 
+        mass over time. 
+    :ivar float skin:      
+        Skin distance of the Verlet neighbour list (default 0). The list is 
+        only rebuilt once particles have moved by more than half the skin distance.
+    :ivar int rebuilds_N:      
+        Number of times the neighbour list has been rebuilt.
+    """
+    _fields_ = [("k", c_double),
+                ("gamma", c_double),
+                ("skin", c_double),
+                ("rebuilds_N", c_long),
+                ("_pairs", c_void_p),
+                ("_pairs_N", c_int),
+                ("_pairs_allocatedN", c_int),
+                ("_x0", POINTER(reb_vec3d)),
+                ("_x0_allocatedN", c_int),
+                ("_N_last", c_int),
+                ("_shift0", c_double),
+                ("_particles_changed", c_ulong),
+                ("_particles_changed_last", c_ulong)]
 
 class reb_simulation_integrator_whfast(Structure):
     """
@@ -138,17 +230,78 @@ class reb_simulation_integrator_whfast(Structure):
         If you set safe_mode to 0, the speed and accuracy of WHFast improves.
         However, make sure you are aware of the consequences. Read the iPython tutorial
         on advanced WHFast usage to learn more.
+    :ivar str splitting:
+        The splitting scheme. The default is the second order Wisdom-Holman 
+        scheme ``'leapfrog'``. Available higher order schemes are ``'saba2'``, 
+        ``'saba3'``, ``'saba4'``, ``'sbab2'``, ``'sbab3'``, ``'sbab4'`` 
+        (Laskar & Robutel 2001) and ``'yoshida4'``, ``'yoshida6'``, ``'yoshida8'``.
+        These do not support symplectic correctors or variational particles.
+    :ivar str coordinates:
+        The coordinate system used by WHFast. The default is ``'jacobi'``. 
+        With ``'democraticheliocentric'`` or ``'whds'`` (Hernandez & Dehnen 2017), 
+        WHFast uses heliocentric positions and barycentric velocities. These 
+        do not support symplectic correctors or variational particles.
+    :ivar float epsilon:
+        Accuracy parameter of the adaptive timestep. The default value 0 
+        uses the fixed timestep ``dt``. If positive, WHFast compares one step 
+        with two half steps, rejects steps whose relative error is larger than 
+        epsilon and adjusts ``dt`` after every step. This costs three force 
+        evaluations per step and the integrator is then no longer symplectic.
+        Symplectic correctors and variational particles are not supported.
+    :ivar float min_dt:
+        The minimum allowed timestep if epsilon is positive (default 0).
     """
+    @property
+    def splitting(self):
+        return _splitting_name(self._splitting)
+    @splitting.setter
+    def splitting(self, value):
+        self._splitting = _splitting_value(value)
+
+    @property
+    def coordinates(self):
+        """
+        Get or set the coordinate system used by WHFast.
+
+        Available coordinate systems are:
+
+        - ``'jacobi'`` (default)
+        - ``'democraticheliocentric'``
+        - ``'whds'``
+        """
+        i = self._coordinates
+        for name, _i in WHFAST_COORDINATES.items():
+            if i==_i:
+                return name
+        return i
+    @coordinates.setter
+    def coordinates(self, value):
+        if isinstance(value, int):
+            self._coordinates = c_int(value)
+        elif isinstance(value, basestring):
+            value = value.lower()
+            if value in WHFAST_COORDINATES: 
+                self._coordinates = WHFAST_COORDINATES[value]
+            else:
+                raise ValueError("Warning. Coordinate system not found.")
+
     _fields_ = [("corrector", c_uint),
                 ("recalculate_jacobi_this_timestep", c_uint),
                 ("safe_mode", c_uint),
+                ("_splitting", c_int),
+                ("_coordinates", c_int),
+                ("epsilon", c_double),
+                ("min_dt", c_double),
                 ("p_j", POINTER(Particle)),
                 ("eta", POINTER(c_double)),
                 ("Mtotal", c_double),
                 ("is_synchronized", c_uint),
                 ("allocatedN", c_uint),
                 ("timestep_warning", c_uint),
-                ("recalculate_jacobi_but_not_synchronized_warning", c_uint)]
+                ("recalculate_jacobi_but_not_synchronized_warning", c_uint),
+                ("_N_massive", c_uint),
+                ("_p_j_save", POINTER(Particle)),
+                ("_allocated_N_save", c_uint)]
 
 class Orbit(Structure):
     """
@@ -525,6 +678,8 @@ class Simulation(Structure):
         - ``'none'`` (default)
         - ``'direct'``
         - ``'tree'``
+        - ``'softsphere'``
+        - ``'bvh'``
         
         Check the online documentation for a full description of each of the modules. 
         """
@@ -713,6 +868,54 @@ class Simulation(Structure):
         clibrebound.reb_tools_calculate_lyapunov.restype = c_double
         return clibrebound.reb_tools_calculate_lyapunov(byref(self))
     
+    def megno_ensemble(self, members, tmax):
+        """
+        Calculate MEGNO and the Lyapunov Characteristic Number (LCN) for an ensemble of simulations.
+
+        Each member of the ensemble is a copy of this simulation (integrator, timestep and all other 
+        settings) in which the particles are replaced by the particles of the member. MEGNO is 
+        initialized for every member, and all members are integrated up to tmax in C. If REBOUND 
+        is compiled with OpenMP, the members are integrated in parallel. This is much faster than 
+        creating one simulation per member in Python, for example to calculate a MEGNO map. 
+        This simulation itself is not modified.
+
+        Parameters
+        ----------
+        members : list
+            Each entry is a list of N particles, where N is the number of particles in this simulation.
+        tmax : float
+            Time up to which each member is integrated.
+
+        Returns
+        -------
+        A tuple of two lists with the MEGNO and the LCN of each member. If the integration of a 
+        member did not finish successfully, for example because a particle escaped, both values are NaN.
+
+        Examples
+        --------
+
+        >>> sim = rebound.Simulation()
+        >>> sim.add(m=1.)
+        >>> sim.add(m=1e-3, a=1.)
+        >>> sim.add(m=1e-3, a=1.5)
+        >>> members = []
+        >>> for a in [1.4,1.5,1.6]:
+        >>>     members.append([sim.particles[0], sim.particles[1], rebound.Particle(simulation=sim, m=1e-3, a=a)])
+        >>> megno, lyapunov = sim.megno_ensemble(members, 100.)
+        """
+        N = self.N - self.N_var
+        N_members = len(members)
+        particles = (Particle*(N*N_members))()
+        for k, member in enumerate(members):
+            if len(member)!=N:
+                raise ValueError("Each member needs to have the same number of particles as the simulation.")
+            for i, p in enumerate(member):
+                particles[k*N+i] = p
+        megno = (c_double*N_members)()
+        lyapunov = (c_double*N_members)()
+        clibrebound.reb_tools_megno_ensemble(byref(self), particles, c_int(N_members), c_double(tmax), megno, lyapunov)
+        return list(megno), list(lyapunov)
+    
 # Particle add function, used to be called particle_add() and add_particle() 
     def add(self, particle=None, **kwargs):   
         """
@@ -1203,15 +1406,20 @@ class reb_simulation_integrator_hermes(Structure):
                 ("radius_switch_factor", c_double),
                 ("mini_active", c_int),
                 ("collision_this_global_dt", c_int),
-                ("energy_before_timestep", c_double),
                 ("global_index_from_mini_index", POINTER(c_int)),
                 ("global_index_from_mini_index_N",c_int),
                 ("global_index_from_mini_index_Nmax",c_int),
+                ("_mini_index_old", POINTER(c_int)),
+                ("_mini_index_old_Nmax",c_int),
                 ("is_in_mini", POINTER(c_int)),
                 ("is_in_mini_Nmax", c_int),
                 ("a_i", POINTER(c_double)),
                 ("a_f", POINTER(c_double)),
                 ("a_Nmax", c_int),
+                ("_rhill", POINTER(c_double)),
+                ("_rhill_Nmax", c_int),
+                ("_grid", POINTER(c_int)),
+                ("_grid_Nmax", c_int),
                 ("timestep_too_large_warning", c_int),
                 ("steps", c_ulonglong),
                 ("steps_miniactive", c_ulonglong),
@@ -1239,6 +1447,8 @@ Simulation._fields_ = [
                 ("_particles", POINTER(Particle)),
                 ("gravity_cs", POINTER(reb_vec3d)),
                 ("gravity_cs_allocatedN", c_int),
+                ("_gravity_var_geometry", POINTER(c_double)),
+                ("_gravity_var_geometry_allocatedN", c_int),
                 ("tree_root", c_void_p),
                 ("tree_needs_update", c_int),
                 ("opening_angle2", c_double),
@@ -1252,6 +1462,8 @@ Simulation._fields_ = [
                 ("usleep", c_double),
                 ("track_energy_offset", c_int),
                 ("energy_offset", c_double),
+                ("rand_seed", c_uint),
+                ("rand_counter", c_uint64),
                 ("boxsize", reb_vec3d),
                 ("boxsize_max", c_double),
                 ("root_size", c_double),
@@ -1262,6 +1474,8 @@ Simulation._fields_ = [
                 ("nghostx", c_int),
                 ("nghosty", c_int),
                 ("nghostz", c_int),
+                ("_ghostbox_table", c_void_p),
+                ("_ghostbox_table_allocatedN", c_int),
                 ("collision_resolve_keep_sorted", c_int),
                 ("collisions", c_void_p),
                 ("collisions_allocatedN", c_int),
@@ -1269,6 +1483,12 @@ Simulation._fields_ = [
                 ("collisions_plog", c_double),
                 ("max_radius", c_double*2),
                 ("collisions_Nlog", c_long),
+                ("softsphere", reb_simulation_collision_softsphere),
+                ("_bvh_nodes", c_void_p),
+                ("_bvh_nodes_N", c_int),
+                ("_bvh_nodes_allocatedN", c_int),
+                ("_bvh_N", c_int),
+                ("_bvh_area", c_double),
                 ("_calculate_megno", c_int),
                 ("megno_Ys", c_double),
                 ("megno_Yss", c_double),
@@ -1286,6 +1506,7 @@ Simulation._fields_ = [
                 ("ri_whfast", reb_simulation_integrator_whfast),
                 ("ri_ias15", reb_simulation_integrator_ias15),
                 ("ri_hermes", reb_simulation_integrator_hermes),
+                ("ri_leapfrog", reb_simulation_integrator_leapfrog),
                 ("_additional_forces", CFUNCTYPE(None,POINTER(Simulation))),
                 ("_post_timestep_modifications", CFUNCTYPE(None,POINTER(Simulation))),
                 ("_heartbeat", CFUNCTYPE(None,POINTER(Simulation))),
@@ -1316,6 +1537,49 @@ AFF = CFUNCTYPE(None,POINTER_REB_SIM)
 CORFF = CFUNCTYPE(c_double,POINTER_REB_SIM, c_double)
 COLRFF = CFUNCTYPE(c_int, POINTER_REB_SIM, reb_collision)
 
+def integrate_whfast_batch(simulations, tmax):
+    """
+    Integrate several simulations with WHFast in lockstep until time tmax.
+
+    All simulations are advanced together by one C function which stores their 
+    particles in shared arrays and carries out each part of the WHFast step for all 
+    simulations in one loop. For small systems, for example an ensemble of planetary 
+    systems with slightly different initial conditions, this is much faster than 
+    calling integrate() for each simulation.
+
+    The simulations need to use WHFast with Jacobi coordinates and the same number of 
+    particles, time, timestep, G, softening and splitting. Collisions, boundaries, 
+    additional forces, variational particles, correctors, heartbeat functions and exit 
+    conditions are not supported. The integration behaves like integrate() with 
+    safe_mode=0 and exact_finish_time=0; the results are identical.
+
+    Parameters
+    ----------
+    simulations : list
+        The simulations to be integrated.
+    tmax : float
+        The time to be integrated to.
+
+    Examples
+    --------
+
+    >>> sims = []
+    >>> for a in [1.4,1.5,1.6]:
+    >>>     sim = rebound.Simulation()
+    >>>     sim.integrator = "whfast"
+    >>>     sim.dt = 0.01
+    >>>     sim.add(m=1.)
+    >>>     sim.add(m=1e-3, a=1.)
+    >>>     sim.add(m=1e-3, a=a)
+    >>>     sims.append(sim)
+    >>> rebound.integrate_whfast_batch(sims, 100.)
+    """
+    M = len(simulations)
+    sims = (POINTER_REB_SIM*M)(*[pointer(sim) for sim in simulations])
+    ret_value = clibrebound.reb_integrate_whfast_batch(sims, c_int(M), c_double(tmax))
+    if ret_value == 1:
+        raise SimulationError("The simulations cannot be integrated in a batch.")
+
 # Import at the end to avoid circular dependence
 from . import horizons
 from . import debug
@@ -1 +1,18 @@
+import unittest
 
+class SimulationTestCase(unittest.TestCase):
+    """
+    TestCase with assertions to compare the particles of two simulations.
+    """
+    def assertSameParticles(self, particles1, particles2, attrs=("x","y","z","vx","vy","vz"), delta=None):
+        """
+        Asserts that the attributes attrs of all particles agree.
+        Without delta, the values have to be bitwise identical.
+        """
+        self.assertEqual(len(particles1), len(particles2))
+        for p1, p2 in zip(particles1, particles2):
+            for attr in attrs:
+                if delta is None:
+                    self.assertEqual(getattr(p1,attr), getattr(p2,attr))
+                else:
+                    self.assertAlmostEqual(getattr(p1,attr), getattr(p2,attr), delta=delta)
@@ -17,6 +17,23 @@ class TestBoundary(unittest.TestCase):
         with self.assertRaises(rebound.NoParticles):
             sim.integrate(2.)
     
+    def test_open_edge(self):
+        # The box is the half-open interval [-L/2,L/2).
+        sim = rebound.Simulation()
+        sim.boundary = "open"
+        sim.gravity = "none"
+        sim.integrator = "leapfrog"
+        sim.dt = 1.
+        sim.configure_box(10.)
+        sim.add(m=0.1, x=-5.)
+        sim.add(m=0.1, x=4., vx=1.)
+        sim.add(m=0.1, y=-4., vy=-1.)
+        self.assertEqual(sim.N,3)
+        sim.integrate(1.)
+        self.assertEqual(sim.particles[1].y,-5.)
+        self.assertEqual(sim.N,2)
+        self.assertEqual(sim.particles[0].x,-5.)
+    
     def test_periodic(self):
         sim = rebound.Simulation()
         sim.boundary = "periodic"
@@ -28,6 +45,37 @@ class TestBoundary(unittest.TestCase):
         self.assertAlmostEqual(sim.particles[0].x,1,1e-16)
         self.assertEqual(sim.N,1)
     
+    def test_open_energy_offset(self):
+        sim = rebound.Simulation()
+        sim.boundary = "open"
+        sim.configure_box(10.)
+        sim.track_energy_offset = 1
+        sim.add(m=1.)
+        sim.add(m=1e-3, a=1., e=0.1)
+        sim.add(m=1e-3, a=2., e=0.1)
+        sim.add(m=1e-3, x=3., vx=40., vy=2.)
+        sim.add(m=1e-3, x=-3., vx=-40., vz=3.)
+        sim.add(m=1e-3, y=3., vy=35.)
+        sim.N_active = 4
+        E0 = sim.calculate_energy()
+        sim.integrate(0.3)
+        self.assertEqual(sim.N,3)
+        self.assertEqual(sim.N_active,3)
+        self.assertAlmostEqual(sim.particles[2].a,2.,delta=1e-2)
+        self.assertAlmostEqual(sim.calculate_energy(),E0,delta=1e-8*abs(E0))
+    
+    def test_periodic_shear(self):
+        sim = rebound.Simulation()
+        sim.boundary = "shear"
+        sim.integrator = "sei"
+        sim.ri_sei.OMEGA = 1.
+        sim.configure_box(10.)
+        sim.add(m=0.1,x=4.9, vx=1.)
+        sim.integrate(0.1)
+        self.assertLess(sim.particles[0].x,-4.)
+        self.assertLess(abs(sim.particles[0].y),5.)
+        self.assertLess(abs(sim.particles[0].z),5.)
     
+
 if __name__ == "__main__":
     unittest.main()
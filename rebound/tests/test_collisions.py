@@ -2,8 +2,9 @@ import rebound
 import unittest
 import math
 import numpy as np
+from rebound.tests import SimulationTestCase
 
-class TestCollisions(unittest.TestCase):
+class TestCollisions(SimulationTestCase):
     
     def test_tree_remove_both(self):
         sim = rebound.Simulation()
@@ -91,6 +92,159 @@ class TestCollisions(unittest.TestCase):
         sim.integrate(2.*sim.dt)
         self.assertLess(sim.N,25)
 
+    def test_direct_merge_keep_sorted(self):
+        sim = rebound.Simulation()
+        sim.integrator = "leapfrog"
+        sim.collision  = "direct"
+        sim.collision_resolve = "merge"
+        sim.collision_resolve_keep_sorted = 1
+        np.random.seed(1)
+        for i in range(100):
+            sim.add(m=1., r=0.5, x=np.random.uniform(-5,5),
+                                y=np.random.uniform(-5,5),
+                                z=np.random.uniform(-5,5),hash=i)
+        sim.N_active = 50
+        sim.dt = 0.001
+        sim.integrate(sim.dt)
+        self.assertLess(sim.N,100)
+        self.assertLess(sim.N_active,50)
+        hashes = [p.hash for p in sim.particles]
+        self.assertEqual(hashes,sorted(hashes))
+        self.assertEqual(sim.N_active,len([h for h in hashes if h<50]))
+        self.assertAlmostEqual(sum([p.m for p in sim.particles]),100.,delta=1e-12)
+
+    def test_merge_energy_offset(self):
+        sim = rebound.Simulation()
+        sim.integrator = "leapfrog"
+        sim.collision  = "direct"
+        sim.collision_resolve = "merge"
+        sim.track_energy_offset = 1
+        sim.add(m=1., r=0.1)
+        sim.add(m=1e-3, r=0.01, a=1.)
+        sim.add(m=1e-3, r=0.01, a=1., f=0.015)
+        sim.dt = 1e-4
+        E0 = sim.calculate_energy()
+        sim.integrate(sim.dt)
+        self.assertEqual(sim.N,2)
+        self.assertNotEqual(sim.energy_offset,0.)
+        dE = abs((sim.calculate_energy() - E0)/E0)
+        self.assertLess(dE,1e-12)
+
+    def test_merge_energy_offset_two_mergers(self):
+        for keep_sorted in [0, 1]:
+            sim = rebound.Simulation()
+            sim.integrator = "leapfrog"
+            sim.collision  = "direct"
+            sim.collision_resolve = "merge"
+            sim.collision_resolve_keep_sorted = keep_sorted
+            sim.track_energy_offset = 1
+            sim.add(m=1., r=0.1, x=-1.)
+            sim.add(m=1., r=0.1, x=-0.9, vy=0.1)
+            sim.add(m=1., r=0.1, x=1., vz=0.1)
+            sim.add(m=1., r=0.1, x=0.9)
+            sim.dt = 1e-6
+            E0 = sim.calculate_energy()
+            sim.integrate(sim.dt)
+            self.assertEqual(sim.N,2)
+            dE = abs((sim.calculate_energy() - E0)/E0)
+            self.assertLess(dE,1e-12)
+
+    def test_softsphere_elastic(self):
+        sim = rebound.Simulation()
+        sim.integrator = "leapfrog"
+        sim.gravity    = "none"
+        sim.collision  = "softsphere"
+        sim.softsphere.k = 1e5
+        sim.softsphere.skin = 0.1
+        sim.add(m=1., r=0.5, x=-1., vx=1.)
+        sim.add(m=1., r=0.5, x=1., vx=-1.)
+        sim.dt = 1e-4
+        sim.integrate(2.)
+        self.assertAlmostEqual(sim.particles[0].vx,-1.,delta=1e-3)
+        self.assertAlmostEqual(sim.particles[1].vx,1.,delta=1e-3)
+        self.assertLess(sim.softsphere.rebuilds_N,100)
+    
+    def test_softsphere_damped(self):
+        sim = rebound.Simulation()
+        sim.integrator = "leapfrog"
+        sim.gravity    = "none"
+        sim.collision  = "softsphere"
+        sim.softsphere.k = 1e5
+        sim.softsphere.gamma = 50.
+        sim.add(m=1., r=0.5, x=-1., vx=1.)
+        sim.add(m=1., r=0.5, x=1., vx=-1.)
+        sim.dt = 1e-4
+        sim.integrate(2.)
+        self.assertLess(sim.particles[0].vx,0.)
+        self.assertGreater(sim.particles[0].vx,-0.9)
+        self.assertAlmostEqual(sim.particles[0].vx+sim.particles[1].vx,0.,delta=1e-12)
+
+    def test_softsphere_add_remove(self):
+        sim = rebound.Simulation()
+        sim.integrator = "leapfrog"
+        sim.gravity    = "none"
+        sim.collision  = "softsphere"
+        sim.softsphere.k = 1e5
+        sim.softsphere.skin = 0.1
+        sim.add(m=1., r=0.5, x=0.)
+        sim.add(m=1., r=0.1, x=1.5)
+        sim.dt = 1e-4
+        sim.step()
+        rebuilds_N = sim.softsphere.rebuilds_N
+        # Same number of particles at the same positions, but the new particle overlaps with particle 0
+        sim.remove(1)
+        sim.add(m=1., r=1.5, x=1.5)
+        sim.step()
+        self.assertEqual(sim.softsphere.rebuilds_N, rebuilds_N+1)
+        self.assertLess(sim.particles[0].vx,0.)
+        self.assertGreater(sim.particles[1].vx,0.)
+
+    def test_bvh_remove_both(self):
+        sim = rebound.Simulation()
+        boxsize = 50000.           
+        sim.configure_box(boxsize)
+        sim.integrator = "leapfrog"
+        sim.boundary   = "open"
+        sim.collision  = "bvh"
+        def cor_remove_both(r, c):
+            r.contents.collisions_Nlog += 1
+            return 3
+        sim.collision_resolve = cor_remove_both
+        
+        while sim.N< 10:
+            sim.add(m=1., r=100., x=np.random.uniform(-20,20),
+                                y=np.random.uniform(-20,20),
+                                z=np.random.uniform(-20,20))
+        sim.dt = 0.001
+        with self.assertRaises(rebound.NoParticles):
+            sim.integrate(1000.)
+        self.assertEqual(sim.collisions_Nlog,5)
+
+    def test_bvh_same_as_direct(self):
+        sims = []
+        for collision in ["direct", "bvh"]:
+            sim = rebound.Simulation()
+            sim.integrator = "leapfrog"
+            sim.gravity    = "none"
+            sim.collision  = collision
+            sim.collision_resolve = "merge"
+            sim.collision_resolve_keep_sorted = 1
+            np.random.seed(3)
+            sim.add(m=1., r=2.)
+            for i in range(200):
+                sim.add(m=1e-3, r=0.01, x=np.random.uniform(-10,10),
+                                    y=np.random.uniform(-10,10),
+                                    z=np.random.uniform(-1,1),
+                                    vx=np.random.normal(0.,0.3),
+                                    vy=np.random.normal(0.,0.3),
+                                    vz=np.random.normal(0.,0.3))
+            sim.dt = 0.01
+            sim.integrate(10.)
+            sims.append(sim)
+        sim_direct, sim_bvh = sims
+        self.assertLess(sim_direct.N,201)
+        self.assertSameParticles(sim_direct.particles, sim_bvh.particles, attrs=("m",), delta=1e-14)
+
 
 if __name__ == "__main__":
     unittest.main()
@@ -2,8 +2,9 @@ import rebound
 import unittest
 import os
 import rebound.data as data
+from rebound.tests import SimulationTestCase
 
-class TestHermes(unittest.TestCase):
+class TestHermes(SimulationTestCase):
     
     def test_no_close_encounter(self):
         sim = rebound.Simulation()
@@ -65,6 +66,53 @@ class TestHermes(unittest.TestCase):
         print(abs((x_hermes-x_ias15)/x_ias15))
         self.assertEqual(x_hermes,x_ias15)
 
+    def test_encounter_many_massive(self):
+        # More than 32 massive particles use the spatial hash to find encounters
+        sim = rebound.Simulation()
+        sim.add(m=1.)
+        for i in range(40):
+            sim.add(m=1e-7, a=1.+0.2*i, f=0.7*i)
+        sim.N_active = sim.N
+        for i in range(40):
+            sim.add(m=0., a=1.1+0.2*i, f=0.7*i+3.)
+        rh = sim.particles[35].a*pow(sim.particles[35].m/3.,1./3)
+        sim.add(primary=sim.particles[35], a=0.5*rh, m=0.)
+        sim.integrator = "hermes"
+        sim.ri_hermes.hill_switch_factor = 3.
+        sim.dt = 1e-3
+        sim.step()
+        self.assertEqual(sim.ri_hermes.mini_active, 1)
+        self.assertEqual(sim.ri_hermes.mini.contents.N, 42)
+        self.assertEqual(sim.ri_hermes.global_index_from_mini_index[41], 81)
+
+    def test_mini_persistent(self):
+        # Particles stay in the mini simulation across timesteps while others pass by
+        sims = []
+        for integrator in ["hermes", "ias15"]:
+            sim = rebound.Simulation()
+            sim.add(m=1.)
+            sim.add(m=1.e-3, a=1.523,e=0.0146,f=0.24)
+            rh = sim.particles[1].a*pow(sim.particles[1].m/(3.*sim.particles[0].m),1./3)
+            sim.add(primary=sim.particles[1], a=0.25*rh, e=0.000123, f=2.3, m=1e-8)
+            sim.N_active = 2
+            for i in range(10):
+                sim.add(a=2.5+0.1*i, f=0.6*i, m=0.)
+            sim.add(primary=sim.particles[1], a=0.3*rh, f=1.2, m=0.)
+            sim.integrator = integrator
+            sim.dt = 1e-4*sim.particles[1].P
+            sims.append(sim)
+        sim, sim_ias15 = sims
+        sim.ri_hermes.hill_switch_factor = 2.
+        for i in range(200):
+            sim.step()
+        self.assertEqual(sim.ri_hermes.mini.contents.N, 4)
+        self.assertEqual([sim.ri_hermes.global_index_from_mini_index[i] for i in range(4)], [0,1,2,13])
+        sim_ias15.integrate(sim.t)
+        ps = [sim.particles[i] for i in [1,2,13]]
+        ps_ias15 = [sim_ias15.particles[i] for i in [1,2,13]]
+        self.assertSameParticles(ps, ps_ias15, attrs=("x",), delta=1e-9)
+        self.assertSameParticles(ps, ps_ias15, attrs=("vy",), delta=1e-8)
+
     def test_planetesimal_collision(self):
         sim = rebound.Simulation()
         sim.add(m=1.)
@@ -89,6 +137,33 @@ class TestHermes(unittest.TestCase):
         dE = abs((sim.calculate_energy() - E0)/E0)
         self.assertLess(dE,5e-13)
 
+    def test_planetesimal_collision_outside_mini(self):
+        sim = rebound.Simulation()
+        sim.add(m=1.)
+        sim.add(m=1e-5,r=1.6e-4,a=0.5,e=0.1)
+        sim.N_active = 2
+        sim.add(m=1e-8,r=4e-5,a=0.55,e=0.4,f=-0.94)
+        # Planetesimals which are never in the mini simulation
+        for i in range(40):
+            sim.add(m=1e-7,r=1e-6,a=1.5+0.02*i,f=0.7*i)
+        sim.move_to_com()
+        
+        sim.integrator = "hermes"
+        sim.ri_hermes.hill_switch_factor = 3.
+        sim.ri_hermes.radius_switch_factor = 20.
+        sim.dt = 0.0001
+        sim.testparticle_type = 1
+        sim.track_energy_offset = 1;
+        sim.collision_resolve_keep_sorted = 1
+        sim.collision = "direct"
+        sim.collision_resolve = "merge"
+        
+        E0 = sim.calculate_energy()
+        sim.integrate(1)
+        self.assertEqual(sim.N,42)
+        dE = abs((sim.calculate_energy() - E0)/E0)
+        self.assertLess(dE,5e-13)
+
     def test_massive_ejection(self):
         sim = rebound.Simulation()
         sim.add(m=1.)
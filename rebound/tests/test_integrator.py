@@ -1,9 +1,11 @@
 import rebound
 import unittest
 import math
+import warnings
 import rebound.data
+from rebound.tests import SimulationTestCase
 
-class TestIntegrator2(unittest.TestCase):
+class TestIntegrator2(SimulationTestCase):
     def test_whfast_verylargedt(self):
         sim = rebound.Simulation()
         sim.add(m=1.)
@@ -41,6 +43,90 @@ class TestIntegrator2(unittest.TestCase):
         x1 = sim.calculate_energy()
         self.assertAlmostEqual(x0, x1, delta=1e-14)
     
+    def test_whfast_many_kepler_orbits(self):
+        # Exercises the batched Kepler solver, including the fallback for hyperbolic and eccentric orbits.
+        sim = rebound.Simulation()
+        sim.add(m=1.)
+        for i in range(11):
+            if i%3==0:
+                sim.add(m=0., a=-1.-i, e=1.5+0.1*i, f=0.1)
+            else:
+                sim.add(m=0., a=1.+0.3*i, e=0.09*i, f=0.7*i)
+        sim.integrator = "whfast"
+        sim.dt = 0.0123
+        orbits0 = sim.calculate_orbits()
+        sim.integrate(20.)
+        orbits1 = sim.calculate_orbits()
+        for o0, o1 in zip(orbits0, orbits1):
+            self.assertAlmostEqual(o0.a, o1.a, delta=1e-10*abs(o0.a))
+            self.assertAlmostEqual(o0.e, o1.e, delta=1e-10)
+    
+    def test_whfast_democraticheliocentric(self):
+        for coordinates in ["democraticheliocentric", "whds"]:
+            sim = rebound.Simulation()
+            sim.add(m=1.)
+            sim.add(m=1e-3, a=1., e=0.05)
+            sim.add(m=1e-3, a=1.6, e=0.05, f=1.)
+            sim.add(m=0., a=2.5, e=0.1, f=2.)
+            sim.move_to_com()
+            sim.integrator = "whfast"
+            sim.ri_whfast.coordinates = coordinates
+            self.assertEqual(sim.ri_whfast.coordinates, coordinates)
+            sim.dt = 0.01
+            e0 = sim.calculate_energy()
+            sim.integrate(1000.)
+            e1 = sim.calculate_energy()
+            self.assertLess(abs((e1-e0)/e0), 1e-8)
+            self.assertAlmostEqual(sim.particles[3].a, 2.5, delta=0.02)
+            com = sim.calculate_com()
+            self.assertAlmostEqual(com.x, 0., delta=1e-13)
+            self.assertAlmostEqual(com.vx, 0., delta=1e-13)
+
+    def test_splitting_order(self):
+        def error(integrator, splitting, dt):
+            sim = rebound.Simulation()
+            sim.add(m=1.)
+            sim.add(m=1e-3, a=1., e=0.1)
+            sim.add(m=1e-3, a=1.7, e=0.05, f=1.)
+            sim.move_to_com()
+            sim.integrator = integrator
+            if integrator == "leapfrog":
+                sim.ri_leapfrog.splitting = splitting
+            else:
+                sim.ri_whfast.splitting = splitting
+                self.assertEqual(sim.ri_whfast.splitting, splitting)
+            sim.dt = dt
+            e0 = sim.calculate_energy()
+            sim.integrate(10.)
+            return math.fabs((sim.calculate_energy()-e0)/e0)
+        # Error ratios for a factor of two in the timestep
+        self.assertGreater(error("leapfrog", "yoshida4", 0.04)/error("leapfrog", "yoshida4", 0.02), 12.)
+        self.assertGreater(error("leapfrog", "yoshida6", 0.08)/error("leapfrog", "yoshida6", 0.04), 48.)
+        # SABA and SBAB remove the leading error term of the Wisdom-Holman scheme
+        for splitting in ["saba2", "saba4", "sbab3"]:
+            self.assertLess(error("whfast", splitting, 0.1), 0.05*error("whfast", "leapfrog", 0.1))
+
+    def test_splitting_stage_times(self):
+        c0 = 0.5-math.sqrt(3.)/6.
+        for integrator in ["leapfrog", "whfast"]:
+            sim = rebound.Simulation()
+            sim.add(m=1.)
+            sim.add(m=1e-3, a=1.)
+            sim.integrator = integrator
+            if integrator == "leapfrog":
+                sim.ri_leapfrog.splitting = "saba2"
+            else:
+                sim.ri_whfast.splitting = "saba2"
+            sim.dt = 0.1
+            times = []
+            sim.additional_forces = lambda s: times.append(s.contents.t)
+            sim.step()
+            # Forces are evaluated at the times of the two SABA2 stages.
+            self.assertEqual(len(times), 2)
+            self.assertAlmostEqual(times[0], c0*0.1, delta=1e-15)
+            self.assertAlmostEqual(times[1], (1.-c0)*0.1, delta=1e-15)
+            self.assertAlmostEqual(sim.t, 0.1, delta=1e-15)
+
     def test_whfast_verylargedt_hyperbolic(self):
         sim = rebound.Simulation()
         sim.add(m=1.)
@@ -53,8 +139,105 @@ class TestIntegrator2(unittest.TestCase):
         x1 = sim.calculate_energy()
         self.assertAlmostEqual(x0, x1, delta=1e-14)
 
+    def test_whfast_batch(self):
+        for splitting in ["leapfrog", "saba2"]:
+            sims_batch = []
+            sims = []
+            # Not a multiple of the number of lanes in the Kepler solver
+            for k in range(7):
+                for sims_k in [sims_batch, sims]:
+                    sim = rebound.Simulation()
+                    sim.integrator = "whfast"
+                    sim.ri_whfast.splitting = splitting
+                    sim.ri_whfast.safe_mode = 0
+                    sim.exact_finish_time = 0
+                    sim.dt = 0.0123
+                    sim.add(m=1.)
+                    sim.add(m=1e-3, a=1., e=0.05*k)
+                    sim.add(m=1e-4, a=1.3+0.02*k, e=0.1, inc=0.1, f=k)
+                    sim.add(m=0., a=2., e=0.2, omega=k)
+                    sim.move_to_com()
+                    sims_k.append(sim)
+            rebound.integrate_whfast_batch(sims_batch, 10.)
+            rebound.integrate_whfast_batch(sims_batch, 20.)
+            for sim, sim_batch in zip(sims, sims_batch):
+                sim.integrate(10., exact_finish_time=0)
+                sim.integrate(20., exact_finish_time=0)
+                self.assertEqual(sim.t, sim_batch.t)
+                self.assertSameParticles(sim.particles, sim_batch.particles, attrs=("x","vz"))
+        sims[1].dt = 0.01
+        with self.assertRaises(rebound.SimulationError):
+            rebound.integrate_whfast_batch(sims[:2], 30.)
+
+    def test_whfast_batch_test_particles(self):
+        sims_batch = []
+        sims = []
+        for k in range(3):
+            for sims_k in [sims_batch, sims]:
+                sim = rebound.Simulation()
+                sim.integrator = "whfast"
+                sim.ri_whfast.safe_mode = 0
+                sim.exact_finish_time = 0
+                sim.dt = 0.0123
+                sim.add(m=0.7+0.3*k)
+                sim.add(m=3e-4, a=1., e=0.05)
+                for j in range(8):
+                    sim.add(m=0., a=2.+0.3*j, e=0.1, f=j+k)
+                # Not in the centre of mass frame, the rescaling of the centre of mass rounds
+                sim.particles[0].x += 1e3
+                sim.particles[0].vy += 1e2
+                sims_k.append(sim)
+        rebound.integrate_whfast_batch(sims_batch, 20.)
+        for sim, sim_batch in zip(sims, sims_batch):
+            sim.integrate(20., exact_finish_time=0)
+            self.assertSameParticles(sim.particles, sim_batch.particles)
+
+    def test_whfast_batch_timestep_warning(self):
+        sims = []
+        for k in range(7):
+            sim = rebound.Simulation()
+            sim.integrator = "whfast"
+            sim.ri_whfast.safe_mode = 0
+            sim.dt = 0.0123
+            sim.add(m=1.)
+            sim.add(m=1e-3, a=1.)
+            if k==3:
+                # The Kepler solver falls back to bisection for this orbit.
+                sim.add(m=0., a=0.075473527214457, e=0.994834056544483, f=4.048230197684336)
+            else:
+                sim.add(m=0., a=2., e=0.1)
+            sims.append(sim)
+        with warnings.catch_warnings(record=True):
+            rebound.integrate_whfast_batch(sims, 0.1)
+        for k, sim in enumerate(sims):
+            self.assertEqual(sim.ri_whfast.timestep_warning, 1 if k==3 else 0)
 
-class TestIntegrator(unittest.TestCase):
+    def test_ias15_block_close_pair(self):
+        sims = []
+        for block_levels in [0, 8]:
+            sim = rebound.Simulation()
+            sim.integrator = "ias15"
+            sim.ri_ias15.block_levels = block_levels
+            sim.dt = 1e-3
+            sim.add(m=1.)
+            sim.add(m=1e-3, a=1.)
+            sim.add(m=1e-6, a=0.002, primary=sim.particles[1])
+            for i in range(20):
+                sim.add(m=1e-8, a=3.+0.5*i, e=0.01, inc=0.01, f=0.3*i)
+            sim.move_to_com()
+            sims.append(sim)
+        sim_global, sim_block = sims
+        e0 = sim_block.calculate_energy()
+        sim_global.integrate(1.)
+        sim_block.integrate(1.)
+        e1 = sim_block.calculate_energy()
+        self.assertLess(math.fabs((e0-e1)/e1),1e-13)
+        # The block is much longer than the timestep of the close pair
+        self.assertGreater(sim_block.dt, 10.*sim_global.dt)
+        self.assertSameParticles(sim_global.particles, sim_block.particles, attrs=("x",), delta=1e-10)
+        self.assertSameParticles(sim_global.particles, sim_block.particles, attrs=("vy",), delta=1e-9)
+
+class TestIntegrator(SimulationTestCase):
     def setUp(self):
         self.sim = rebound.Simulation()
         rebound.data.add_outer_solar_system(self.sim)
@@ -98,6 +281,53 @@ class TestIntegrator(unittest.TestCase):
         #e1 = self.sim.calculate_energy()
         #self.assertLess(math.fabs((e0-e1)/e1),10**13.5)
     
+    def test_ias15_block(self):
+        self.sim.integrator = "ias15"
+        self.sim.ri_ias15.block_levels = 4
+        jupyr = 11.86*2.*math.pi
+        e0 = self.sim.calculate_energy()
+        self.assertNotEqual(e0,0.)
+        self.sim.integrate(1e3*jupyr)
+        e1 = self.sim.calculate_energy()
+        self.assertLess(math.fabs((e0-e1)/e1),1e-14)
+    
+    def test_ias15_block_unsupported(self):
+        self.sim.integrator = "ias15"
+        self.sim.ri_ias15.block_levels = 4
+        self.sim.gravity = "compensated"
+        jupyr = 11.86*2.*math.pi
+        e0 = self.sim.calculate_energy()
+        self.sim.integrate(1e2*jupyr)
+        # Global timesteps are only used while block timesteps are not supported
+        self.assertEqual(self.sim.ri_ias15.block_levels, 4)
+        N_global = self.sim.ri_ias15.block_unsupported
+        self.assertGreater(N_global, 0)
+        e1 = self.sim.calculate_energy()
+        self.assertLess(math.fabs((e0-e1)/e1),1e-14)
+        # Block timesteps are used again as soon as they are supported
+        self.sim.gravity = "basic"
+        self.sim.integrate(2e2*jupyr)
+        self.assertEqual(self.sim.ri_ias15.block_unsupported, N_global)
+        self.assertTrue(any(self.sim.ri_ias15._block_level[i]>0 for i in range(self.sim.N)))
+
+    def test_ias15_shrink(self):
+        sims = []
+        for stale in [False, True]:
+            sim = rebound.Simulation()
+            sim.integrator = "ias15"
+            sim.add(m=1.)
+            sim.add(m=1e-3, a=1., e=0.1)
+            sim.add(m=1e-3, a=2., e=0.1)
+            sim.integrate(1.)
+            # N3 goes from 9 to 6, the arrays keep the stride of the allocation.
+            sim.remove(2)
+            if stale:
+                for k in range(6):
+                    sim.ri_ias15.csb.p6[k] = 1e-3
+            sim.integrate(10.)
+            sims.append(sim)
+        self.assertSameParticles(sims[0].particles, sims[1].particles, attrs=("x","vy"))
+
     def test_ias15_compensated(self):
         self.sim.integrator = "ias15"
         self.sim.gravity = "compensated"
@@ -167,7 +397,85 @@ class TestIntegrator(unittest.TestCase):
         self.assertNotEqual(e0,0.)
         e1 = self.sim.calculate_energy()
         self.assertLess(math.fabs((e0-e1)/e1),1e-8)
-    
+
+    def test_whfast_adaptive(self):
+        sim = rebound.Simulation()
+        sim.integrator = "whfast"
+        sim.ri_whfast.epsilon = 1e-8
+        sim.dt = 1.
+        sim.add(m=1.)
+        sim.add(m=1e-3, a=1., e=0.05)
+        sim.add(m=1e-6, a=3., e=0.95)
+        sim.move_to_com()
+        e0 = sim.calculate_energy()
+        sim.integrate(100.)
+        self.assertAlmostEqual(sim.t, 100., delta=1e-12)
+        # The initial timestep is far too large
+        self.assertLess(sim.dt, 0.5)
+        e1 = sim.calculate_energy()
+        self.assertLess(math.fabs((e0-e1)/e1),1e-8)
+        self.assertEqual(sim.ri_whfast.timestep_warning, 0)
+
+    def test_whfast_adaptive_nan(self):
+        sim = rebound.Simulation()
+        sim.integrator = "whfast"
+        sim.ri_whfast.epsilon = 1e-8
+        sim.dt = 0.01
+        sim.add(m=1.)
+        sim.add(m=1e-3, a=1.)
+        # Test particle on top of the star. The error estimate becomes NaN.
+        sim.add(m=0.)
+        sim.integrate(0.1)
+        # The integration does not stall
+        self.assertAlmostEqual(sim.t, 0.1, delta=1e-15)
+        self.assertGreater(sim.dt, 0.)
+
+    def test_whfast_restricted(self):
+        for splitting in ["leapfrog", "saba2"]:
+            sims = []
+            for general in [False, True]:
+                sim = rebound.Simulation()
+                sim.integrator = "whfast"
+                sim.ri_whfast.splitting = splitting
+                sim.dt = 0.1
+                sim.add(m=1.)
+                sim.add(m=1e-3, a=5.2, e=0.05)
+                sim.add(m=3e-4, a=9.5, e=0.05, inc=0.02)
+                for i in range(23):
+                    sim.add(a=12.+0.1*i, e=0.1, inc=0.01*i, f=0.3*i)
+                sim.N_active = 3
+                sim.move_to_com()
+                if general:
+                    # Additional forces disable the restricted kick
+                    sim.additional_forces = lambda s: None
+                sim.integrate(50.)
+                sims.append(sim)
+            self.assertSameParticles(sims[0].particles, sims[1].particles, attrs=("x","y","vz","ax","az"))
+
+    def test_fused_step(self):
+        for integrator, gravity in [("leapfrog", "basic"), ("leapfrog", "none"), ("sei", "none")]:
+            sims = []
+            for fused in [True, False]:
+                sim = rebound.Simulation()
+                sim.integrator = integrator
+                sim.gravity = gravity
+                sim.dt = 0.01
+                if integrator == "sei":
+                    sim.ri_sei.OMEGA = 1.
+                    sim.configure_box(10.)
+                    sim.boundary = "shear"
+                sim.add(m=1.)
+                sim.add(m=1e-3, x=1.5, vy=0.8)
+                for i in range(600):
+                    sim.add(x=2.+0.01*i, y=0.1*math.sin(i), vy=0.6, vx=0.1*math.cos(i))
+                sim.N_active = 2
+                if not fused:
+                    # Additional forces require separate passes
+                    sim.additional_forces = lambda s: None
+                sim.integrate(5.)
+                sims.append(sim)
+            self.assertSameParticles(sims[0].particles, sims[1].particles, attrs=("x","y","vx","vy"))
+
     def test_whfast_nosafemode(self):
         self.sim.integrator = "whfast"
         self.sim.ri_whfast.safe_mode = 0
@@ -180,5 +488,37 @@ class TestIntegrator(unittest.TestCase):
         e1 = self.sim.calculate_energy()
         self.assertLess(math.fabs((e0-e1)/e1),1e-9)
 
+    def test_whfast_corrector_safemode(self):
+        jupyr = 11.86*2.*math.pi
+        x = []
+        for safe_mode in [1, 0]:
+            sim = rebound.Simulation()
+            rebound.data.add_outer_solar_system(sim)
+            sim.move_to_com()
+            sim.integrator = "whfast"
+            sim.ri_whfast.safe_mode = safe_mode
+            sim.ri_whfast.corrector = 11
+            sim.dt = 0.0123*jupyr
+            sim.integrate(1e2*jupyr)
+            x.append(sim.particles[1].x)
+        self.assertAlmostEqual(x[0], x[1], delta=1e-8)
+
+    def test_whfast_corrector_force_evaluations(self):
+        sim = rebound.Simulation()
+        rebound.data.add_outer_solar_system(sim)
+        sim.integrator = "whfast"
+        sim.dt = 0.1
+        evaluations = [0]
+        def count(simp):
+            evaluations[0] += 1
+        sim.additional_forces = count
+        for corrector, stages in [(3,2), (5,4), (7,6), (11,10)]:
+            sim.ri_whfast.corrector = corrector
+            evaluations[0] = 0
+            sim.step()
+            # One kick, plus corrector and inverse corrector. 
+            # The kicks of the two central stages are combined.
+            self.assertEqual(evaluations[0], 1+2*(2*stages-1))
+
 if __name__ == "__main__":
     unittest.main()
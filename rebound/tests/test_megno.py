@@ -27,4 +27,54 @@ class TestMegno(unittest.TestCase):
         self.assertAlmostEqual(self.sim.calculate_megno(),2.,delta=2e-1)
         self.assertAlmostEqual(self.sim.calculate_lyapunov(),0.,delta=1e-3)
 
+    def test_rand_seed(self):
+        def deviation(seed):
+            sim = rebound.Simulation()
+            sim.rand_seed = seed
+            sim.add(m=1)
+            sim.add(m=1e-3,a=1.5,e=0.1,inc=0.1)
+            sim.init_megno()
+            # Two uniform numbers per normal, six normals per particle
+            self.assertEqual(sim.rand_counter, 24)
+            return [(p.x, p.vz) for p in sim.particles[2:]]
+        self.assertEqual(deviation(7), deviation(7))
+        self.assertNotEqual(deviation(7), deviation(8))
 
+    def test_ensemble(self):
+        self.sim.integrator = "whfast"
+        self.sim.dt = 0.05
+        self.sim.add(m=1)
+        self.sim.add(m=1e-3,a=1.5,e=0.1,inc=0.1)
+        self.sim.exit_max_distance = 10.
+        members = []
+        for a, e in [(1.5,0.1), (1.5,0.2), (-1.5,2.)]:
+            members.append([self.sim.particles[0], rebound.Particle(simulation=self.sim,m=1e-3,a=a,e=e,inc=0.1)])
+        megno, lyapunov = self.sim.megno_ensemble(members, 1000)
+        for k in range(2):
+            self.assertAlmostEqual(megno[k],2.,delta=2e-1)
+            self.assertAlmostEqual(lyapunov[k],0.,delta=1e-3)
+        # Hyperbolic orbit escapes
+        self.assertTrue(math.isnan(megno[2]))
+        self.assertTrue(math.isnan(lyapunov[2]))
+        self.assertEqual(self.sim.N, 2)
+        self.assertEqual(self.sim.t, 0.)
+
+    def test_ensemble_hermes(self):
+        def ensemble(stepped):
+            sim = rebound.Simulation()
+            sim.rand_seed = 7
+            sim.integrator = "hermes"
+            sim.ri_hermes.hill_switch_factor = 100. # Planets are always in the mini simulation
+            sim.dt = 0.05
+            sim.add(m=1)
+            sim.add(m=1e-3,a=1.5,e=0.1,inc=0.1)
+            if stepped:
+                sim.step()
+                self.assertEqual(sim.ri_hermes.mini_active, 1)
+                sim.t = 0.
+            members = []
+            for a in [1.5, 1.6]:
+                members.append([rebound.Particle(m=1), rebound.Particle(simulation=sim,primary=rebound.Particle(m=1),m=1e-3,a=a,e=0.1,inc=0.1)])
+            return sim.megno_ensemble(members, 100)
+        # The mini simulation of the template is neither shared nor reused by the members
+        self.assertEqual(ensemble(True), ensemble(False))
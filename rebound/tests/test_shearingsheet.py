@@ -2,8 +2,9 @@ import rebound
 import unittest
 import math
 import numpy as np
+from rebound.tests import SimulationTestCase
 
-class TestShearingSheet(unittest.TestCase):
+class TestShearingSheet(SimulationTestCase):
     
     def test_saturnsrings(self):
         sim = rebound.Simulation()
@@ -59,5 +60,29 @@ class TestShearingSheet(unittest.TestCase):
         with self.assertRaises(ValueError):
             sim.remove(0,keepSorted=1)
 
+    def test_sei_wrap(self):
+        sims = []
+        for check in [False, True]:
+            sim = rebound.Simulation()
+            sim.ri_sei.OMEGA = 1.
+            sim.configure_box(10.)
+            sim.integrator = "sei"
+            sim.boundary = "shear"
+            sim.gravity = "none"
+            sim.dt = 0.01
+            for i in range(10):
+                x = -4.9+i
+                sim.add(m=1., x=x, y=0.4*i-4., z=0.1, vx=0.5-0.1*i, vy=-1.5*x)
+            if check:
+                # With post timestep modifications, reb_boundary_check() shifts particles back into the box
+                sim.post_timestep_modifications = lambda s: None
+            sim.integrate(20.)
+            sims.append(sim)
+        sim, sim_check = sims
+        for p in sim.particles:
+            self.assertLessEqual(abs(p.x), 5.)
+            self.assertLessEqual(abs(p.y), 5.)
+        self.assertSameParticles(sim.particles, sim_check.particles, attrs=("x","y","vy"))
+
 if __name__ == "__main__":
     unittest.main()
@@ -229,6 +229,24 @@ class TestSimulation(unittest.TestCase):
         self.assertEqual(self.sim.integrator, sim2.integrator)
         os.remove("bintest.bin")
     
+    def test_checkpoint_ias15_block(self):
+        sim = rebound.Simulation()
+        sim.ri_ias15.block_levels = 4
+        sim.add(m=1.)
+        sim.add(m=1e-3, a=1.)
+        sim.add(m=1e-6, a=0.002, primary=sim.particles[1])
+        sim.add(m=1e-8, a=3.)
+        sim.integrate(0.1)
+        sim.save("bintest.bin")
+        sim.integrate(0.5)
+        sim2 = rebound.Simulation.from_file("bintest.bin")
+        sim2.integrate(0.5)
+        for i in range(sim.N):
+            self.assertEqual(sim.particles[i].x, sim2.particles[i].x)
+            self.assertEqual(sim.particles[i].vx, sim2.particles[i].vx)
+        self.assertEqual(sim.t, sim2.t)
+        os.remove("bintest.bin")
+    
     
 class TestSimulationCollisions(unittest.TestCase):
     def setUp(self):
@@ -0,0 +1,62 @@
+import rebound
+import unittest
+import threading
+from rebound.tests import SimulationTestCase
+
+def setup_planets(integrator, k):
+    sim = rebound.Simulation()
+    sim.integrator = integrator
+    sim.dt = 0.01
+    sim.add(m=1.)
+    sim.add(m=1e-3, a=1., e=0.02*k)
+    sim.add(m=1e-3, a=1.6+0.01*k, e=0.1, inc=0.05)
+    sim.add(m=1e-8, a=1.3, e=0.3, f=k)
+    sim.move_to_com()
+    return sim
+
+def setup_collisions(k):
+    sim = rebound.Simulation()
+    sim.integrator = "leapfrog"
+    sim.collision = "direct"
+    sim.collision_resolve = "merge"
+    sim.rand_seed = 42+k
+    sim.dt = 0.01
+    sim.add(m=1.)
+    for i in range(20):
+        sim.add(m=1e-4, r=0.05, a=1.+0.02*i, e=0.2, f=0.7*i+k)
+    sim.move_to_com()
+    return sim
+
+setups = [lambda k: setup_planets("ias15", k),
+          lambda k: setup_planets("whfast", k),
+          lambda k: setup_planets("hermes", k),
+          lambda k: setup_planets("leapfrog", k),
+          setup_collisions]
+
+class TestThreading(SimulationTestCase):
+
+    def test_concurrent_simulations(self):
+        jobs = [(setup, k) for k in range(4) for setup in setups]
+        expected = []
+        for setup, k in jobs:
+            sim = setup(k)
+            sim.integrate(100.)
+            expected.append(sim)
+        results = [None]*len(jobs)
+        def worker(j):
+            # Simulations are created, integrated and freed on this thread.
+            setup, k = jobs[j]
+            for repeat in range(3):
+                sim = setup(k)
+                sim.integrate(100.)
+                results[j] = sim
+        threads = [threading.Thread(target=worker, args=(j,)) for j in range(len(jobs))]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        for j in range(len(jobs)):
+            self.assertSameParticles(results[j].particles, expected[j].particles, attrs=("x","vy","m"))
+
+if __name__ == "__main__":
+    unittest.main()
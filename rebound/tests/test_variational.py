@@ -1,9 +1,10 @@
 import rebound
 import unittest
 import datetime
+from rebound.tests import SimulationTestCase
 
 
-class TestVariational(unittest.TestCase):
+class TestVariational(SimulationTestCase):
     paramlist = [ 
             (1e-3,1.,0.1,0.02,0.3,0.56,0.4),
             (1e-6,2.,0.02,0.0132,0.33,1.56,0.14),
@@ -45,6 +46,34 @@ class TestVariational(unittest.TestCase):
     
     
     
+    def test_many_variations(self):
+        # Additional variational sets must not change the result of another set
+        sims = []
+        for i in range(2):
+            sim = rebound.Simulation()
+            sim.add(m=1.)
+            sim.add(m=1e-3, a=1., e=0.1, f=0.4)
+            sim.add(m=1e-3, a=1.76, e=0.05, f=2.1)
+            # Fixed timestep, otherwise the timestep depends on all variational particles
+            sim.ri_ias15.epsilon = 0.
+            sim.dt = 0.01
+            sims.append(sim)
+        sim1, sim2 = sims
+        var_1 = sim1.add_variation()
+        var_1.vary(1,"a")
+        sim1.integrate(1.4)
+        
+        var_2 = sim2.add_variation()
+        var_2.vary(1,"a")
+        var_e = sim2.add_variation()
+        var_e.vary(2,"e")
+        var_aa = sim2.add_variation(order=2, first_order=var_2)
+        var_aa.vary(1,"a")
+        var_m = sim2.add_variation()
+        var_m.vary(2,"m")
+        sim2.integrate(1.4)
+        self.assertSameParticles(var_1.particles, var_2.particles, attrs=("x","vy"))
+    
     def test_all_2nd_order_full(self):
         self.run_2nd_order_full(com=False)
     def test_all_2nd_order_full_com(self):
@@ -37,109 +37,107 @@
 #include "boundary.h"
 #include "tree.h"
 
+/**
+ * @brief Returns 1 if the particle is outside of the box.
+ * @details The box is the half-open interval [-L/2,L/2) in each direction, 
+ * the same interval that the periodic wrap and the root boxes of the tree use.
+ */
+static inline int reb_boundary_is_outside(const struct reb_particle p, const struct reb_vec3d boxsize){
+	return (p.x>=boxsize.x/2.) | (p.x<-boxsize.x/2.) | (p.y>=boxsize.y/2.) | (p.y<-boxsize.y/2.) | (p.z>=boxsize.z/2.) | (p.z<-boxsize.z/2.);
+}
+
+/**
+ * @brief Calculates the energy carried away by a set of particles.
+ * @details The result is the same as the difference of reb_tools_energy()
+ * before and after removing the flagged particles with keepSorted=1, but is
+ * calculated in a single O(N*N_remove) pass.
+ * @param r REBOUND Simulation to consider
+ * @param remove Array of flags, particle i is removed if remove[i] is non-zero.
+ */
+static double reb_boundary_energy_of_removed(const struct reb_simulation* const r, const int* const remove){
+	const int N = r->N;
+	const int N_var = r->N_var;
+	const int _N_active = ((r->N_active==-1)?N:r->N_active) - N_var;
+	const int N_interact = (r->testparticle_type==0)?_N_active:(N-N_var);
+	const struct reb_particle* const particles = r->particles;
+	const double G = r->G;
+	double e_kin = 0.;
+	double e_pot = 0.;
+	for (int i=0;i<N_interact;i++){
+		if (!remove[i]) continue;
+		const struct reb_particle pi = particles[i];
+		e_kin += 0.5 * pi.m * (pi.vx*pi.vx + pi.vy*pi.vy + pi.vz*pi.vz);
+		// Pairs in reb_tools_energy() have at least one active particle.
+		const int j_max = (i<_N_active)?N_interact:_N_active;
+		for (int j=0;j<j_max;j++){
+			// Pairs of two removed particles are only counted once.
+			if (j==i || (remove[j] && j<i)) continue;
+			const struct reb_particle pj = particles[j];
+			const double dx = pi.x - pj.x;
+			const double dy = pi.y - pj.y;
+			const double dz = pi.z - pj.z;
+			e_pot -= G*pj.m*pi.m/sqrt(dx*dx + dy*dy + dz*dz);
+		}
+	}
+	return e_kin + e_pot;
+}
+
 void reb_boundary_check(struct reb_simulation* const r){
 	struct reb_particle* const particles = r->particles;
 	int N = r->N;
 	const struct reb_vec3d boxsize = r->boxsize;
 	switch(r->boundary){
 		case REB_BOUNDARY_OPEN:
-			for (int i=0;i<N;i++){ // run through loop backwards so we don't have to recheck same index after removing
-				int removep = 0;
-				if(particles[i].x>boxsize.x/2.){
-					removep = 1;
-				}
-				if(particles[i].x<-boxsize.x/2.){
-					removep = 1;
-				}
-				if(particles[i].y>boxsize.y/2.){
-					removep = 1;
-				}
-				if(particles[i].y<-boxsize.y/2.){
-					removep = 1;
-				}
-				if(particles[i].z>boxsize.z/2.){
-					removep = 1;
-				}
-				if(particles[i].z<-boxsize.z/2.){
-					removep = 1;
-				}
-				if (removep==1){
-                    // If hermes calculate energy offset in global
-                    if(r->track_energy_offset){
-                        double Ei = reb_tools_energy(r);
-                        reb_remove(r, i,1);
-                        r->energy_offset += Ei - reb_tools_energy(r);
-                    } else {
-                    reb_remove(r, i,0); // keepSorted=0 by default in C version
-                    }
-                    if (r->tree_root==NULL){
-                        i--; // need to recheck the particle that replaced the removed one
-                        N--; // This is the local N
-                    }else{
-                        // particle just marked, will be removed later
-                        r->tree_needs_update= 1;
-                    }
+		{
+			// First count escapers. In most timesteps there are none.
+			int N_remove = 0;
+#pragma omp parallel for schedule(guided) reduction(+:N_remove)
+			for (int i=0;i<N;i++){
+				N_remove += reb_boundary_is_outside(particles[i], boxsize);
+			}
+			if (N_remove==0){
+				break;
+			}
+			int* remove = malloc(sizeof(int)*N);
+#pragma omp parallel for schedule(guided)
+			for (int i=0;i<N;i++){
+				remove[i] = reb_boundary_is_outside(particles[i], boxsize);
+			}
+			if(r->track_energy_offset && r->N_var==0){
+				r->energy_offset += reb_boundary_energy_of_removed(r, remove);
+			}
+			if (r->tree_root==NULL){
+				// Compact the particle array once, keeping particles sorted.
+				reb_remove_marked(r, remove, N);
+			}else{
+				for (int i=0;i<N;i++){
+					if (remove[i]){
+						// Particle just marked, will be removed later.
+						reb_remove(r, i, 0);
+					}
 				}
+				r->tree_needs_update= 1;
 			}
-			break;
+			free(remove);
+		}
+		break;
 		case REB_BOUNDARY_SHEAR:
 		{
 			// The offset of ghostcell is time dependent.
 			const double OMEGA = r->ri_sei.OMEGA;
-			const double offsetp1 = -fmod(-1.5*OMEGA*boxsize.x*r->t+boxsize.y/2.,boxsize.y)-boxsize.y/2.; 
-			const double offsetm1 = -fmod( 1.5*OMEGA*boxsize.x*r->t-boxsize.y/2.,boxsize.y)+boxsize.y/2.; 
-			struct reb_particle* const particles = r->particles;
+			const double offsetp1 = reb_boundary_shear_offset(boxsize, OMEGA, r->t);
 #pragma omp parallel for schedule(guided)
 			for (int i=0;i<N;i++){
-				// Radial
-				while(particles[i].x>boxsize.x/2.){
-					particles[i].x -= boxsize.x;
-					particles[i].y += offsetp1;
-					particles[i].vy += 3./2.*OMEGA*boxsize.x;
-				}
-				while(particles[i].x<-boxsize.x/2.){
-					particles[i].x += boxsize.x;
-					particles[i].y += offsetm1;
-					particles[i].vy -= 3./2.*OMEGA*boxsize.x;
-				}
-				// Azimuthal
-				while(particles[i].y>boxsize.y/2.){
-					particles[i].y -= boxsize.y;
-				}
-				while(particles[i].y<-boxsize.y/2.){
-					particles[i].y += boxsize.y;
-				}
-				// Vertical (there should be no boundary, but periodic makes life easier)
-				while(particles[i].z>boxsize.z/2.){
-					particles[i].z -= boxsize.z;
-				}
-				while(particles[i].z<-boxsize.z/2.){
-					particles[i].z += boxsize.z;
-				}
+				reb_boundary_shear_wrap(&(particles[i]), boxsize, OMEGA, offsetp1);
 			}
 		}
 		break;
 		case REB_BOUNDARY_PERIODIC:
 #pragma omp parallel for schedule(guided)
 			for (int i=0;i<N;i++){
-				while(particles[i].x>boxsize.x/2.){
-					particles[i].x -= boxsize.x;
-				}
-				while(particles[i].x<-boxsize.x/2.){
-					particles[i].x += boxsize.x;
-				}
-				while(particles[i].y>boxsize.y/2.){
-					particles[i].y -= boxsize.y;
-				}
-				while(particles[i].y<-boxsize.y/2.){
-					particles[i].y += boxsize.y;
-				}
-				while(particles[i].z>boxsize.z/2.){
-					particles[i].z -= boxsize.z;
-				}
-				while(particles[i].z<-boxsize.z/2.){
-					particles[i].z += boxsize.z;
-				}
+				particles[i].x -= floor(particles[i].x/boxsize.x+0.5)*boxsize.x;
+				particles[i].y -= floor(particles[i].y/boxsize.y+0.5)*boxsize.y;
+				particles[i].z -= floor(particles[i].z/boxsize.z+0.5)*boxsize.z;
 			}
 		break;
 		default:
@@ -202,6 +200,33 @@ struct reb_ghostbox reb_boundary_get_ghostbox(struct reb_simulation* const r, in
 	}
 }
 
+const struct reb_ghostbox* reb_boundary_get_ghostbox_table(struct reb_simulation* const r, const int nghostx, const int nghosty, const int nghostz){
+	const int N = (2*nghostx+1)*(2*nghosty+1)*(2*nghostz+1);
+	if (r->ghostbox_table_allocatedN<N){
+		r->ghostbox_table_allocatedN = N;
+		r->ghostbox_table = realloc(r->ghostbox_table,sizeof(struct reb_ghostbox)*N);
+	}
+	for (int i=-nghostx; i<=nghostx; i++){
+	for (int j=-nghosty; j<=nghosty; j++){
+	for (int k=-nghostz; k<=nghostz; k++){
+		r->ghostbox_table[reb_boundary_ghostbox_index(nghostx,nghosty,nghostz,i,j,k)] = reb_boundary_get_ghostbox(r,i,j,k);
+	}
+	}
+	}
+	return r->ghostbox_table;
+}
+
+int reb_boundary_ghostbox_in_range(const struct reb_simulation* const r, const struct reb_ghostbox gb, const double distance){
+	if (r->boundary!=REB_BOUNDARY_PERIODIC && r->boundary!=REB_BOUNDARY_SHEAR){
+		return 1;
+	}
+	// Distance between shifted position and the box in each direction.
+	const double dx = fmax(fabs(gb.shiftx)-r->boxsize.x/2.,0.);
+	const double dy = fmax(fabs(gb.shifty)-r->boxsize.y/2.,0.);
+	const double dz = fmax(fabs(gb.shiftz)-r->boxsize.z/2.,0.);
+	return dx*dx + dy*dy + dz*dz <= distance*distance;
+}
+
 /**
  * @brief Checks if a given particle is within the computational domain.
  * @param p reb_particle to be checked.
@@ -212,22 +237,7 @@ int reb_boundary_particle_is_in_box(const struct reb_simulation* const r, struct
 	switch(r->boundary){
 		case REB_BOUNDARY_OPEN:
 		case REB_BOUNDARY_SHEAR:
-			if(p.x>r->boxsize.x/2.){
-				return 0;
-			}
-			if(p.x<-r->boxsize.x/2.){
-				return 0;
-			}
-			if(p.y>r->boxsize.y/2.){
-				return 0;
-			}
-			if(p.y<-r->boxsize.y/2.){
-				return 0;
-			}
-			if(p.z>r->boxsize.z/2.){
-				return 0;
-			}
-			if(p.z<-r->boxsize.z/2.){
+			if(reb_boundary_is_outside(p, r->boxsize)){
 				return 0;
 			}
 			return 1;
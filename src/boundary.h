@@ -24,6 +24,7 @@
  */
 #ifndef _BOUNDARIES_H
 #define _BOUNDARIES_H
+#include <math.h>
 
 /**
  * @brief This function checks if any particle has left the main box.
@@ -33,6 +34,36 @@
  */
 void reb_boundary_check(struct reb_simulation* r);
 
+/**
+ * @brief Returns the shift in the y direction of particles leaving a shearing sheet box on the outer edge.
+ * @param boxsize Size of the box.
+ * @param OMEGA Epicyclic frequency.
+ * @param t Current time.
+ */
+static inline double reb_boundary_shear_offset(const struct reb_vec3d boxsize, const double OMEGA, const double t){
+	return -fmod(-1.5*OMEGA*boxsize.x*t+boxsize.y/2.,boxsize.y)-boxsize.y/2.; 
+}
+
+/**
+ * @brief Shifts a particle that has left a shearing sheet box back into the box.
+ * @details This is used by reb_boundary_check() and by integrators which wrap particles in the same pass as their drift.
+ * @param p Particle to shift.
+ * @param boxsize Size of the box.
+ * @param OMEGA Epicyclic frequency.
+ * @param offsetp1 Shift calculated with reb_boundary_shear_offset().
+ */
+static inline void reb_boundary_shear_wrap(struct reb_particle* const p, const struct reb_vec3d boxsize, const double OMEGA, const double offsetp1){
+	// Radial (offsetm1 = -offsetp1 for particles leaving on the inner edge)
+	const double nx = floor(p->x/boxsize.x+0.5);
+	p->x -= nx*boxsize.x;
+	p->y += nx*offsetp1;
+	p->vy += nx*3./2.*OMEGA*boxsize.x;
+	// Azimuthal
+	p->y -= floor(p->y/boxsize.y+0.5)*boxsize.y;
+	// Vertical (there should be no boundary, but periodic makes life easier)
+	p->z -= floor(p->z/boxsize.z+0.5)*boxsize.z;
+}
+
 /**
  * @brief Creates a ghostbox.
  * @param r REBOUND Simulation to consider
@@ -42,6 +73,39 @@ void reb_boundary_check(struct reb_simulation* r);
  */
 struct reb_ghostbox reb_boundary_get_ghostbox(struct reb_simulation* const r, int i, int j, int k);
 
+/**
+ * @brief Calculates all ghostboxes up to a given index at the current time.
+ * @details The table is owned by the simulation and is overwritten by the next call.
+ * Hot loops should use this table instead of calling reb_boundary_get_ghostbox() 
+ * repeatedly, which is expensive for shearing sheet boundaries. Use 
+ * reb_boundary_ghostbox_index() to access an element.
+ * @param r REBOUND Simulation to consider
+ * @param nghostx Largest index in x direction.
+ * @param nghosty Largest index in y direction.
+ * @param nghostz Largest index in z direction.
+ * @return Pointer to the first element of the table.
+ */
+const struct reb_ghostbox* reb_boundary_get_ghostbox_table(struct reb_simulation* const r, const int nghostx, const int nghosty, const int nghostz);
+
+/**
+ * @brief Returns the position of ghostbox (i,j,k) in a table created by reb_boundary_get_ghostbox_table().
+ */
+static inline int reb_boundary_ghostbox_index(const int nghostx, const int nghosty, const int nghostz, const int i, const int j, const int k){
+	return ((i+nghostx)*(2*nghosty+1) + (j+nghosty))*(2*nghostz+1) + (k+nghostz);
+}
+
+/**
+ * @brief Checks whether anything within a given distance of a shifted position can be inside the box.
+ * @details This is used to skip entire ghostboxes during collision searches. 
+ * Only periodic and shearing sheet boundaries guarantee that all particles 
+ * are within the box. For all other boundaries the function always returns 1.
+ * @param r REBOUND Simulation to consider
+ * @param gb Ghostbox shift plus the particle's position.
+ * @param distance Search radius.
+ * @return 1 if the ghostbox needs to be searched, 0 otherwise.
+ */
+int reb_boundary_ghostbox_in_range(const struct reb_simulation* const r, const struct reb_ghostbox gb, const double distance);
+
 /**
  * @details Return 1 if a particle is in the box, 0 otherwise.
  * @param r REBOUND Simulation to consider
@@ -34,6 +34,7 @@
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
+#include <string.h>
 #include "particle.h"
 #include "collision.h"
 #include "rebound.h"
@@ -43,7 +44,11 @@
 #include "communication_mpi.h"
 #endif // MPI
 
+#define MIN(a, b) ((a) > (b) ? (b) : (a))    ///< Returns the minimum of a and b
+#define MAX(a, b) ((a) < (b) ? (b) : (a))    ///< Returns the maximum of a and b
+
 static void reb_tree_get_nearest_neighbour_in_cell(struct reb_simulation* const r, int* collisions_N, struct reb_ghostbox gb, struct reb_ghostbox gbunmod, int ri, double p1_r,  double* nearest_r2, struct reb_collision* collision_nearest, struct reb_treecell* c);
+static void reb_collision_search_bvh(struct reb_simulation* const r, int* collisions_N);
 
 void reb_collision_search(struct reb_simulation* const r){
 	const int N = r->N;
@@ -58,13 +63,20 @@ void reb_collision_search(struct reb_simulation* const r){
 			int nghostxcol = (r->nghostx>1?1:r->nghostx);
 			int nghostycol = (r->nghosty>1?1:r->nghosty);
 			int nghostzcol = (r->nghostz>1?1:r->nghostz);
+			const struct reb_ghostbox* const gbtable = reb_boundary_get_ghostbox_table(r, nghostxcol, nghostycol, nghostzcol);
+			// Largest radius (max_radius might be outdated if radii changed after reb_add).
+			double max_radius = 0.;
+			for (int i=0;i<N;i++){
+				max_radius = fmax(max_radius, particles[i].r);
+			}
 			for (int gbx=-nghostxcol; gbx<=nghostxcol; gbx++){
 			for (int gby=-nghostycol; gby<=nghostycol; gby++){
 			for (int gbz=-nghostzcol; gbz<=nghostzcol; gbz++){
+				const struct reb_ghostbox gborig = gbtable[reb_boundary_ghostbox_index(nghostxcol,nghostycol,nghostzcol,gbx,gby,gbz)];
+				const int is_mainbox = (gbx==0 && gby==0 && gbz==0);
 				// Loop over all particles
 				for (int i=0;i<N;i++){
 					struct reb_particle p1 = particles[i];
-					struct reb_ghostbox gborig = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
 					struct reb_ghostbox gb = gborig;
 					// Precalculate shifted position 
 					gb.shiftx += p1.x;
@@ -73,6 +85,8 @@ void reb_collision_search(struct reb_simulation* const r){
 					gb.shiftvx += p1.vx;
 					gb.shiftvy += p1.vy;
 					gb.shiftvz += p1.vz;
+					// Skip ghostbox if no particle can be close enough.
+					if (!is_mainbox && !reb_boundary_ghostbox_in_range(r, gb, p1.r+max_radius)) continue;
 					// Loop over all particles again
 					for (int j=0;j<N;j++){
 						// Do not collide particle with itself.
@@ -129,6 +143,7 @@ void reb_collision_search(struct reb_simulation* const r){
 			int nghostxcol = (r->nghostx>1?1:r->nghostx);
 			int nghostycol = (r->nghosty>1?1:r->nghosty);
 			int nghostzcol = (r->nghostz>1?1:r->nghostz);
+			const struct reb_ghostbox* const gbtable = reb_boundary_get_ghostbox_table(r, nghostxcol, nghostycol, nghostzcol);
 			const struct reb_particle* const particles = r->particles;
 			const int N = r->N;
 			// Loop over all particles
@@ -145,7 +160,7 @@ void reb_collision_search(struct reb_simulation* const r){
 				for (int gby=-nghostycol; gby<=nghostycol; gby++){
 				for (int gbz=-nghostzcol; gbz<=nghostzcol; gbz++){
 					// Calculated shifted position (for speedup). 
-					struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
+					struct reb_ghostbox gb = gbtable[reb_boundary_ghostbox_index(nghostxcol,nghostycol,nghostzcol,gbx,gby,gbz)];
 					struct reb_ghostbox gbunmod = gb;
 					gb.shiftx += p1.x; 
 					gb.shifty += p1.y; 
@@ -153,6 +168,8 @@ void reb_collision_search(struct reb_simulation* const r){
 					gb.shiftvx += p1.vx; 
 					gb.shiftvy += p1.vy; 
 					gb.shiftvz += p1.vz; 
+					// Skip ghostbox if no particle can be close enough.
+					if ((gbx!=0 || gby!=0 || gbz!=0) && !reb_boundary_ghostbox_in_range(r, gb, p1_r+r->max_radius[0])) continue;
 					// Loop over all root boxes.
 					for (int ri=0;ri<r->root_n;ri++){
 						struct reb_treecell* rootcell = r->tree_root[ri];
@@ -168,13 +185,21 @@ void reb_collision_search(struct reb_simulation* const r){
 			}
 		}
 		break;
+		case REB_COLLISION_BVH:
+			reb_collision_search_bvh(r, &collisions_N);
+		break;
+		case REB_COLLISION_SOFTSPHERE:
+			// Contact forces are calculated together with gravity. 
+			// See reb_collision_softsphere_forces().
+		break;
 		default:
 			reb_exit("Collision routine not implemented.");
 	}
 
 	// randomize
 	for (int i=0;i<collisions_N;i++){
-		int new = rand()%collisions_N;
+		int new = (int)reb_random_sim_uniform(r, 0., collisions_N);
+		if (new>=collisions_N) new = collisions_N-1; // Guard against rounding
 		struct reb_collision c1 = r->collisions[i];
 		r->collisions[i] = r->collisions[new];
 		r->collisions[new] = c1;
@@ -186,13 +211,35 @@ void reb_collision_search(struct reb_simulation* const r){
 		// Default is hard sphere
 		resolve = reb_collision_resolve_hardsphere;
 	}
+	// If the particles are kept sorted, removals are deferred and the 
+	// particle array is compacted only once after all collisions are resolved.
+	const int deferred_remove = r->collision_resolve_keep_sorted && !(r->tree_root) && !(r->N_var);
+	int* removed = NULL;
+	const int removed_N = r->N;
 	for (int i=0;i<collisions_N;i++){
         
         struct reb_collision c = r->collisions[i];
         if (c.p1 != -1 && c.p2 != -1){
+            if (removed && (removed[c.p1] || (c.p2<removed_N && removed[c.p2]))){
+                // One of the particles has already been removed.
+                continue;
+            }
             // Resolve collision
             int outcome = resolve(r, c);
             
+            if (deferred_remove){
+                if ((outcome & 3) && removed==NULL){
+                    removed = calloc(removed_N,sizeof(int));
+                }
+                if (outcome & 1){
+                    removed[c.p1] = 1;
+                }
+                if ((outcome & 2) && c.p2<removed_N){
+                    removed[c.p2] = 1;
+                }
+                continue;
+            }
+
             // Remove particles
             if (outcome & 1){
                 // Remove p1
@@ -238,6 +285,10 @@ void reb_collision_search(struct reb_simulation* const r){
             }
         }
 	}
+	if (removed){
+		reb_remove_marked(r, removed, removed_N);
+		free(removed);
+	}
 }
 
 /**
@@ -345,6 +396,294 @@ static void reb_tree_get_nearest_neighbour_in_cell(struct reb_simulation* const
 	}
 }
 
+/**
+ * @brief Node of the bounding volume hierarchy used by REB_COLLISION_BVH.
+ * @details Nodes are stored in pre-order, so that the children of a node 
+ * always have a larger index than the node itself. This allows the tree to
+ * be refit bottom-up with a single reverse loop over the node array.
+ */
+struct reb_bvh_node{
+	double min[3];	///< Lower corner of the axis aligned bounding box.
+	double max[3];	///< Upper corner of the axis aligned bounding box.
+	int left;	///< Index of the left daughter node, -1 for leaves.
+	int right;	///< Index of the right daughter node, -1 for leaves.
+	int pt;		///< Index of the particle for leaves, -1 otherwise.
+};
+
+/**
+ * @brief Number of refits after which the BVH quality is compared to a fresh build.
+ * @details The BVH is rebuilt if the summed surface area of all nodes has grown 
+ * by more than this factor since the last rebuild.
+ */
+#define REB_BVH_REBUILD_FACTOR 2.
+
+/**
+ * @brief Calculates the swept bounding box of a particle.
+ * @details The box contains the particle at the current position and at 
+ * the position one timestep ago (assuming linear motion), inflated by the 
+ * particle's own radius.
+ */
+static inline void reb_bvh_particle_aabb(const struct reb_particle p, const double dt, double* min, double* max){
+	const double x[3] = {p.x, p.y, p.z};
+	const double dx[3] = {-p.vx*dt, -p.vy*dt, -p.vz*dt};
+	for (int k=0;k<3;k++){
+		if (dx[k]<0.){
+			min[k] = x[k] + dx[k] - p.r;
+			max[k] = x[k] + p.r;
+		}else{
+			min[k] = x[k] - p.r;
+			max[k] = x[k] + dx[k] + p.r;
+		}
+	}
+}
+
+static inline double reb_bvh_area(const struct reb_bvh_node* const n){
+	const double ex = n->max[0]-n->min[0];
+	const double ey = n->max[1]-n->min[1];
+	const double ez = n->max[2]-n->min[2];
+	return ex*ey + ey*ez + ez*ex;
+}
+
+static inline double reb_bvh_centre(const struct reb_particle* const particles, const int pt, const int axis){
+	switch (axis){
+		case 0:
+			return particles[pt].x;
+		case 1:
+			return particles[pt].y;
+		default:
+			return particles[pt].z;
+	}
+}
+
+/**
+ * @brief Partially sorts index[first..last] such that the median element is in place (quickselect).
+ */
+static void reb_bvh_select(const struct reb_particle* const particles, int* index, int first, int last, const int nth, const int axis){
+	while (last>first){
+		const double pivot = reb_bvh_centre(particles, index[(first+last)/2], axis);
+		int i = first;
+		int j = last;
+		while (i<=j){
+			while (reb_bvh_centre(particles, index[i], axis)<pivot) i++;
+			while (reb_bvh_centre(particles, index[j], axis)>pivot) j--;
+			if (i<=j){
+				const int tmp = index[i];
+				index[i] = index[j];
+				index[j] = tmp;
+				i++;
+				j--;
+			}
+		}
+		if (nth<=j){
+			last = j;
+		}else if (nth>=i){
+			first = i;
+		}else{
+			return;
+		}
+	}
+}
+
+/**
+ * @brief Builds the BVH for the particles index[first..last] recursively (top down, median split).
+ * @return Index of the node created.
+ */
+static int reb_bvh_build(struct reb_simulation* const r, int* index, int first, int last, int* nodes_N, const double dt){
+	const struct reb_particle* const particles = r->particles;
+	const int node = (*nodes_N)++;
+	struct reb_bvh_node* const n = &(r->bvh_nodes[node]);
+	if (first==last){
+		n->left = -1;
+		n->right = -1;
+		n->pt = index[first];
+		reb_bvh_particle_aabb(particles[index[first]], dt, n->min, n->max);
+		return node;
+	}
+	// Split along the axis with the largest extent of particle positions.
+	double cmin[3] = {INFINITY, INFINITY, INFINITY};
+	double cmax[3] = {-INFINITY, -INFINITY, -INFINITY};
+	for (int i=first;i<=last;i++){
+		for (int k=0;k<3;k++){
+			const double c = reb_bvh_centre(particles, index[i], k);
+			if (c<cmin[k]) cmin[k] = c;
+			if (c>cmax[k]) cmax[k] = c;
+		}
+	}
+	int axis = 0;
+	if (cmax[1]-cmin[1] > cmax[axis]-cmin[axis]) axis = 1;
+	if (cmax[2]-cmin[2] > cmax[axis]-cmin[axis]) axis = 2;
+	const int mid = (first+last)/2;
+	reb_bvh_select(particles, index, first, last, mid, axis);
+	const int left = reb_bvh_build(r, index, first, mid, nodes_N, dt);
+	const int right = reb_bvh_build(r, index, mid+1, last, nodes_N, dt);
+	n->left = left;
+	n->right = right;
+	n->pt = -1;
+	for (int k=0;k<3;k++){
+		n->min[k] = fmin(r->bvh_nodes[left].min[k], r->bvh_nodes[right].min[k]);
+		n->max[k] = fmax(r->bvh_nodes[left].max[k], r->bvh_nodes[right].max[k]);
+	}
+	return node;
+}
+
+/**
+ * @brief Updates the bounding boxes of all nodes for the current particle positions.
+ * @return Summed surface area of all internal nodes.
+ */
+static double reb_bvh_refit(struct reb_simulation* const r, const double dt){
+	const struct reb_particle* const particles = r->particles;
+	struct reb_bvh_node* const nodes = r->bvh_nodes;
+	double area = 0.;
+	for (int i=r->bvh_nodes_N-1;i>=0;i--){
+		struct reb_bvh_node* n = &(nodes[i]);
+		if (n->pt>=0){
+			reb_bvh_particle_aabb(particles[n->pt], dt, n->min, n->max);
+		}else{
+			const struct reb_bvh_node* const nl = &(nodes[n->left]);
+			const struct reb_bvh_node* const nr = &(nodes[n->right]);
+			for (int k=0;k<3;k++){
+				n->min[k] = fmin(nl->min[k], nr->min[k]);
+				n->max[k] = fmax(nl->max[k], nr->max[k]);
+			}
+			area += reb_bvh_area(n);
+		}
+	}
+	return area;
+}
+
+static double reb_bvh_area_internal(const struct reb_simulation* const r){
+	double area = 0.;
+	for (int i=0;i<r->bvh_nodes_N;i++){
+		if (r->bvh_nodes[i].pt<0){
+			area += reb_bvh_area(&(r->bvh_nodes[i]));
+		}
+	}
+	return area;
+}
+
+/**
+ * @brief Updates the BVH for the current particle positions.
+ * @details The tree is refit if the number of particles has not changed. 
+ * It is rebuilt from scratch if the number of particles changed or if the 
+ * refit tree has become significantly worse than it was after the last rebuild.
+ */
+static void reb_bvh_update(struct reb_simulation* const r){
+	const int N = r->N;
+	const double dt = r->dt_last_done;
+	if (r->bvh_N==N && r->bvh_nodes!=NULL){
+		const double area = reb_bvh_refit(r, dt);
+		if (area <= REB_BVH_REBUILD_FACTOR*r->bvh_area){
+			return;
+		}
+	}
+	if (r->bvh_nodes_allocatedN<2*N-1){
+		r->bvh_nodes_allocatedN = 2*N-1;
+		r->bvh_nodes = realloc(r->bvh_nodes, sizeof(struct reb_bvh_node)*r->bvh_nodes_allocatedN);
+	}
+	int* index = malloc(sizeof(int)*N);
+	for (int i=0;i<N;i++){
+		index[i] = i;
+	}
+	int nodes_N = 0;
+	reb_bvh_build(r, index, 0, N-1, &nodes_N, dt);
+	free(index);
+	r->bvh_nodes_N = nodes_N;
+	r->bvh_N = N;
+	r->bvh_area = reb_bvh_area_internal(r);
+}
+
+/**
+ * @brief Collision search using a bounding volume hierarchy over swept particle bounding boxes.
+ * @details Unlike the tree search, the search radius of a particle only depends 
+ * on its own radius and motion, not on the largest particle in the simulation.
+ */
+static void reb_collision_search_bvh(struct reb_simulation* const r, int* collisions_N){
+	const int N = r->N;
+	if (N<2) return;
+	reb_bvh_update(r);
+	const struct reb_particle* const particles = r->particles;
+	const struct reb_bvh_node* const nodes = r->bvh_nodes;
+	const double dt = r->dt_last_done;
+	// Loop over ghost boxes, but only the inner most ring.
+	int nghostxcol = (r->nghostx>1?1:r->nghostx);
+	int nghostycol = (r->nghosty>1?1:r->nghosty);
+	int nghostzcol = (r->nghostz>1?1:r->nghostz);
+	const struct reb_ghostbox* const gbtable = reb_boundary_get_ghostbox_table(r, nghostxcol, nghostycol, nghostzcol);
+#pragma omp parallel for schedule(guided)
+	for (int i=0;i<N;i++){
+		const struct reb_particle p1 = particles[i];
+		double min[3], max[3];
+		reb_bvh_particle_aabb(p1, dt, min, max);
+		for (int gbx=-nghostxcol; gbx<=nghostxcol; gbx++){
+		for (int gby=-nghostycol; gby<=nghostycol; gby++){
+		for (int gbz=-nghostzcol; gbz<=nghostzcol; gbz++){
+			const struct reb_ghostbox gborig = gbtable[reb_boundary_ghostbox_index(nghostxcol,nghostycol,nghostzcol,gbx,gby,gbz)];
+			struct reb_ghostbox gb = gborig;
+			gb.shiftx += p1.x;
+			gb.shifty += p1.y;
+			gb.shiftz += p1.z;
+			gb.shiftvx += p1.vx;
+			gb.shiftvy += p1.vy;
+			gb.shiftvz += p1.vz;
+			const double qmin[3] = {min[0]+gborig.shiftx, min[1]+gborig.shifty, min[2]+gborig.shiftz};
+			const double qmax[3] = {max[0]+gborig.shiftx, max[1]+gborig.shifty, max[2]+gborig.shiftz};
+			// Depth-first traversal. The tree is balanced, so the stack depth is about log2(N).
+			int stack[128];
+			int stack_N = 0;
+			stack[stack_N++] = 0;
+			while (stack_N>0){
+				const struct reb_bvh_node* const n = &(nodes[stack[--stack_N]]);
+				if (n->min[0]>qmax[0] || n->max[0]<qmin[0]) continue;
+				if (n->min[1]>qmax[1] || n->max[1]<qmin[1]) continue;
+				if (n->min[2]>qmax[2] || n->max[2]<qmin[2]) continue;
+				if (n->pt<0){
+					stack[stack_N++] = n->left;
+					stack[stack_N++] = n->right;
+					continue;
+				}
+				const int j = n->pt;
+				// Do not collide particle with itself.
+				if (i==j) continue;
+				const struct reb_particle p2 = particles[j];
+				const double dx = gb.shiftx - p2.x; 
+				const double dy = gb.shifty - p2.y; 
+				const double dz = gb.shiftz - p2.z; 
+				const double sr = p1.r + p2.r; 
+				const double r2 = dx*dx+dy*dy+dz*dz;
+				// Check if particles are overlapping 
+				if (r2>sr*sr) continue;	
+				const double dvx = gb.shiftvx - p2.vx; 
+				const double dvy = gb.shiftvy - p2.vy; 
+				const double dvz = gb.shiftvz - p2.vz; 
+				// Check if particles are approaching each other
+				if (dvx*dx + dvy*dy + dvz*dz >0) continue; 
+#pragma omp critical
+				{
+					if (r->collisions_allocatedN<=(*collisions_N)){
+						r->collisions_allocatedN += 32;
+						r->collisions = realloc(r->collisions,sizeof(struct reb_collision)*r->collisions_allocatedN);
+					}
+					r->collisions[(*collisions_N)].p1 = i;
+					r->collisions[(*collisions_N)].p2 = j;
+					r->collisions[(*collisions_N)].gb = gborig;
+					r->collisions[(*collisions_N)].ri = 0;
+					(*collisions_N)++;
+				}
+			}
+		}
+		}
+		}
+	}
+}
+
+void reb_collision_bvh_reset(struct reb_simulation* const r){
+	free(r->bvh_nodes);
+	r->bvh_nodes = NULL;
+	r->bvh_nodes_allocatedN = 0;
+	r->bvh_nodes_N = 0;
+	r->bvh_N = 0;
+	r->bvh_area = 0.;
+}
 
 int reb_collision_resolve_hardsphere(struct reb_simulation* const r, struct reb_collision c){
 	struct reb_particle* const particles = r->particles;
@@ -443,6 +782,66 @@ int reb_collision_resolve_hardsphere(struct reb_simulation* const r, struct reb_
 }
 
 
+/**
+ * @brief Energy of particle i as counted in reb_tools_energy(), but without the pair (i,skip).
+ * @details This is the kinetic energy of the particle and the potential energy of all pairs 
+ * with the particle.
+ */
+static double reb_collision_energy_of_particle(const struct reb_simulation* const r, const int i, const int skip){
+	const int N = r->N;
+	const int N_var = r->N_var;
+	const int _N_active = ((r->N_active==-1)?N:r->N_active) - N_var;
+	const int N_interact = (r->testparticle_type==0)?_N_active:(N-N_var);
+	if (i>=N_interact) return 0.;
+	const struct reb_particle* const particles = r->particles;
+	const struct reb_particle pi = particles[i];
+	double e = 0.5 * pi.m * (pi.vx*pi.vx + pi.vy*pi.vy + pi.vz*pi.vz);
+	// Pairs in reb_tools_energy() have at least one active particle.
+	const int j_max = (i<_N_active)?N_interact:_N_active;
+	for (int j=0;j<j_max;j++){
+		if (j==i || j==skip) continue;
+		const struct reb_particle pj = particles[j];
+		// Particles merged away earlier in this timestep have zero mass but 
+		// might not have been removed yet (deferred removal, flagged in tree).
+		if (pj.m==0.) continue;
+		const double dx = pi.x - pj.x;
+		const double dy = pi.y - pj.y;
+		const double dz = pi.z - pj.z;
+		e -= r->G*pj.m*pi.m/sqrt(dx*dx + dy*dy + dz*dz);
+	}
+	return e;
+}
+
+/**
+ * @brief Potential energy of particle i of a HERMES mini simulation with all particles of the 
+ * global simulation which are not in the mini simulation.
+ * @details The global particles are at the end of the global timestep.
+ */
+static double reb_collision_energy_outside_mini(const struct reb_simulation* const mini, const int i){
+	const struct reb_simulation* const r = mini->ri_hermes.global;
+	const int N = r->N;
+	const int N_var = r->N_var;
+	const int _N_active = ((r->N_active==-1)?N:r->N_active) - N_var;
+	const int N_interact = (r->testparticle_type==0)?_N_active:(N-N_var);
+	const int gi = r->ri_hermes.global_index_from_mini_index[i];
+	if (gi>=N_interact) return 0.;
+	const int* const is_in_mini = r->ri_hermes.is_in_mini;
+	const struct reb_particle* const particles = r->particles;
+	const struct reb_particle pi = mini->particles[i];
+	double e = 0.;
+	const int j_max = (gi<_N_active)?N_interact:_N_active;
+	for (int j=0;j<j_max;j++){
+		if (is_in_mini[j]) continue;
+		const struct reb_particle pj = particles[j];
+		if (pj.m==0.) continue;
+		const double dx = pi.x - pj.x;
+		const double dy = pi.y - pj.y;
+		const double dz = pi.z - pj.z;
+		e -= r->G*pj.m*pi.m/sqrt(dx*dx + dy*dy + dz*dz);
+	}
+	return e;
+}
+
 int reb_collision_resolve_merge(struct reb_simulation* const r, struct reb_collision c){
 	if (r->particles[c.p1].lastcollision==r->t || r->particles[c.p2].lastcollision==r->t) return 0;
 
@@ -460,6 +859,15 @@ int reb_collision_resolve_merge(struct reb_simulation* const r, struct reb_colli
 
     struct reb_particle* pi = &(r->particles[i]);
     struct reb_particle* pj = &(r->particles[j]);
+    
+    // Energy of the two particles before the merger. Particle j is removed afterwards.
+    double Ei = 0.;
+    if (r->track_energy_offset && r->N_var==0){
+        Ei = reb_collision_energy_of_particle(r, i, j) + reb_collision_energy_of_particle(r, j, -1);
+        if (r->ri_hermes.global){
+            Ei += reb_collision_energy_outside_mini(r, i) + reb_collision_energy_outside_mini(r, j);
+        }
+    }
                 
     double invmass = 1.0/(pi->m + pj->m);
     
@@ -473,6 +881,17 @@ int reb_collision_resolve_merge(struct reb_simulation* const r, struct reb_colli
     pi->m  = pi->m + pj->m;
     pi->r  = pow(pow(pi->r,3.)+pow(pj->r,3.),1./3.);
     pi->lastcollision = r->t;
+    // Particle j might only be removed at the end of the collision search. 
+    // It must not contribute to the energy of other mergers in the meantime.
+    pj->m  = 0.;
+    
+    if (r->track_energy_offset && r->N_var==0){
+        double Ef = reb_collision_energy_of_particle(r, i, j);
+        if (r->ri_hermes.global){
+            Ef += reb_collision_energy_outside_mini(r, i);
+        }
+        r->energy_offset += Ei - Ef;
+    }
     
     // If hermes calculate energy offset in global - hasn't been removed from global yet
     if (r->ri_hermes.global){
@@ -483,3 +902,262 @@ int reb_collision_resolve_merge(struct reb_simulation* const r, struct reb_colli
     
     return swap?1:2; // Remove particle p2 from simulation
 }
+
+/**
+ * @brief Entry of the soft-sphere neighbour list.
+ * @details The ghostbox is saved as indices because the shift of 
+ * shearing sheet ghostboxes changes with time.
+ */
+struct reb_softsphere_pair{
+	int p1;		///< Particle with the lower index.
+	int p2;		///< Particle with the higher index.
+	int gbx;	///< Ghostbox of p1 in x direction.
+	int gby;	///< Ghostbox of p1 in y direction.
+	int gbz;	///< Ghostbox of p1 in z direction.
+};
+
+/**
+ * @brief Checks if the soft-sphere neighbour list needs to be rebuilt.
+ * @details The list is valid as long as no two particles can have approached 
+ * each other by more than the skin distance since the last rebuild.
+ */
+static int reb_collision_softsphere_needs_rebuild(struct reb_simulation* const r){
+	struct reb_simulation_collision_softsphere* const ss = &(r->softsphere);
+	const int N = r->N;
+	// Particles added or removed since the last rebuild invalidate the indices in the list.
+	if (ss->x0==NULL || ss->N_last!=N || ss->particles_changed!=ss->particles_changed_last){
+		return 1;
+	}
+	const struct reb_particle* const particles = r->particles;
+	const struct reb_vec3d* const x0 = ss->x0;
+	double maxdisp2 = 0.;
+	for (int i=0;i<N;i++){
+		const double dx = particles[i].x - x0[i].x;
+		const double dy = particles[i].y - x0[i].y;
+		const double dz = particles[i].z - x0[i].z;
+		const double d2 = dx*dx + dy*dy + dz*dz;
+		if (d2>maxdisp2) maxdisp2 = d2;
+	}
+	double shift = 0.;
+	if (r->boundary==REB_BOUNDARY_SHEAR && r->nghostx>0){
+		shift = fabs(reb_boundary_get_ghostbox(r,1,0,0).shifty - ss->shift0);
+	}
+	return 2.*sqrt(maxdisp2) + shift > ss->skin;
+}
+
+/**
+ * @brief Rebuilds the soft-sphere neighbour list.
+ * @details Particles are binned in a grid of cells which are at least as large as 
+ * the largest cutoff distance. Only particles in the 27 cells around a particle 
+ * (or around its image in a ghostbox) need to be checked.
+ */
+static void reb_collision_softsphere_rebuild(struct reb_simulation* const r){
+	struct reb_simulation_collision_softsphere* const ss = &(r->softsphere);
+	const struct reb_particle* const particles = r->particles;
+	const int N = r->N;
+	const double skin = ss->skin;
+	int pairs_N = 0;
+
+	// Bounding box of all particles and largest radius
+	double cmin[3] = {INFINITY, INFINITY, INFINITY};
+	double cmax[3] = {-INFINITY, -INFINITY, -INFINITY};
+	double rmax = 0.;
+	for (int i=0;i<N;i++){
+		const double x[3] = {particles[i].x, particles[i].y, particles[i].z};
+		for (int k=0;k<3;k++){
+			if (x[k]<cmin[k]) cmin[k] = x[k];
+			if (x[k]>cmax[k]) cmax[k] = x[k];
+		}
+		if (particles[i].r>rmax) rmax = particles[i].r;
+	}
+	// Cells are enlarged until there are not many more cells than particles.
+	double h = 2.*rmax + skin;
+	if (!(h>0.)){
+		h = fmax(fmax(cmax[0]-cmin[0], cmax[1]-cmin[1]), fmax(cmax[2]-cmin[2], 1.));
+	}
+	double nc[3];
+	while(1){
+		for (int k=0;k<3;k++){
+			nc[k] = floor((cmax[k]-cmin[k])/h)+1.;
+		}
+		if (nc[0]*nc[1]*nc[2] <= 2.*N+8.) break;
+		h *= 2.;
+	}
+	const int nx = (int)nc[0];
+	const int ny = (int)nc[1];
+	const int nz = (int)nc[2];
+	const int cells_N = nx*ny*nz;
+
+	// Sort particles by cell (counting sort, particles stay in ascending order within a cell)
+	int* cell = malloc(sizeof(int)*N);
+	int* cell_start = calloc(cells_N+1,sizeof(int));
+	int* cell_particles = malloc(sizeof(int)*N);
+	for (int i=0;i<N;i++){
+		const int cx = MIN((int)((particles[i].x-cmin[0])/h),nx-1);
+		const int cy = MIN((int)((particles[i].y-cmin[1])/h),ny-1);
+		const int cz = MIN((int)((particles[i].z-cmin[2])/h),nz-1);
+		cell[i] = (cx*ny+cy)*nz+cz;
+		cell_start[cell[i]+1]++;
+	}
+	for (int c=0;c<cells_N;c++){
+		cell_start[c+1] += cell_start[c];
+	}
+	int* cell_fill = malloc(sizeof(int)*cells_N);
+	memcpy(cell_fill, cell_start, sizeof(int)*cells_N);
+	for (int i=0;i<N;i++){
+		cell_particles[cell_fill[cell[i]]++] = i;
+	}
+	free(cell_fill);
+	free(cell);
+
+	// Loop over ghost boxes, but only the inner most ring.
+	int nghostxcol = (r->nghostx>1?1:r->nghostx);
+	int nghostycol = (r->nghosty>1?1:r->nghosty);
+	int nghostzcol = (r->nghostz>1?1:r->nghostz);
+	const struct reb_ghostbox* const gbtable = reb_boundary_get_ghostbox_table(r, nghostxcol, nghostycol, nghostzcol);
+	for (int gbx=-nghostxcol; gbx<=nghostxcol; gbx++){
+	for (int gby=-nghostycol; gby<=nghostycol; gby++){
+	for (int gbz=-nghostzcol; gbz<=nghostzcol; gbz++){
+		const struct reb_ghostbox gb = gbtable[reb_boundary_ghostbox_index(nghostxcol,nghostycol,nghostzcol,gbx,gby,gbz)];
+		for (int i=0;i<N;i++){
+			const struct reb_particle p1 = particles[i];
+			const double x1 = p1.x + gb.shiftx;
+			const double y1 = p1.y + gb.shifty;
+			const double z1 = p1.z + gb.shiftz;
+			// Range of neighbouring cells. Images far outside the grid have no neighbours.
+			const double c1[3] = {floor((x1-cmin[0])/h), floor((y1-cmin[1])/h), floor((z1-cmin[2])/h)};
+			if (c1[0]<-1. || c1[0]>nc[0] || c1[1]<-1. || c1[1]>nc[1] || c1[2]<-1. || c1[2]>nc[2]) continue;
+			const int cx0 = MAX((int)c1[0]-1,0);
+			const int cy0 = MAX((int)c1[1]-1,0);
+			const int cz0 = MAX((int)c1[2]-1,0);
+			const int cx1 = MIN((int)c1[0]+1,nx-1);
+			const int cy1 = MIN((int)c1[1]+1,ny-1);
+			const int cz1 = MIN((int)c1[2]+1,nz-1);
+			for (int cx=cx0;cx<=cx1;cx++){
+			for (int cy=cy0;cy<=cy1;cy++){
+			for (int cz=cz0;cz<=cz1;cz++){
+				const int c = (cx*ny+cy)*nz+cz;
+				for (int n=cell_start[c];n<cell_start[c+1];n++){
+					const int j = cell_particles[n];
+					// Pair (j,i) in ghostbox -gb is the same as pair (i,j) in ghostbox gb.
+					if (j<=i) continue;
+					const struct reb_particle p2 = particles[j];
+					const double dx = x1 - p2.x;
+					const double dy = y1 - p2.y;
+					const double dz = z1 - p2.z;
+					const double rs = p1.r + p2.r + skin;
+					if (dx*dx + dy*dy + dz*dz > rs*rs) continue;
+					if (ss->pairs_allocatedN<=pairs_N){
+						ss->pairs_allocatedN += 128;
+						ss->pairs = realloc(ss->pairs,sizeof(struct reb_softsphere_pair)*ss->pairs_allocatedN);
+					}
+					ss->pairs[pairs_N].p1 = i;
+					ss->pairs[pairs_N].p2 = j;
+					ss->pairs[pairs_N].gbx = gbx;
+					ss->pairs[pairs_N].gby = gby;
+					ss->pairs[pairs_N].gbz = gbz;
+					pairs_N++;
+				}
+			}
+			}
+			}
+		}
+	}
+	}
+	}
+	free(cell_start);
+	free(cell_particles);
+	ss->pairs_N = pairs_N;
+
+	// Save positions for displacement check.
+	if (ss->x0_allocatedN<N){
+		ss->x0_allocatedN = N;
+		ss->x0 = realloc(ss->x0,sizeof(struct reb_vec3d)*N);
+	}
+	for (int i=0;i<N;i++){
+		ss->x0[i].x = particles[i].x;
+		ss->x0[i].y = particles[i].y;
+		ss->x0[i].z = particles[i].z;
+	}
+	ss->N_last = N;
+	ss->particles_changed_last = ss->particles_changed;
+	ss->shift0 = 0.;
+	if (r->boundary==REB_BOUNDARY_SHEAR && r->nghostx>0){
+		ss->shift0 = reb_boundary_get_ghostbox(r,1,0,0).shifty;
+	}
+	ss->rebuilds_N++;
+}
+
+void reb_collision_softsphere_forces(struct reb_simulation* const r){
+	struct reb_simulation_collision_softsphere* const ss = &(r->softsphere);
+	if (r->N==0) return;
+	if (reb_collision_softsphere_needs_rebuild(r)){
+		reb_collision_softsphere_rebuild(r);
+	}
+	struct reb_particle* const particles = r->particles;
+	if (r->gravity==REB_GRAVITY_NONE){
+		// Accelerations have not been reset by the gravity routine.
+		const int N = r->N;
+		for (int i=0;i<N;i++){
+			particles[i].ax = 0.;
+			particles[i].ay = 0.;
+			particles[i].az = 0.;
+		}
+	}
+	const double k = ss->k;
+	const double gamma = ss->gamma;
+	// Ghostboxes are the same for all pairs. Calculate them only once.
+	int nghostxcol = (r->nghostx>1?1:r->nghostx);
+	int nghostycol = (r->nghosty>1?1:r->nghosty);
+	int nghostzcol = (r->nghostz>1?1:r->nghostz);
+	const struct reb_ghostbox* const gbtable = reb_boundary_get_ghostbox_table(r, nghostxcol, nghostycol, nghostzcol);
+	const struct reb_softsphere_pair* const pairs = ss->pairs;
+	for (int n=0;n<ss->pairs_N;n++){
+		const struct reb_softsphere_pair pair = pairs[n];
+		const struct reb_ghostbox gb = gbtable[reb_boundary_ghostbox_index(nghostxcol,nghostycol,nghostzcol,pair.gbx,pair.gby,pair.gbz)];
+		struct reb_particle* const p1 = &(particles[pair.p1]);
+		struct reb_particle* const p2 = &(particles[pair.p2]);
+		const double dx = p1->x + gb.shiftx - p2->x;
+		const double dy = p1->y + gb.shifty - p2->y;
+		const double dz = p1->z + gb.shiftz - p2->z;
+		const double rp = p1->r + p2->r;
+		const double r2 = dx*dx + dy*dy + dz*dz;
+		// Particles are not overlapping
+		if (r2>=rp*rp || r2==0.) continue;
+		const double _r = sqrt(r2);
+		const double nx = dx/_r;
+		const double ny = dy/_r;
+		const double nz = dz/_r;
+		const double dvx = p1->vx + gb.shiftvx - p2->vx;
+		const double dvy = p1->vy + gb.shiftvy - p2->vy;
+		const double dvz = p1->vz + gb.shiftvz - p2->vz;
+		const double vn = dvx*nx + dvy*ny + dvz*nz;
+		double F = k*(rp-_r) - gamma*vn;
+		// Contacts do not pull particles together.
+		if (F<0.) continue;
+		if (p1->m>0.){
+			const double prefac = F/p1->m;
+			p1->ax += prefac*nx;
+			p1->ay += prefac*ny;
+			p1->az += prefac*nz;
+		}
+		if (p2->m>0.){
+			const double prefac = F/p2->m;
+			p2->ax -= prefac*nx;
+			p2->ay -= prefac*ny;
+			p2->az -= prefac*nz;
+		}
+	}
+}
+
+void reb_collision_softsphere_reset(struct reb_simulation* const r){
+	struct reb_simulation_collision_softsphere* const ss = &(r->softsphere);
+	free(ss->pairs);
+	ss->pairs = NULL;
+	ss->pairs_N = 0;
+	ss->pairs_allocatedN = 0;
+	free(ss->x0);
+	ss->x0 = NULL;
+	ss->x0_allocatedN = 0;
+	ss->N_last = 0;
+}
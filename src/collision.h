@@ -29,4 +29,21 @@
  */
 void reb_collision_search(struct reb_simulation* const r);
 
+/**
+ * @brief Adds the soft-sphere contact forces to the particle accelerations.
+ * @details Only used if collision is set to REB_COLLISION_SOFTSPHERE.
+ * The neighbour list is rebuilt if needed.
+ */
+void reb_collision_softsphere_forces(struct reb_simulation* const r);
+
+/**
+ * @brief Frees the bounding volume hierarchy used by REB_COLLISION_BVH.
+ */
+void reb_collision_bvh_reset(struct reb_simulation* const r);
+
+/**
+ * @brief Frees the neighbour list of the soft-sphere contact model.
+ */
+void reb_collision_softsphere_reset(struct reb_simulation* const r);
+
 #endif // _COLLISIONS_H
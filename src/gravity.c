@@ -61,7 +61,8 @@ void reb_calculate_acceleration(struct reb_simulation* r){
 	const double G = r->G;
 	const double softening2 = r->softening*r->softening;
 	const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
-	const int _N_start  = (r->integrator==REB_INTEGRATOR_WH?1:0);
+	// WH and WHFast with democratic heliocentric or WHDS coordinates ignore all interactions with the central object
+	const int _N_start  = (r->integrator==REB_INTEGRATOR_WH || (r->integrator==REB_INTEGRATOR_WHFAST && r->ri_whfast.coordinates!=REB_WHFAST_COORDINATES_JACOBI))?1:0;
 	const int _N_active = ((N_active==-1)?N:N_active) - r->N_var;
 	const int _N_real   = N  - r->N_var;
 	const int _testparticle_type   = r->testparticle_type;
@@ -366,13 +367,18 @@ void reb_calculate_acceleration(struct reb_simulation* r){
 				particles[i].az = 0; 
 			}
 			// Summing over all Ghost Boxes
-			for (int gbx=-r->nghostx; gbx<=r->nghostx; gbx++){
-			for (int gby=-r->nghosty; gby<=r->nghosty; gby++){
-			for (int gbz=-r->nghostz; gbz<=r->nghostz; gbz++){
+			const int nghostx = r->nghostx;
+			const int nghosty = r->nghosty;
+			const int nghostz = r->nghostz;
+			const struct reb_ghostbox* const gbtable = reb_boundary_get_ghostbox_table(r, nghostx, nghosty, nghostz);
+			for (int gbx=-nghostx; gbx<=nghostx; gbx++){
+			for (int gby=-nghosty; gby<=nghosty; gby++){
+			for (int gbz=-nghostz; gbz<=nghostz; gbz++){
+				const struct reb_ghostbox gborig = gbtable[reb_boundary_ghostbox_index(nghostx,nghosty,nghostz,gbx,gby,gbz)];
 				// Summing over all particle pairs
 #pragma omp parallel for schedule(guided)
 				for (int i=0; i<N; i++){
-					struct reb_ghostbox gb = reb_boundary_get_ghostbox(r, gbx,gby,gbz);
+					struct reb_ghostbox gb = gborig;
 					// Precalculated shifted position
 					gb.shiftx += particles[i].x;
 					gb.shifty += particles[i].y;
@@ -390,6 +396,63 @@ void reb_calculate_acceleration(struct reb_simulation* r){
 
 }
 
+/**
+ * @brief Number of values stored per particle pair by reb_gravity_var_geometry().
+ */
+#define REB_GRAVITY_VAR_GEOMETRY_N 7
+
+// Relative position and inverse distances of a pair of particles as used by the variational equations.
+static inline void reb_gravity_var_geometry(const struct reb_particle pi, const struct reb_particle pj, double* const g){
+    const double dx = pi.x - pj.x;
+    const double dy = pi.y - pj.y;
+    const double dz = pi.z - pj.z;
+    const double r2 = dx*dx + dy*dy + dz*dz;
+    const double _r  = sqrt(r2);
+    const double r3inv = 1./(r2*_r);
+    g[0] = dx;
+    g[1] = dy;
+    g[2] = dz;
+    g[3] = r3inv;
+    g[4] = 3.*r3inv/r2;     // 1st order
+    g[5] = r3inv/r2;        // 2nd order
+    g[6] = g[5]/r2;
+}
+
+// Index of the pair (i,i+1) in the list of all pairs i<j of N particles.
+static inline int reb_gravity_var_pair_index(const int N, const int i){
+    return i*(2*N-i-1)/2;
+}
+
+void reb_calculate_acceleration_range(struct reb_simulation* r, const int i0, const int i1){
+	struct reb_particle* const particles = r->particles;
+	const int N_active = ((r->N_active==-1)?r->N:r->N_active) - r->N_var;
+	const double G = r->G;
+	const double softening2 = r->softening*r->softening;
+	// Same order of operations as REB_GRAVITY_BASIC
+	for (int i=i0; i<i1; i++){
+		double ax = 0.;
+		double ay = 0.;
+		double az = 0.;
+		const double xi = particles[i].x;
+		const double yi = particles[i].y;
+		const double zi = particles[i].z;
+		for (int j=0; j<N_active; j++){
+			if (i==j) continue;
+			const double dx = xi - particles[j].x;
+			const double dy = yi - particles[j].y;
+			const double dz = zi - particles[j].z;
+			const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+			const double prefact = -G/(_r*_r*_r)*particles[j].m;
+			ax += prefact*dx;
+			ay += prefact*dy;
+			az += prefact*dz;
+		}
+		particles[i].ax = ax;
+		particles[i].ay = ay;
+		particles[i].az = az;
+	}
+}
+
 void reb_calculate_acceleration_var(struct reb_simulation* r){
 	struct reb_particle* const particles = r->particles;
 	const double G = r->G;
@@ -410,6 +473,31 @@ void reb_calculate_acceleration_var(struct reb_simulation* r){
 			}
         }
 		case REB_GRAVITY_BASIC:
+        {
+            // The geometry of each pair of real particles is the same for all variational 
+            // particles and is therefore only calculated once. Test particle sets only need 
+            // one row and calculate it on the fly.
+            int need_pairs = 0;
+            for (int v=0;v<r->var_config_N;v++){
+                if (r->var_config[v].testparticle<0) need_pairs = 1;
+            }
+            const int N_pairs = _N_real*(_N_real-1)/2;
+            if (need_pairs && r->gravity_var_geometry_allocatedN<N_pairs){
+                r->gravity_var_geometry = realloc(r->gravity_var_geometry,sizeof(double)*REB_GRAVITY_VAR_GEOMETRY_N*N_pairs);
+                r->gravity_var_geometry_allocatedN = N_pairs;
+            }
+            double* const geometry = r->gravity_var_geometry;
+            if (need_pairs){
+#pragma omp parallel for schedule(guided)
+                for (int i=0; i<_N_real; i++){
+                    double* const gi = geometry + REB_GRAVITY_VAR_GEOMETRY_N*reb_gravity_var_pair_index(_N_real,i);
+                    for (int j=i+1; j<_N_real; j++){
+                        reb_gravity_var_geometry(particles[i], particles[j], gi + REB_GRAVITY_VAR_GEOMETRY_N*(j-i-1));
+                    }
+                }
+            }
+            // Each variational set only writes to its own particles.
+#pragma omp parallel for schedule(dynamic)
             for (int v=0;v<r->var_config_N;v++){
                 struct reb_variational_configuration const vc = r->var_config[v];
                 if (vc.order==1){
@@ -424,15 +512,15 @@ void reb_calculate_acceleration_var(struct reb_simulation* r){
                             particles_var1[i].az = 0.; 
                         }
                         for (int i=0; i<_N_real; i++){
+                        const double* const gi = geometry + REB_GRAVITY_VAR_GEOMETRY_N*reb_gravity_var_pair_index(_N_real,i);
                         for (int j=i+1; j<_N_real; j++){
                             if (_gravity_ignore_10 && ((i==1 && j==0) || (j==1 && i==0)) ) continue;
-                            const double dx = particles[i].x - particles[j].x;
-                            const double dy = particles[i].y - particles[j].y;
-                            const double dz = particles[i].z - particles[j].z;
-                            const double r2 = dx*dx + dy*dy + dz*dz;
-                            const double _r  = sqrt(r2);
-                            const double r3inv = 1./(r2*_r);
-                            const double r5inv = 3.*r3inv/r2;
+                            const double* const g = gi + REB_GRAVITY_VAR_GEOMETRY_N*(j-i-1);
+                            const double dx = g[0];
+                            const double dy = g[1];
+                            const double dz = g[2];
+                            const double r3inv = g[3];
+                            const double r5inv = g[4];
                             const double ddx = particles_var1[i].x - particles_var1[j].x;
                             const double ddy = particles_var1[i].y - particles_var1[j].y;
                             const double ddz = particles_var1[i].z - particles_var1[j].z;
@@ -471,13 +559,13 @@ void reb_calculate_acceleration_var(struct reb_simulation* r){
                         for (int j=0; j<_N_real; j++){
                             if (i==j) continue;
                             if (_gravity_ignore_10 && ((i==1 && j==0) || (j==1 && i==0)) ) continue;
-                            const double dx = particles[i].x - particles[j].x;
-                            const double dy = particles[i].y - particles[j].y;
-                            const double dz = particles[i].z - particles[j].z;
-                            const double r2 = dx*dx + dy*dy + dz*dz;
-                            const double _r  = sqrt(r2);
-                            const double r3inv = 1./(r2*_r);
-                            const double r5inv = 3.*r3inv/r2;
+                            double g[REB_GRAVITY_VAR_GEOMETRY_N];
+                            reb_gravity_var_geometry(particles[i], particles[j], g);
+                            const double dx = g[0];
+                            const double dy = g[1];
+                            const double dz = g[2];
+                            const double r3inv = g[3];
+                            const double r5inv = g[4];
                             const double ddx = particles_var1[0].x;
                             const double ddy = particles_var1[0].y;
                             const double ddz = particles_var1[0].z;
@@ -516,17 +604,17 @@ void reb_calculate_acceleration_var(struct reb_simulation* r){
                             particles_var2[i].az = 0.; 
                         }
                         for (int i=0; i<_N_real; i++){
+                        const double* const gi = geometry + REB_GRAVITY_VAR_GEOMETRY_N*reb_gravity_var_pair_index(_N_real,i);
                         for (int j=i+1; j<_N_real; j++){
                             // TODO: Need to implement WH skipping
                             //if (_gravity_ignore_10 && ((i==1 && j==0) || (j==1 && i==0)) ) continue;
-                            const double dx = particles[i].x - particles[j].x;
-                            const double dy = particles[i].y - particles[j].y;
-                            const double dz = particles[i].z - particles[j].z;
-                            const double r2 = dx*dx + dy*dy + dz*dz;
-                            const double r  = sqrt(r2);
-                            const double r3inv = 1./(r2*r);
-                            const double r5inv = r3inv/r2;
-                            const double r7inv = r5inv/r2;
+                            const double* const g = gi + REB_GRAVITY_VAR_GEOMETRY_N*(j-i-1);
+                            const double dx = g[0];
+                            const double dy = g[1];
+                            const double dz = g[2];
+                            const double r3inv = g[3];
+                            const double r5inv = g[5];
+                            const double r7inv = g[6];
                             const double ddx = particles_var2[i].x - particles_var2[j].x;
                             const double ddy = particles_var2[i].y - particles_var2[j].y;
                             const double ddz = particles_var2[i].z - particles_var2[j].z;
@@ -612,14 +700,14 @@ void reb_calculate_acceleration_var(struct reb_simulation* r){
                             if (i==j) continue;
                             // TODO: Need to implement WH skipping
                             //if (_gravity_ignore_10 && ((i==1 && j==0) || (j==1 && i==0)) ) continue;
-                            const double dx = particles[i].x - particles[j].x;
-                            const double dy = particles[i].y - particles[j].y;
-                            const double dz = particles[i].z - particles[j].z;
-                            const double r2 = dx*dx + dy*dy + dz*dz;
-                            const double r  = sqrt(r2);
-                            const double r3inv = 1./(r2*r);
-                            const double r5inv = r3inv/r2;
-                            const double r7inv = r5inv/r2;
+                            double g[REB_GRAVITY_VAR_GEOMETRY_N];
+                            reb_gravity_var_geometry(particles[i], particles[j], g);
+                            const double dx = g[0];
+                            const double dy = g[1];
+                            const double dz = g[2];
+                            const double r3inv = g[3];
+                            const double r5inv = g[5];
+                            const double r7inv = g[6];
                             const double ddx = particles_var2[0].x;
                             const double ddy = particles_var2[0].y;
                             const double ddz = particles_var2[0].z;
@@ -670,6 +758,7 @@ void reb_calculate_acceleration_var(struct reb_simulation* r){
                     }
                 }
             }
+        }
 			break;
 		default:
 			reb_exit("Variational gravity calculation not yet implemented.");
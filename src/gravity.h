@@ -33,6 +33,14 @@ struct reb_simulation;
   */
 void reb_calculate_acceleration(struct reb_simulation* r);
 
+/**
+  * Calculates the gravitational acceleration on the particles with index i0 to i1-1 
+  * due to all active particles. Only for REB_GRAVITY_BASIC without ghost boxes and 
+  * testparticle_type 0. The result is identical to that of reb_calculate_acceleration().
+  * Used by fused integrator steps, which call this function for one tile of particles at a time.
+  */
+void reb_calculate_acceleration_range(struct reb_simulation* r, const int i0, const int i1);
+
 /**
   * The function calculates the acceleration for the variational equations.
   */
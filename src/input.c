@@ -32,6 +32,7 @@
 #include "particle.h"
 #include "rebound.h"
 #include "collision.h"
+#include "integrator_ias15.h"
 #include "input.h"
 #ifdef MPI
 #include "communication_mpi.h"
@@ -85,13 +86,8 @@ char* reb_read_char(int argc, char** argv, const char* argument){
 }
 
 static void reb_read_dp7(struct reb_dp7* dp7, const int N3, FILE* inf){
-    dp7->p0 = malloc(sizeof(double)*N3);
-    dp7->p1 = malloc(sizeof(double)*N3);
-    dp7->p2 = malloc(sizeof(double)*N3);
-    dp7->p3 = malloc(sizeof(double)*N3);
-    dp7->p4 = malloc(sizeof(double)*N3);
-    dp7->p5 = malloc(sizeof(double)*N3);
-    dp7->p6 = malloc(sizeof(double)*N3);
+    dp7->p0 = NULL;
+    reb_integrator_ias15_alloc_dp7(dp7, N3);
     fread(dp7->p0,sizeof(double),N3,inf);
     fread(dp7->p1,sizeof(double),N3,inf);
     fread(dp7->p2,sizeof(double),N3,inf);
@@ -129,6 +125,7 @@ struct reb_simulation* reb_create_simulation_from_binary(char* filename){
         // Read main simulation oject.
         objects += fread(r,sizeof(struct reb_simulation),1,inf);
         int ri_ias15_allocatedN = r->ri_ias15.allocatedN;
+        int ri_ias15_block_allocatedN = r->ri_ias15.block_allocatedN;
         if(reb_reset_function_pointers(r)){
             reb_warning("You have to reset function pointers after creating a reb_simulation struct with a binary file.");
         }
@@ -179,6 +176,13 @@ struct reb_simulation* reb_create_simulation_from_binary(char* filename){
             reb_read_dp7(&(r->ri_ias15.br) ,N3,inf);
             reb_read_dp7(&(r->ri_ias15.er) ,N3,inf);
         }
+        // Read levels and timesteps of the IAS15 block timestepping
+        if (ri_ias15_block_allocatedN){
+            int N = ri_ias15_block_allocatedN;
+            reb_integrator_ias15_block_alloc(r,N);
+            fread(r->ri_ias15.block_level,sizeof(int),N,inf);
+            fread(r->ri_ias15.block_dt,sizeof(double),N,inf);
+        }
 
         fclose(inf);
     }else{
@@ -34,6 +34,7 @@
 #include <time.h>
 #include "rebound.h"
 #include "gravity.h"
+#include "collision.h"
 #include "output.h"
 #include "integrator.h"
 #include "integrator_whfast.h"
@@ -93,6 +94,35 @@ void reb_integrator_part2(struct reb_simulation* r){
 	}
 }
 	
+int reb_integrator_fused_step(struct reb_simulation* r){
+#ifdef MPI
+	return 0;
+#else // MPI
+	if (r->integrator==REB_INTEGRATOR_LEAPFROG){
+		if (r->ri_leapfrog.splitting!=REB_SPLITTING_LEAPFROG) return 0;
+	}else if (r->integrator!=REB_INTEGRATOR_SEI){
+		return 0;
+	}
+	if (r->N_var || r->additional_forces || r->tree_needs_update) return 0;
+	if (r->collision==REB_COLLISION_SOFTSPHERE || r->collision==REB_COLLISION_TREE) return 0;
+	int N_sources = 0;
+	if (r->gravity==REB_GRAVITY_BASIC){
+		if (r->nghostx || r->nghosty || r->nghostz || r->gravity_ignore_10 || r->testparticle_type) return 0;
+		N_sources = (r->N_active==-1)?r->N:r->N_active;
+		// Without massless particles all particles need to be drifted before any force is calculated.
+		if (N_sources>=r->N) return 0;
+	}else if (r->gravity!=REB_GRAVITY_NONE){
+		return 0;
+	}
+	if (r->integrator==REB_INTEGRATOR_LEAPFROG){
+		reb_integrator_leapfrog_fused_step(r, N_sources);
+	}else{
+		reb_integrator_sei_fused_step(r, N_sources);
+	}
+	return 1;
+#endif // MPI
+}
+
 void reb_integrator_synchronize(struct reb_simulation* r){
 	switch(r->integrator){
 		case REB_INTEGRATOR_IAS15:
@@ -129,11 +159,123 @@ void reb_integrator_reset(struct reb_simulation* r){
 	reb_integrator_whfast_reset(r);
 }
 
+// Converts a symmetric composition of second order drift-kick-drift steps with weights w into drift and kick coefficients.
+static int reb_integrator_splitting_composition(const int n, const double* const w, double* const c, double* const d){
+	const int m = 2*n+1; // Number of kicks: w[n], ..., w[1], w[0], w[1], ..., w[n]
+	for (int i=0;i<m;i++){
+		d[i] = w[abs(n-i)];
+	}
+	c[0] = 0.5*d[0];
+	for (int i=1;i<m;i++){
+		c[i] = 0.5*(d[i-1]+d[i]);
+	}
+	c[m] = 0.5*d[m-1];
+	return m;
+}
+
+int reb_integrator_splitting_coefficients(const int splitting, double* const c, double* const d){
+	switch(splitting){
+		case REB_SPLITTING_YOSHIDA4:
+		{
+			// Yoshida (1990), Eq. 4.11
+			const double cbrt2 = cbrt(2.);
+			double w[2] = {0., 1./(2.-cbrt2)};
+			w[0] = 1.-2.*w[1];
+			return reb_integrator_splitting_composition(1, w, c, d);
+		}
+		case REB_SPLITTING_YOSHIDA6:
+		{
+			// Yoshida (1990), Table 1, solution A
+			double w[4] = {0., -0.117767998417887e1, 0.235573213359357e0, 0.784513610477560e0};
+			w[0] = 1.-2.*(w[1]+w[2]+w[3]);
+			return reb_integrator_splitting_composition(3, w, c, d);
+		}
+		case REB_SPLITTING_YOSHIDA8:
+		{
+			// Yoshida (1990), Table 2, solution D
+			double w[8] = {0., 0.102799849391985e0, -0.196061023297549e1, 0.193813913762276e1, -0.158240635368243e0, -0.144485223686048e1, 0.253693336566229e0, 0.914844246229740e0};
+			w[0] = 1.-2.*(w[1]+w[2]+w[3]+w[4]+w[5]+w[6]+w[7]);
+			return reb_integrator_splitting_composition(7, w, c, d);
+		}
+		case REB_SPLITTING_SABA2:
+			// Laskar & Robutel (2001), Gauss-Legendre nodes
+			c[0] = 0.5-sqrt(3.)/6.;
+			c[1] = sqrt(3.)/3.;
+			c[2] = c[0];
+			d[0] = 0.5;
+			d[1] = 0.5;
+			return 2;
+		case REB_SPLITTING_SABA3:
+			c[0] = 0.5-sqrt(15.)/10.;
+			c[1] = sqrt(15.)/10.;
+			c[2] = c[1];
+			c[3] = c[0];
+			d[0] = 5./18.;
+			d[1] = 4./9.;
+			d[2] = d[0];
+			return 3;
+		case REB_SPLITTING_SABA4:
+			c[0] = 0.5-sqrt(525.+70.*sqrt(30.))/70.;
+			c[1] = (sqrt(525.+70.*sqrt(30.))-sqrt(525.-70.*sqrt(30.)))/70.;
+			c[2] = sqrt(525.-70.*sqrt(30.))/35.;
+			c[3] = c[1];
+			c[4] = c[0];
+			d[0] = 0.25-sqrt(30.)/72.;
+			d[1] = 0.25+sqrt(30.)/72.;
+			d[2] = d[1];
+			d[3] = d[0];
+			return 4;
+		case REB_SPLITTING_SBAB2:
+			// Laskar & Robutel (2001), Gauss-Lobatto nodes
+			c[0] = 0.;
+			c[1] = 0.5;
+			c[2] = 0.5;
+			c[3] = 0.;
+			d[0] = 1./6.;
+			d[1] = 2./3.;
+			d[2] = d[0];
+			return 3;
+		case REB_SPLITTING_SBAB3:
+			c[0] = 0.;
+			c[1] = 0.5-sqrt(5.)/10.;
+			c[2] = sqrt(5.)/5.;
+			c[3] = c[1];
+			c[4] = 0.;
+			d[0] = 1./12.;
+			d[1] = 5./12.;
+			d[2] = d[1];
+			d[3] = d[0];
+			return 4;
+		case REB_SPLITTING_SBAB4:
+			c[0] = 0.;
+			c[1] = 0.5-sqrt(21.)/14.;
+			c[2] = sqrt(21.)/14.;
+			c[3] = c[2];
+			c[4] = c[1];
+			c[5] = 0.;
+			d[0] = 1./20.;
+			d[1] = 49./180.;
+			d[2] = 16./45.;
+			d[3] = d[1];
+			d[4] = d[0];
+			return 5;
+		default:
+			// Second order drift-kick-drift
+			c[0] = 0.5;
+			c[1] = 0.5;
+			d[0] = 1.;
+			return 1;
+	}
+}
+
 void reb_update_acceleration(struct reb_simulation* r){
 	// This should probably go elsewhere
 	PROFILING_STOP(PROFILING_CAT_INTEGRATOR)
 	PROFILING_START()
 	reb_calculate_acceleration(r);
+	if (r->collision==REB_COLLISION_SOFTSPHERE){
+		reb_collision_softsphere_forces(r);
+	}
 	if (r->N_var){
 		reb_calculate_acceleration_var(r);
 	}
@@ -44,6 +44,24 @@ void reb_integrator_part1(struct reb_simulation* r);
 void reb_integrator_part2(struct reb_simulation* r);
 
 
+/**
+ * @brief Performs a full timestep with a single pass over most particles if possible.
+ * @details Supported are LEAPFROG (with the default splitting) and SEI with 
+ * REB_GRAVITY_NONE, or with REB_GRAVITY_BASIC if there are particles with an 
+ * index >= N_active. Particles are processed in tiles of REB_INTEGRATOR_FUSED_TILE 
+ * particles. Each tile is drifted, its forces are calculated, and it is kicked 
+ * and drifted again while it is still in cache. The results are identical to calling 
+ * reb_integrator_part1(), reb_calculate_acceleration() and reb_integrator_part2().
+ * Additional forces, variational particles, ghost boxes, trees and MPI are not supported.
+ * @return 1 if the timestep was done, 0 otherwise.
+ */
+int reb_integrator_fused_step(struct reb_simulation* r);
+
+/**
+ * @brief Number of particles per tile in a fused timestep.
+ */
+#define REB_INTEGRATOR_FUSED_TILE 256
+
 /** 
  * @brief This function updates the acceleration on all particles. 
  * @details It uses the current position and velocity data in the 
@@ -51,4 +69,22 @@ void reb_integrator_part2(struct reb_simulation* r);
  */
 void reb_update_acceleration(struct reb_simulation* r);
 
+/**
+ * @brief Maximum number of kicks in a splitting scheme.
+ */
+#define REB_SPLITTING_MAX_KICKS 15
+
+/**
+ * @brief Returns the coefficients of a splitting scheme.
+ * @details The timestep consists of the sequence 
+ * D(c[0]*dt) K(d[0]*dt) D(c[1]*dt) ... K(d[n-1]*dt) D(c[n]*dt),
+ * where D is a drift and K a kick. The coefficients are symmetric, 
+ * so c[n]==c[0]. The arrays need space for REB_SPLITTING_MAX_KICKS(+1) entries.
+ * @param splitting The splitting scheme (enum REB_SPLITTING).
+ * @param c Drift coefficients (n+1 entries).
+ * @param d Kick coefficients (n entries).
+ * @return The number of kicks n. 
+ */
+int reb_integrator_splitting_coefficients(const int splitting, double* const c, double* const d);
+
 #endif
@@ -37,8 +37,10 @@
 #include "integrator_ias15.h"
 #include "integrator_whfast.h"
 #define MIN(a, b) ((a) > (b) ? (b) : (a))    ///< Returns the minimum of a and b
+#define MAX(a, b) ((a) < (b) ? (b) : (a))    ///< Returns the maximum of a and b
 
 static void reb_integrator_hermes_check_for_encounter(struct reb_simulation* r);
+static void reb_integrator_hermes_update_mini(struct reb_simulation* r, const int warm);
 static void reb_integrator_hermes_additional_forces_mini(struct reb_simulation* mini);
 static void calc_forces_on_planets(const struct reb_simulation* r, double* a);
 
@@ -61,13 +63,12 @@ void reb_integrator_hermes_part1(struct reb_simulation* r){
     mini->collision_resolve_keep_sorted = r->collision_resolve_keep_sorted;
     mini->track_energy_offset = r->track_energy_offset;
 
-    // Remove all particles from mini
+    // The state of IAS15 can only be reused if the mini simulation was integrated 
+    // in the previous timestep and no particles were removed during the integration.
     mini->t = r->t;
-    int mini_previously_active = r->ri_hermes.mini_active;
-    mini->N = 0;
+    const int mini_warm = r->ri_hermes.mini_active && !r->ri_hermes.collision_this_global_dt;
     mini->energy_offset = 0.;
     r->ri_hermes.mini_active = 0;
-    r->ri_hermes.global_index_from_mini_index_N = 0;
     r->ri_hermes.collision_this_global_dt = 0;
     
     if (_N_active>r->ri_hermes.a_Nmax){
@@ -76,37 +77,19 @@ void reb_integrator_hermes_part1(struct reb_simulation* r){
         r->ri_hermes.a_Nmax = _N_active;
     }
     
-    //reset is_in_mini
+    //reset is_in_mini, all massive particles are always in mini
     if (r->N>r->ri_hermes.is_in_mini_Nmax){
         r->ri_hermes.is_in_mini_Nmax = r->N;
         r->ri_hermes.is_in_mini = realloc(r->ri_hermes.is_in_mini,r->N*sizeof(int));
     }
+    for(int i=0;i<_N_active;i++)r->ri_hermes.is_in_mini[i] = 1;
     for(int i=_N_active;i<r->N;i++)r->ri_hermes.is_in_mini[i] = 0;
     
-    // Add all massive particles
-    for (int i=0; i<_N_active; i++){
-        reb_add(r->ri_hermes.mini, r->particles[i]);
-        r->ri_hermes.is_in_mini[i] = 1;
-        if (r->ri_hermes.global_index_from_mini_index_N>=r->ri_hermes.global_index_from_mini_index_Nmax){
-            r->ri_hermes.global_index_from_mini_index_Nmax += 32;
-            r->ri_hermes.global_index_from_mini_index = realloc(r->ri_hermes.global_index_from_mini_index,r->ri_hermes.global_index_from_mini_index_Nmax*sizeof(int));
-        }
-        r->ri_hermes.global_index_from_mini_index[r->ri_hermes.global_index_from_mini_index_N] = i;
-        r->ri_hermes.global_index_from_mini_index_N++;
-    }
-    r->ri_hermes.mini->N_active = _N_active;
-
     reb_integrator_hermes_check_for_encounter(r);
-        
-    if (r->N != r->ri_hermes.mini->N || mini_previously_active==0) {
-        reb_integrator_ias15_clear(r->ri_hermes.mini);
-    }
     
-    calc_forces_on_planets(r, r->ri_hermes.a_i);
+    reb_integrator_hermes_update_mini(r, mini_warm);
     
-    if(r->ri_hermes.mini_active && r->track_energy_offset){
-        r->ri_hermes.energy_before_timestep = reb_tools_energy(r);
-    }
+    calc_forces_on_planets(r, r->ri_hermes.a_i);
     
     reb_integrator_whfast_part1(r);
 }
@@ -129,10 +112,9 @@ void reb_integrator_hermes_part2(struct reb_simulation* r){
             r->particles[r->ri_hermes.global_index_from_mini_index[i]].sim = r;    
         }
         
-        // Correct for energy jump in collision
+        // Correct for energy jump in collision. It is recorded by the collision resolve function.
         if(r->ri_hermes.collision_this_global_dt && r->track_energy_offset){
-            double Ef = reb_tools_energy(r);
-            r->energy_offset += r->ri_hermes.energy_before_timestep - Ef;
+            r->energy_offset += mini->energy_offset;
         }
     }
 }
@@ -154,6 +136,11 @@ void reb_integrator_hermes_reset(struct reb_simulation* r){
         reb_free_simulation(r->ri_hermes.mini);
         r->ri_hermes.mini = NULL;
     }
+    if(r->ri_hermes.mini_index_old){
+        free(r->ri_hermes.mini_index_old);
+        r->ri_hermes.mini_index_old = NULL;
+        r->ri_hermes.mini_index_old_Nmax = 0;
+    }
     if(r->ri_hermes.global_index_from_mini_index){
         free(r->ri_hermes.global_index_from_mini_index);
         r->ri_hermes.global_index_from_mini_index = NULL;
@@ -166,77 +153,271 @@ void reb_integrator_hermes_reset(struct reb_simulation* r){
     }
     if(r->ri_hermes.a_i){
         free(r->ri_hermes.a_i);
+        r->ri_hermes.a_i = NULL;
     }
     if(r->ri_hermes.a_f){
         free(r->ri_hermes.a_f);
+        r->ri_hermes.a_f = NULL;
     }
     r->ri_hermes.a_Nmax = 0;
+    if(r->ri_hermes.rhill){
+        free(r->ri_hermes.rhill);
+        r->ri_hermes.rhill = NULL;
+    }
+    r->ri_hermes.rhill_Nmax = 0;
+    if(r->ri_hermes.grid){
+        free(r->ri_hermes.grid);
+        r->ri_hermes.grid = NULL;
+    }
+    r->ri_hermes.grid_Nmax = 0;
+}
+
+/**
+ * @brief Minimum number of massive particles for which a spatial hash is used to find encounters.
+ * @details For fewer massive particles, every particle is checked against all massive particles directly.
+ */
+#define HERMES_GRID_MIN_N_ACTIVE 32
+
+// Checks if particles i (massive, i<j) and j have a close encounter. 
+static inline int reb_integrator_hermes_pair_encounter(const struct reb_particle pi, const struct reb_particle pj, const double rhi, const double rhj, const double hill_switch_factor2, const double radius_switch_factor, double* const min_dt_enc2){
+    const double radius_check = radius_switch_factor*pi.r;
+    const double rh_sum = rhi+rhj;
+    const double rh_sum2 = rh_sum*rh_sum;
+    const double dx = pi.x - pj.x;
+    const double dy = pi.y - pj.y;
+    const double dz = pi.z - pj.z;
+    const double rij2 = dx*dx + dy*dy + dz*dz;
+    if(rij2 < hill_switch_factor2*rh_sum2 || rij2 < radius_check*radius_check){
+        // Monitor hill radius/relative velocity
+        const double dvx = pi.vx - pj.vx;
+        const double dvy = pi.vy - pj.vy;
+        const double dvz = pi.vz - pj.vz;
+        const double vij2 = dvx*dvx + dvy*dvy + dvz*dvz;
+        const double dt_enc2 = hill_switch_factor2*rh_sum2/vij2;
+        *min_dt_enc2 = MIN(*min_dt_enc2,dt_enc2);
+        return 1;
+    }
+    return 0;
+}
+
+// Cell coordinate of the spatial hash. Clamped to avoid integer overflows for distant particles.
+static inline long long reb_integrator_hermes_cell(const double x, const double hi){
+    double c = floor(x*hi);
+    if (c>1e15) c = 1e15;
+    if (c<-1e15) c = -1e15;
+    return (long long)c;
+}
+
+static inline unsigned int reb_integrator_hermes_hash(const long long cx, const long long cy, const long long cz, const unsigned int mask){
+    return (unsigned int)(((unsigned long long)cx*73856093ULL) ^ ((unsigned long long)cy*19349663ULL) ^ ((unsigned long long)cz*83492791ULL)) & mask;
 }
 
 static void reb_integrator_hermes_check_for_encounter(struct reb_simulation* global){
-    struct reb_simulation* mini = global->ri_hermes.mini;
 	const int _N_active = ((global->N_active==-1)?global->N:global->N_active) - global->N_var;
-    struct reb_particle* global_particles = global->particles;
-    struct reb_particle p0 = global_particles[0];
-    double hill_switch_factor = global->ri_hermes.hill_switch_factor;
-    double hill_switch_factor2 = hill_switch_factor*hill_switch_factor;
+    const int N = global->N;
+    struct reb_particle* const global_particles = global->particles;
+    const struct reb_particle p0 = global_particles[0];
+    const double hill_switch_factor = global->ri_hermes.hill_switch_factor;
+    const double hill_switch_factor2 = hill_switch_factor*hill_switch_factor;
+    const double radius_switch_factor = global->ri_hermes.radius_switch_factor;
+    int* const is_in_mini = global->ri_hermes.is_in_mini;
     double min_dt_enc2 = INFINITY;
-    for (int i=0; i<_N_active; i++){
-        struct reb_particle pi = global_particles[i];
-        double radius_check = global->ri_hermes.radius_switch_factor*pi.r;
-        double radius_check2 = radius_check*radius_check;
+    int mini_active = 0;
+
+    // Hill radii only depend on the particle itself and are calculated once per timestep.
+    if (N>global->ri_hermes.rhill_Nmax){
+        global->ri_hermes.rhill_Nmax = N;
+        global->ri_hermes.rhill = realloc(global->ri_hermes.rhill,sizeof(double)*N);
+    }
+    double* const rhill = global->ri_hermes.rhill;
+    double rhill_max = 0.;
+#pragma omp parallel for schedule(guided) reduction(max:rhill_max)
+    for (int i=0; i<N; i++){
+        const struct reb_particle pi = global_particles[i];
         const double dxi = p0.x - pi.x;
         const double dyi = p0.y - pi.y;
         const double dzi = p0.z - pi.z;
         const double r0i2 = dxi*dxi + dyi*dyi + dzi*dzi;
-        const double mi = pi.m/(p0.m*3.);
-        double rhi = pow(mi*mi*r0i2*r0i2*r0i2,1./6.);
-        for(int j=i+1;j<global->N;j++){
-            struct reb_particle pj = global_particles[j];
-            
-            const double dxj = p0.x - pj.x;
-            const double dyj = p0.y - pj.y;
-            const double dzj = p0.z - pj.z;
-            const double r0j2 = dxj*dxj + dyj*dyj + dzj*dzj;
-            const double mj = pj.m/(p0.m*3.);
-            double rhj = pow(mj*mj*r0j2*r0j2*r0j2,1./6.);
-            const double rh_sum = rhi+rhj;
-            const double rh_sum2 = rh_sum*rh_sum;
-            
-            const double dx = pi.x - pj.x;
-            const double dy = pi.y - pj.y;
-            const double dz = pi.z - pj.z;
-            const double rij2 = dx*dx + dy*dy + dz*dz;
+        rhill[i] = cbrt(pi.m/(p0.m*3.))*sqrt(r0i2);
+        rhill_max = rhill[i]>rhill_max?rhill[i]:rhill_max;
+    }
 
-            if(rij2 < hill_switch_factor2*rh_sum2 || rij2 < radius_check2){
-                global->ri_hermes.mini_active = 1;
-                // Monitor hill radius/relative velocity
-                const double dvx = pi.vx - pj.vx;
-                const double dvy = pi.vy - pj.vy;
-                const double dvz = pi.vz - pj.vz;
-                const double vij2 = dvx*dvx + dvy*dvy + dvz*dvz;
-                const double dt_enc2 = hill_switch_factor2*rh_sum2/vij2;
-                min_dt_enc2 = MIN(min_dt_enc2,dt_enc2);
-                if (j>=_N_active && global->ri_hermes.is_in_mini[j]==0){//make sure not already added
-                    // Add particle to mini simulation
-                    reb_add(mini,pj);
-                    global->ri_hermes.is_in_mini[j] = 1;
-                    if (global->ri_hermes.global_index_from_mini_index_N>=global->ri_hermes.global_index_from_mini_index_Nmax){
-                        while(global->ri_hermes.global_index_from_mini_index_N>=global->ri_hermes.global_index_from_mini_index_Nmax) global->ri_hermes.global_index_from_mini_index_Nmax += 32;
-                        global->ri_hermes.global_index_from_mini_index = realloc(global->ri_hermes.global_index_from_mini_index,global->ri_hermes.global_index_from_mini_index_Nmax*sizeof(int));
+    if (_N_active>HERMES_GRID_MIN_N_ACTIVE){
+        // Spatial hash of the massive particles. Any particle closer to a massive particle than 
+        // the largest possible switching radius is in one of the 27 neighbouring cells.
+        double h = 0.;
+        for (int i=0; i<_N_active; i++){
+            const double ri = MAX(hill_switch_factor*rhill[i], radius_switch_factor*global_particles[i].r);
+            h = MAX(h,ri);
+        }
+        h += hill_switch_factor*rhill_max;
+        if (h>0.){
+            const double hi = 1./h;
+            unsigned int N_table = 1;
+            while (N_table<2*_N_active) N_table *= 2;
+            const unsigned int mask = N_table-1;
+            if (N_table+1+_N_active>global->ri_hermes.grid_Nmax){
+                global->ri_hermes.grid_Nmax = N_table+1+_N_active;
+                global->ri_hermes.grid = realloc(global->ri_hermes.grid,sizeof(int)*global->ri_hermes.grid_Nmax);
+            }
+            // grid[b]..grid[b+1]-1 are the positions of the particles in bucket b in grid+N_table+1. 
+            int* const grid_start = global->ri_hermes.grid;
+            int* const grid_particles = global->ri_hermes.grid+N_table+1;
+            memset(grid_start,0,sizeof(int)*(N_table+1));
+            for (int i=0; i<_N_active; i++){
+                const struct reb_particle pi = global_particles[i];
+                const unsigned int b = reb_integrator_hermes_hash(reb_integrator_hermes_cell(pi.x,hi), reb_integrator_hermes_cell(pi.y,hi), reb_integrator_hermes_cell(pi.z,hi), mask);
+                grid_start[b+1]++;
+            }
+            for (unsigned int b=0; b<N_table; b++){
+                grid_start[b+1] += grid_start[b];
+            }
+            // Fill the buckets from the end in reverse order so that each bucket is sorted.
+            // Afterwards grid_start[b+1] points to the start of bucket b.
+            for (int i=_N_active-1; i>=0; i--){
+                const struct reb_particle pi = global_particles[i];
+                const unsigned int b = reb_integrator_hermes_hash(reb_integrator_hermes_cell(pi.x,hi), reb_integrator_hermes_cell(pi.y,hi), reb_integrator_hermes_cell(pi.z,hi), mask);
+                grid_particles[--grid_start[b+1]] = i;
+            }
+            for (unsigned int b=0; b<N_table; b++){
+                grid_start[b] = grid_start[b+1];
+            }
+            grid_start[N_table] = _N_active;
+#pragma omp parallel for schedule(guided) reduction(min:min_dt_enc2) reduction(|:mini_active)
+            for (int j=1; j<N; j++){
+                const struct reb_particle pj = global_particles[j];
+                const long long cx = reb_integrator_hermes_cell(pj.x,hi);
+                const long long cy = reb_integrator_hermes_cell(pj.y,hi);
+                const long long cz = reb_integrator_hermes_cell(pj.z,hi);
+                unsigned int visited[27];
+                int N_visited = 0;
+                int encounter = 0;
+                for (int ox=-1; ox<=1; ox++){
+                for (int oy=-1; oy<=1; oy++){
+                for (int oz=-1; oz<=1; oz++){
+                    const unsigned int b = reb_integrator_hermes_hash(cx+ox, cy+oy, cz+oz, mask);
+                    int seen = 0;
+                    for (int k=0; k<N_visited; k++){
+                        if (visited[k]==b) seen = 1;
                     }
-                    global->ri_hermes.global_index_from_mini_index[global->ri_hermes.global_index_from_mini_index_N] = j;
-                    global->ri_hermes.global_index_from_mini_index_N++;
+                    if (seen) continue;
+                    visited[N_visited++] = b;
+                    for (int k=grid_start[b]; k<grid_start[b+1]; k++){
+                        const int i = grid_particles[k];
+                        if (i>=j) break; // Buckets are sorted
+                        encounter |= reb_integrator_hermes_pair_encounter(global_particles[i], pj, rhill[i], rhill[j], hill_switch_factor2, radius_switch_factor, &min_dt_enc2);
+                    }
+                }
+                }
+                }
+                if (encounter){
+                    mini_active = 1;
+                    if (j>=_N_active) is_in_mini[j] = 1;
                 }
             }
         }
+    }else{
+#pragma omp parallel for schedule(guided) reduction(min:min_dt_enc2) reduction(|:mini_active)
+        for (int j=1; j<N; j++){
+            const struct reb_particle pj = global_particles[j];
+            const int i_max = MIN(j,_N_active);
+            int encounter = 0;
+            for (int i=0; i<i_max; i++){
+                encounter |= reb_integrator_hermes_pair_encounter(global_particles[i], pj, rhill[i], rhill[j], hill_switch_factor2, radius_switch_factor, &min_dt_enc2);
+            }
+            if (encounter){
+                mini_active = 1;
+                if (j>=_N_active) is_in_mini[j] = 1;
+            }
+        }
+    }
+    if (mini_active){
+        global->ri_hermes.mini_active = 1;
     }
+
     if (global->ri_hermes.timestep_too_large_warning==0 && min_dt_enc2 < 16.*global->dt*global->dt){
         global->ri_hermes.timestep_too_large_warning = 1;
         reb_warning("The timestep is likely too large. Close encounters might be missed. Decrease the timestep or increase the switching radius. This warning will appear only once.");
     }
 }
 
+// Returns 1 if the mini simulation still has the same particle as the global simulation.
+static inline int reb_integrator_hermes_same_particle(const struct reb_particle p1, const struct reb_particle p2){
+    return p1.x==p2.x && p1.y==p2.y && p1.z==p2.z && p1.vx==p2.vx && p1.vy==p2.vy && p1.vz==p2.vz && p1.m==p2.m;
+}
+
+// Brings the mini simulation up to date with the particles flagged in is_in_mini.
+// Particles that were already in the mini simulation in the previous timestep keep 
+// their IAS15 predictors. Particles are kept in the order of their global index.
+static void reb_integrator_hermes_update_mini(struct reb_simulation* global, const int warm){
+    struct reb_simulation* mini = global->ri_hermes.mini;
+	const int _N_active = ((global->N_active==-1)?global->N:global->N_active) - global->N_var;
+    const int N = global->N;
+    const struct reb_particle* const global_particles = global->particles;
+    const int* const is_in_mini = global->ri_hermes.is_in_mini;
+    const int N_old = warm?MIN(global->ri_hermes.global_index_from_mini_index_N,mini->N):0;
+    int N_mini = 0;
+    for (int j=0; j<N; j++){
+        N_mini += is_in_mini[j];
+    }
+    if (N_old+N_mini>global->ri_hermes.mini_index_old_Nmax){
+        global->ri_hermes.mini_index_old_Nmax = N_old+N_mini;
+        global->ri_hermes.mini_index_old = realloc(global->ri_hermes.mini_index_old,sizeof(int)*global->ri_hermes.mini_index_old_Nmax);
+    }
+    if (N_mini>global->ri_hermes.global_index_from_mini_index_Nmax){
+        while(N_mini>global->ri_hermes.global_index_from_mini_index_Nmax) global->ri_hermes.global_index_from_mini_index_Nmax += 32;
+        global->ri_hermes.global_index_from_mini_index = realloc(global->ri_hermes.global_index_from_mini_index,global->ri_hermes.global_index_from_mini_index_Nmax*sizeof(int));
+    }
+    int* const global_index_old = global->ri_hermes.mini_index_old;
+    int* const mini_index_old = global->ri_hermes.mini_index_old+N_old;
+    int* const global_index = global->ri_hermes.global_index_from_mini_index;
+    memcpy(global_index_old, global_index, sizeof(int)*N_old);
+
+    // Both index maps are sorted, so matching them is a single merge.
+    int N_retained = 0;
+    int k = 0;
+    int p = 0;
+    for (int j=0; j<N; j++){
+        if (!is_in_mini[j]) continue;
+        while (p<N_old && global_index_old[p]<j) p++;
+        mini_index_old[k] = -1;
+        if (p<N_old && global_index_old[p]==j && reb_integrator_hermes_same_particle(mini->particles[p],global_particles[j])){
+            mini_index_old[k] = p;
+            N_retained++;
+        }
+        global_index[k] = j;
+        k++;
+    }
+    global->ri_hermes.global_index_from_mini_index_N = N_mini;
+
+    while (mini->allocatedN<N_mini){
+        mini->allocatedN += 128;
+        mini->particles = realloc(mini->particles,sizeof(struct reb_particle)*mini->allocatedN);
+    }
+    for (int i=0; i<N_mini; i++){
+        const struct reb_particle pk = global_particles[global_index[i]];
+        mini->particles[i] = pk;
+        mini->particles[i].sim = mini;
+        if (mini_index_old[i]==-1){
+            // Same as in reb_add()
+            if (pk.r>=mini->max_radius[0]){
+                mini->max_radius[1] = mini->max_radius[0];
+                mini->max_radius[0] = pk.r;
+            }else if (pk.r>=mini->max_radius[1]){
+                mini->max_radius[1] = pk.r;
+            }
+        }
+    }
+    mini->N = N_mini;
+    mini->N_active = _N_active;
+
+    if (N_retained==0){
+        reb_integrator_ias15_clear(mini);
+    }else if (N_retained!=N_mini || N_mini!=N_old){
+        reb_integrator_ias15_permute(mini, mini_index_old, N_mini);
+    }
+}
+
 static void calc_forces_on_planets(const struct reb_simulation* r, double* a){
     int* is_in_mini = r->ri_hermes.is_in_mini;
     double G = r->G;
@@ -67,7 +67,6 @@ struct reb_dpconst7 {
 };
 
 // Helper functions for resetting the b and e coefficients
-static void copybuffers(const struct reb_dpconst7 _a, const struct reb_dpconst7 _b, int N3);
 static void predict_next_step(double ratio, int N3,  const struct reb_dpconst7 _e, const struct reb_dpconst7 _b, const struct reb_dpconst7 e, const struct reb_dpconst7 b);
 
 
@@ -76,6 +75,15 @@ static void predict_next_step(double ratio, int N3,  const struct reb_dpconst7 _
 
 static const double safety_factor           = 0.25; /**< Maximum increase/deacrease of consecutve timesteps. */
 
+/**
+ * @brief Minimum number of particles for which the IAS15 sweeps are run in parallel.
+ * @details Below this the cost of starting an OpenMP team exceeds the work in a single sweep.
+ * All sweeps use a static schedule so that each thread touches the same part of the 
+ * arrays in every sweep. The error estimates are max-reductions and therefore 
+ * independent of the number of threads.
+ */
+#define REB_IAS15_OMP_MIN_N 1000
+
 // Gauss Radau spacings
 static const double h[8]    = { 0.0, 0.0562625605369221464656521910318, 0.180240691736892364987579942780, 0.352624717113169637373907769648, 0.547153626330555383001448554766, 0.734210177215410531523210605558, 0.885320946839095768090359771030, 0.977520613561287501891174488626};
 // Other constants
@@ -88,14 +96,18 @@ static const double d[21] = {0.0562625605369221464656522, 0.00316547571817082924
 static const double w[8] = {0.03125, 0.185358154802979278540728972807180754479812609, 0.304130620646785128975743291458180383736715043, 0.376517545389118556572129261157225608762708603, 0.391572167452493593082499533303669362149363727, 0.347014795634501068709955597003528601733139176, 0.249647901329864963257869294715235590174262844, 0.114508814744257199342353731044292225247093225};
 
 
+/**
+ * @brief Distance between the p0..p6 arrays of a reb_dp7 in units of doubles.
+ * @details All seven arrays of a reb_dp7 are stored in a single block. Each array 
+ * is padded to a multiple of 8 doubles so that it starts on a 64 byte boundary.
+ */
+static inline int dp7_stride(const int N3){
+    return (N3+7)&~7;
+}
+
 static void free_dp7(struct reb_dp7* dp7){
+    // p1..p6 point into the same block as p0.
     free(dp7->p0);
-    free(dp7->p1);
-    free(dp7->p2);
-    free(dp7->p3);
-    free(dp7->p4);
-    free(dp7->p5);
-    free(dp7->p6);
     dp7->p0 = NULL;
     dp7->p1 = NULL;
     dp7->p2 = NULL;
@@ -104,25 +116,50 @@ static void free_dp7(struct reb_dp7* dp7){
     dp7->p5 = NULL;
     dp7->p6 = NULL;
 }
+// Number of doubles in the block of a reb_dp7. Uses the stride of the allocation, which can be larger than that of the current N3.
+static inline int dp7_size(const struct reb_dp7* const dp7){
+    return 7*(int)(dp7->p1 - dp7->p0);
+}
 static void clear_dp7(struct reb_dp7* const dp7, const int N3){
-    for (int k=0;k<N3;k++){
-        dp7->p0[k] = 0.;
-        dp7->p1[k] = 0.;
-        dp7->p2[k] = 0.;
-        dp7->p3[k] = 0.;
-        dp7->p4[k] = 0.;
-        dp7->p5[k] = 0.;
-        dp7->p6[k] = 0.;
-    }
-}
-static void realloc_dp7(struct reb_dp7* const dp7, const int N3){
-    dp7->p0 = realloc(dp7->p0,sizeof(double)*N3);
-    dp7->p1 = realloc(dp7->p1,sizeof(double)*N3);
-    dp7->p2 = realloc(dp7->p2,sizeof(double)*N3);
-    dp7->p3 = realloc(dp7->p3,sizeof(double)*N3);
-    dp7->p4 = realloc(dp7->p4,sizeof(double)*N3);
-    dp7->p5 = realloc(dp7->p5,sizeof(double)*N3);
-    dp7->p6 = realloc(dp7->p6,sizeof(double)*N3);
+    const int N7 = dp7_size(dp7);
+    double* restrict const p = dp7->p0;
+    if (N3>3*REB_IAS15_OMP_MIN_N){
+#pragma omp parallel for schedule(static)
+        for (int k=0;k<N7;k++){
+            p[k] = 0.;
+        }
+    }else{
+        memset(p, 0, sizeof(double)*N7);
+    }
+}
+static void copy_dp7(const struct reb_dp7* const _a, struct reb_dp7* const _b, const int N3){
+    // All dp7 arrays of IAS15 are allocated together and have the same stride.
+    const int N7 = dp7_size(_a);
+    const double* restrict const pa = _a->p0;
+    double* restrict const pb = _b->p0;
+    if (N3>3*REB_IAS15_OMP_MIN_N){
+#pragma omp parallel for schedule(static)
+        for (int k=0;k<N7;k++){
+            pb[k] = pa[k];
+        }
+    }else{
+        memcpy(pb, pa, sizeof(double)*N7);
+    }
+}
+void reb_integrator_ias15_alloc_dp7(struct reb_dp7* const dp7, const int N3){
+    free_dp7(dp7);
+    const int stride = dp7_stride(N3);
+    double* block;
+    if (posix_memalign((void**)&block, 64, sizeof(double)*7*stride)){
+        reb_exit("Cannot allocate memory for IAS15.");
+    }
+    dp7->p0 = block;
+    dp7->p1 = block + 1*stride;
+    dp7->p2 = block + 2*stride;
+    dp7->p3 = block + 3*stride;
+    dp7->p4 = block + 4*stride;
+    dp7->p5 = block + 5*stride;
+    dp7->p6 = block + 6*stride;
     clear_dp7(dp7,N3);
 }
 
@@ -139,25 +176,15 @@ static struct reb_dpconst7 dpcast(struct reb_dp7 dp){
     return dpc;
 }
 
-static inline void add_cs(double* p, double* csp, double inp){
-    const double y = inp - *csp;
-    const double t = *p + y;
-    *csp = (t - *p) - y;
-    *p = t;
-}
- 
-// Does the actual timestep.
-static int reb_integrator_ias15_step(struct reb_simulation* r) {
-    struct reb_particle* const particles = r->particles;
-    const int N = r->N;
-    const int N3 = 3*N;
+// Allocates the arrays used by IAS15 for N3 values if needed.
+static void reb_integrator_ias15_alloc(struct reb_simulation* r, const int N3){
     if (N3 > r->ri_ias15.allocatedN) {
-        realloc_dp7(&(r->ri_ias15.g),N3);
-        realloc_dp7(&(r->ri_ias15.b),N3);
-        realloc_dp7(&(r->ri_ias15.csb),N3);
-        realloc_dp7(&(r->ri_ias15.e),N3);
-        realloc_dp7(&(r->ri_ias15.br),N3);
-        realloc_dp7(&(r->ri_ias15.er),N3);
+        reb_integrator_ias15_alloc_dp7(&(r->ri_ias15.g),N3);
+        reb_integrator_ias15_alloc_dp7(&(r->ri_ias15.b),N3);
+        reb_integrator_ias15_alloc_dp7(&(r->ri_ias15.csb),N3);
+        reb_integrator_ias15_alloc_dp7(&(r->ri_ias15.e),N3);
+        reb_integrator_ias15_alloc_dp7(&(r->ri_ias15.br),N3);
+        reb_integrator_ias15_alloc_dp7(&(r->ri_ias15.er),N3);
         r->ri_ias15.at = realloc(r->ri_ias15.at,sizeof(double)*N3);
         r->ri_ias15.x0 = realloc(r->ri_ias15.x0,sizeof(double)*N3);
         r->ri_ias15.v0 = realloc(r->ri_ias15.v0,sizeof(double)*N3);
@@ -174,6 +201,161 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
         }
         r->ri_ias15.allocatedN = N3;
     }
+}
+
+static inline void add_cs(double* p, double* csp, double inp){
+    const double y = inp - *csp;
+    const double t = *p + y;
+    *csp = (t - *p) - y;
+    *p = t;
+}
+
+/**
+ * @brief Sweeps over the coefficient arrays of IAS15.
+ * @details The sweeps are kept in separate functions so that the restrict qualified 
+ * pointers of reb_dpconst7 are function arguments. The compiler can then vectorize 
+ * the loops, including the compensated summation. The operations are the same as 
+ * in the scalar loops, results are bit-identical.
+ */
+static void init_g(const int N3, const struct reb_dpconst7 g, const struct reb_dpconst7 b){
+#pragma omp parallel for schedule(static) if(N3>3*REB_IAS15_OMP_MIN_N)
+    for(int k=0;k<N3;k++) {
+        g.p0[k] = b.p6[k]*d[15] + b.p5[k]*d[10] + b.p4[k]*d[6] + b.p3[k]*d[3]  + b.p2[k]*d[1]  + b.p1[k]*d[0]  + b.p0[k];
+        g.p1[k] = b.p6[k]*d[16] + b.p5[k]*d[11] + b.p4[k]*d[7] + b.p3[k]*d[4]  + b.p2[k]*d[2]  + b.p1[k];
+        g.p2[k] = b.p6[k]*d[17] + b.p5[k]*d[12] + b.p4[k]*d[8] + b.p3[k]*d[5]  + b.p2[k];
+        g.p3[k] = b.p6[k]*d[18] + b.p5[k]*d[13] + b.p4[k]*d[9] + b.p3[k];
+        g.p4[k] = b.p6[k]*d[19] + b.p5[k]*d[14] + b.p4[k];
+        g.p5[k] = b.p6[k]*d[20] + b.p5[k];
+        g.p6[k] = b.p6[k];
+    }
+}
+
+static void correct_b(const int n, const int N3, const double* restrict const at, const double* restrict const gcs, const double* restrict const a0, const double* restrict const csa0, const struct reb_dpconst7 g, const struct reb_dpconst7 b, const struct reb_dpconst7 csb){
+    switch (n) {
+        case 1: 
+#pragma omp parallel for schedule(static) if(N3>3*REB_IAS15_OMP_MIN_N)
+            for(int k=0;k<N3;++k) {
+                double tmp = g.p0[k];
+                double gk = at[k];
+                double gk_cs = gcs[k];
+                add_cs(&gk, &gk_cs, -a0[k]);
+                add_cs(&gk, &gk_cs, csa0[k]);
+                g.p0[k]  = gk/rr[0];
+                add_cs(&(b.p0[k]), &(csb.p0[k]), g.p0[k]-tmp);
+            } break;
+        case 2: 
+#pragma omp parallel for schedule(static) if(N3>3*REB_IAS15_OMP_MIN_N)
+            for(int k=0;k<N3;++k) {
+                double tmp = g.p1[k];
+                double gk = at[k];
+                double gk_cs = gcs[k];
+                add_cs(&gk, &gk_cs, -a0[k]);
+                add_cs(&gk, &gk_cs, csa0[k]);
+                g.p1[k] = (gk/rr[1] - g.p0[k])/rr[2];
+                tmp = g.p1[k] - tmp;
+                add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[0]);
+                add_cs(&(b.p1[k]), &(csb.p1[k]), tmp);
+            } break;
+        case 3: 
+#pragma omp parallel for schedule(static) if(N3>3*REB_IAS15_OMP_MIN_N)
+            for(int k=0;k<N3;++k) {
+                double tmp = g.p2[k];
+                double gk = at[k];
+                double gk_cs = gcs[k];
+                add_cs(&gk, &gk_cs, -a0[k]);
+                add_cs(&gk, &gk_cs, csa0[k]);
+                g.p2[k] = ((gk/rr[3] - g.p0[k])/rr[4] - g.p1[k])/rr[5];
+                tmp = g.p2[k] - tmp;
+                add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[1]);
+                add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[2]);
+                add_cs(&(b.p2[k]), &(csb.p2[k]), tmp);
+            } break;
+        case 4:
+#pragma omp parallel for schedule(static) if(N3>3*REB_IAS15_OMP_MIN_N)
+            for(int k=0;k<N3;++k) {
+                double tmp = g.p3[k];
+                double gk = at[k];
+                double gk_cs = gcs[k];
+                add_cs(&gk, &gk_cs, -a0[k]);
+                add_cs(&gk, &gk_cs, csa0[k]);
+                g.p3[k] = (((gk/rr[6] - g.p0[k])/rr[7] - g.p1[k])/rr[8] - g.p2[k])/rr[9];
+                tmp = g.p3[k] - tmp;
+                add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[3]);
+                add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[4]);
+                add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[5]);
+                add_cs(&(b.p3[k]), &(csb.p3[k]), tmp);
+            } break;
+        case 5:
+#pragma omp parallel for schedule(static) if(N3>3*REB_IAS15_OMP_MIN_N)
+            for(int k=0;k<N3;++k) {
+                double tmp = g.p4[k];
+                double gk = at[k];
+                double gk_cs = gcs[k];
+                add_cs(&gk, &gk_cs, -a0[k]);
+                add_cs(&gk, &gk_cs, csa0[k]);
+                g.p4[k] = ((((gk/rr[10] - g.p0[k])/rr[11] - g.p1[k])/rr[12] - g.p2[k])/rr[13] - g.p3[k])/rr[14];
+                tmp = g.p4[k] - tmp;
+                add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[6]);
+                add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[7]);
+                add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[8]);
+                add_cs(&(b.p3[k]), &(csb.p3[k]), tmp * c[9]);
+                add_cs(&(b.p4[k]), &(csb.p4[k]), tmp);
+            } break;
+        case 6:
+#pragma omp parallel for schedule(static) if(N3>3*REB_IAS15_OMP_MIN_N)
+            for(int k=0;k<N3;++k) {
+                double tmp = g.p5[k];
+                double gk = at[k];
+                double gk_cs = gcs[k];
+                add_cs(&gk, &gk_cs, -a0[k]);
+                add_cs(&gk, &gk_cs, csa0[k]);
+                g.p5[k] = (((((gk/rr[15] - g.p0[k])/rr[16] - g.p1[k])/rr[17] - g.p2[k])/rr[18] - g.p3[k])/rr[19] - g.p4[k])/rr[20];
+                tmp = g.p5[k] - tmp;
+                add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[10]);
+                add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[11]);
+                add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[12]);
+                add_cs(&(b.p3[k]), &(csb.p3[k]), tmp * c[13]);
+                add_cs(&(b.p4[k]), &(csb.p4[k]), tmp * c[14]);
+                add_cs(&(b.p5[k]), &(csb.p5[k]), tmp);
+            } break;
+    }
+}
+
+static void advance_x0_v0(const int N3, const double dt_done, double* restrict const x0, double* restrict const csx, double* restrict const v0, double* restrict const csv, const double* restrict const a0, const struct reb_dpconst7 b){
+    const double dt_done2 = dt_done * dt_done;
+#pragma omp parallel for schedule(static) if(N3>3*REB_IAS15_OMP_MIN_N)
+    for(int k=0;k<N3;++k) {
+        {
+            add_cs(&(x0[k]), &(csx[k]), b.p6[k]/72.*dt_done2);
+            add_cs(&(x0[k]), &(csx[k]), b.p5[k]/56.*dt_done2);
+            add_cs(&(x0[k]), &(csx[k]), b.p4[k]/42.*dt_done2);
+            add_cs(&(x0[k]), &(csx[k]), b.p3[k]/30.*dt_done2);
+            add_cs(&(x0[k]), &(csx[k]), b.p2[k]/20.*dt_done2);
+            add_cs(&(x0[k]), &(csx[k]), b.p1[k]/12.*dt_done2);
+            add_cs(&(x0[k]), &(csx[k]), b.p0[k]/6.*dt_done2);
+            add_cs(&(x0[k]), &(csx[k]), a0[k]/2.*dt_done2);
+            add_cs(&(x0[k]), &(csx[k]), v0[k]*dt_done);
+        }
+        {
+            add_cs(&(v0[k]), &(csv[k]), b.p6[k]/8.*dt_done);
+            add_cs(&(v0[k]), &(csv[k]), b.p5[k]/7.*dt_done);
+            add_cs(&(v0[k]), &(csv[k]), b.p4[k]/6.*dt_done);
+            add_cs(&(v0[k]), &(csv[k]), b.p3[k]/5.*dt_done);
+            add_cs(&(v0[k]), &(csv[k]), b.p2[k]/4.*dt_done);
+            add_cs(&(v0[k]), &(csv[k]), b.p1[k]/3.*dt_done);
+            add_cs(&(v0[k]), &(csv[k]), b.p0[k]/2.*dt_done);
+            add_cs(&(v0[k]), &(csv[k]), a0[k]*dt_done);
+        }
+    }
+
+}
+ 
+// Does the actual timestep.
+static int reb_integrator_ias15_step(struct reb_simulation* r) {
+    struct reb_particle* const particles = r->particles;
+    const int N = r->N;
+    const int N3 = 3*N;
+    reb_integrator_ias15_alloc(r,N3);
     
     // reb_update_acceleration(); // Not needed. Forces are already calculated in main routine.
     
@@ -192,6 +374,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
     const struct reb_dpconst7 csb= dpcast(r->ri_ias15.csb);
     const struct reb_dpconst7 er = dpcast(r->ri_ias15.er);
     const struct reb_dpconst7 br = dpcast(r->ri_ias15.br);
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N)
     for(int k=0;k<N;k++) {
         x0[3*k]   = particles[k].x;
         x0[3*k+1] = particles[k].y;
@@ -204,6 +387,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
         a0[3*k+2] = particles[k].az;
     }
     if (r->gravity==REB_GRAVITY_COMPENSATED){
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N)
         for(int k=0;k<N;k++) {
             csa0[3*k]   = gravity_cs[k].x;
             csa0[3*k+1] = gravity_cs[k].y;  
@@ -211,30 +395,14 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
         }
     }else{
         gravity_cs = (struct reb_vec3d*)csa0; // Always 0.
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N)
         for(int k=0;k<N3;k++) {
             csa0[k]   = 0;
         }
     }
-    for (int k=0;k<N3;k++){
-        // Memset might be faster!
-        csb.p0[k] = 0.;
-        csb.p1[k] = 0.;
-        csb.p2[k] = 0.;
-        csb.p3[k] = 0.;
-        csb.p4[k] = 0.;
-        csb.p5[k] = 0.;
-        csb.p6[k] = 0.;
-    }
+    clear_dp7(&(r->ri_ias15.csb),N3);
 
-    for(int k=0;k<N3;k++) {
-        g.p0[k] = b.p6[k]*d[15] + b.p5[k]*d[10] + b.p4[k]*d[6] + b.p3[k]*d[3]  + b.p2[k]*d[1]  + b.p1[k]*d[0]  + b.p0[k];
-        g.p1[k] = b.p6[k]*d[16] + b.p5[k]*d[11] + b.p4[k]*d[7] + b.p3[k]*d[4]  + b.p2[k]*d[2]  + b.p1[k];
-        g.p2[k] = b.p6[k]*d[17] + b.p5[k]*d[12] + b.p4[k]*d[8] + b.p3[k]*d[5]  + b.p2[k];
-        g.p3[k] = b.p6[k]*d[18] + b.p5[k]*d[13] + b.p4[k]*d[9] + b.p3[k];
-        g.p4[k] = b.p6[k]*d[19] + b.p5[k]*d[14] + b.p4[k];
-        g.p5[k] = b.p6[k]*d[20] + b.p5[k];
-        g.p6[k] = b.p6[k];
-    }
+    init_g(N3, g, b);
 
     double integrator_megno_thisdt = 0.;
     double integrator_megno_thisdt_init = 0.;
@@ -287,6 +455,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
             r->t = t_beginning + s[0];
 
             // Prepare particles arrays for force calculation
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N)
             for(int i=0;i<N;i++) {                      // Predict positions at interval n using b values
                 const int k0 = 3*i+0;
                 const int k1 = 3*i+1;
@@ -309,6 +478,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
                 s[6] = 6. * s[5] * h[n] / 7.;
                 s[7] = 7. * s[6] * h[n] / 8.;
 
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N)
                 for(int i=0;i<N;i++) {                  // Predict velocities at interval n using b values
                     const int k0 = 3*i+0;
                     const int k1 = 3*i+1;
@@ -329,96 +499,21 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
                 integrator_megno_thisdt += w[n] * r->t * reb_tools_megno_deltad_delta(r);
             }
 
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N)
             for(int k=0;k<N;++k) {
                 at[3*k]   = particles[k].ax;
                 at[3*k+1] = particles[k].ay;  
                 at[3*k+2] = particles[k].az;
             }
             switch (n) {                            // Improve b and g values
-                case 1: 
-                    for(int k=0;k<N3;++k) {
-                        double tmp = g.p0[k];
-                        double gk = at[k];
-                        double gk_cs = ((double*)(gravity_cs))[k];
-                        add_cs(&gk, &gk_cs, -a0[k]);
-                        add_cs(&gk, &gk_cs, csa0[k]);
-                        g.p0[k]  = gk/rr[0];
-                        add_cs(&(b.p0[k]), &(csb.p0[k]), g.p0[k]-tmp);
-                    } break;
-                case 2: 
-                    for(int k=0;k<N3;++k) {
-                        double tmp = g.p1[k];
-                        double gk = at[k];
-                        double gk_cs = ((double*)(gravity_cs))[k];
-                        add_cs(&gk, &gk_cs, -a0[k]);
-                        add_cs(&gk, &gk_cs, csa0[k]);
-                        g.p1[k] = (gk/rr[1] - g.p0[k])/rr[2];
-                        tmp = g.p1[k] - tmp;
-                        add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[0]);
-                        add_cs(&(b.p1[k]), &(csb.p1[k]), tmp);
-                    } break;
-                case 3: 
-                    for(int k=0;k<N3;++k) {
-                        double tmp = g.p2[k];
-                        double gk = at[k];
-                        double gk_cs = ((double*)(gravity_cs))[k];
-                        add_cs(&gk, &gk_cs, -a0[k]);
-                        add_cs(&gk, &gk_cs, csa0[k]);
-                        g.p2[k] = ((gk/rr[3] - g.p0[k])/rr[4] - g.p1[k])/rr[5];
-                        tmp = g.p2[k] - tmp;
-                        add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[1]);
-                        add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[2]);
-                        add_cs(&(b.p2[k]), &(csb.p2[k]), tmp);
-                    } break;
-                case 4:
-                    for(int k=0;k<N3;++k) {
-                        double tmp = g.p3[k];
-                        double gk = at[k];
-                        double gk_cs = ((double*)(gravity_cs))[k];
-                        add_cs(&gk, &gk_cs, -a0[k]);
-                        add_cs(&gk, &gk_cs, csa0[k]);
-                        g.p3[k] = (((gk/rr[6] - g.p0[k])/rr[7] - g.p1[k])/rr[8] - g.p2[k])/rr[9];
-                        tmp = g.p3[k] - tmp;
-                        add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[3]);
-                        add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[4]);
-                        add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[5]);
-                        add_cs(&(b.p3[k]), &(csb.p3[k]), tmp);
-                    } break;
-                case 5:
-                    for(int k=0;k<N3;++k) {
-                        double tmp = g.p4[k];
-                        double gk = at[k];
-                        double gk_cs = ((double*)(gravity_cs))[k];
-                        add_cs(&gk, &gk_cs, -a0[k]);
-                        add_cs(&gk, &gk_cs, csa0[k]);
-                        g.p4[k] = ((((gk/rr[10] - g.p0[k])/rr[11] - g.p1[k])/rr[12] - g.p2[k])/rr[13] - g.p3[k])/rr[14];
-                        tmp = g.p4[k] - tmp;
-                        add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[6]);
-                        add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[7]);
-                        add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[8]);
-                        add_cs(&(b.p3[k]), &(csb.p3[k]), tmp * c[9]);
-                        add_cs(&(b.p4[k]), &(csb.p4[k]), tmp);
-                    } break;
-                case 6:
-                    for(int k=0;k<N3;++k) {
-                        double tmp = g.p5[k];
-                        double gk = at[k];
-                        double gk_cs = ((double*)(gravity_cs))[k];
-                        add_cs(&gk, &gk_cs, -a0[k]);
-                        add_cs(&gk, &gk_cs, csa0[k]);
-                        g.p5[k] = (((((gk/rr[15] - g.p0[k])/rr[16] - g.p1[k])/rr[17] - g.p2[k])/rr[18] - g.p3[k])/rr[19] - g.p4[k])/rr[20];
-                        tmp = g.p5[k] - tmp;
-                        add_cs(&(b.p0[k]), &(csb.p0[k]), tmp * c[10]);
-                        add_cs(&(b.p1[k]), &(csb.p1[k]), tmp * c[11]);
-                        add_cs(&(b.p2[k]), &(csb.p2[k]), tmp * c[12]);
-                        add_cs(&(b.p3[k]), &(csb.p3[k]), tmp * c[13]);
-                        add_cs(&(b.p4[k]), &(csb.p4[k]), tmp * c[14]);
-                        add_cs(&(b.p5[k]), &(csb.p5[k]), tmp);
-                    } break;
+                case 1: case 2: case 3: case 4: case 5: case 6:
+                    correct_b(n, N3, at, (double*)gravity_cs, a0, csa0, g, b, csb);
+                    break;
                 case 7:
                 {
                     double maxak = 0.0;
                     double maxb6ktmp = 0.0;
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N) reduction(max:maxak,maxb6ktmp,predictor_corrector_error)
                     for(int k=0;k<N3;++k) {
                         double tmp = g.p6[k];
                         double gk = at[k];
@@ -481,6 +576,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
         if (r->ri_ias15.epsilon_global){
             double maxak = 0.0;
             double maxb6k = 0.0;
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N) reduction(max:maxak,maxb6k)
             for(int i=0;i<N;i++){ // Looping over all particles and all 3 components of the acceleration. 
                 const double v2 = particles[i].vx*particles[i].vx+particles[i].vy*particles[i].vy+particles[i].vz*particles[i].vz;
                 const double x2 = particles[i].x*particles[i].x+particles[i].y*particles[i].y+particles[i].z*particles[i].z;
@@ -499,6 +595,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
             }
             integrator_error = maxb6k/maxak;
         }else{
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N) reduction(max:integrator_error)
             for(int k=0;k<N3;k++) {
                 const double ak  = at[k];
                 const double b6k = b.p6[k]; 
@@ -521,6 +618,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
         
         if (fabs(dt_new/dt_done) < safety_factor) { // New timestep is significantly smaller.
             // Reset particles
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N)
             for(int k=0;k<N;++k) {
                 particles[k].x = x0[3*k+0]; // Set inital position
                 particles[k].y = x0[3*k+1];
@@ -545,30 +643,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
     }
 
     // Find new position and velocity values at end of the sequence
-    const double dt_done2 = dt_done * dt_done;
-    for(int k=0;k<N3;++k) {
-        {
-            add_cs(&(x0[k]), &(csx[k]), b.p6[k]/72.*dt_done2);
-            add_cs(&(x0[k]), &(csx[k]), b.p5[k]/56.*dt_done2);
-            add_cs(&(x0[k]), &(csx[k]), b.p4[k]/42.*dt_done2);
-            add_cs(&(x0[k]), &(csx[k]), b.p3[k]/30.*dt_done2);
-            add_cs(&(x0[k]), &(csx[k]), b.p2[k]/20.*dt_done2);
-            add_cs(&(x0[k]), &(csx[k]), b.p1[k]/12.*dt_done2);
-            add_cs(&(x0[k]), &(csx[k]), b.p0[k]/6.*dt_done2);
-            add_cs(&(x0[k]), &(csx[k]), a0[k]/2.*dt_done2);
-            add_cs(&(x0[k]), &(csx[k]), v0[k]*dt_done);
-        }
-        {
-            add_cs(&(v0[k]), &(csv[k]), b.p6[k]/8.*dt_done);
-            add_cs(&(v0[k]), &(csv[k]), b.p5[k]/7.*dt_done);
-            add_cs(&(v0[k]), &(csv[k]), b.p4[k]/6.*dt_done);
-            add_cs(&(v0[k]), &(csv[k]), b.p3[k]/5.*dt_done);
-            add_cs(&(v0[k]), &(csv[k]), b.p2[k]/4.*dt_done);
-            add_cs(&(v0[k]), &(csv[k]), b.p1[k]/3.*dt_done);
-            add_cs(&(v0[k]), &(csv[k]), b.p0[k]/2.*dt_done);
-            add_cs(&(v0[k]), &(csv[k]), a0[k]*dt_done);
-        }
-    }
+    advance_x0_v0(N3, dt_done, x0, csx, v0, csv, a0, b);
 
     r->t += dt_done;
     r->dt_last_done = dt_done;
@@ -579,6 +654,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
     }
 
     // Swap particle buffers
+#pragma omp parallel for schedule(static) if(N>REB_IAS15_OMP_MIN_N)
     for(int k=0;k<N;++k) {
         particles[k].x = x0[3*k+0]; // Set final position
         particles[k].y = x0[3*k+1];
@@ -588,8 +664,8 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
         particles[k].vy = v0[3*k+1];
         particles[k].vz = v0[3*k+2];
     }
-    copybuffers(e,er,N3);       
-    copybuffers(b,br,N3);       
+    copy_dp7(&(r->ri_ias15.e),&(r->ri_ias15.er),N3);       
+    copy_dp7(&(r->ri_ias15.b),&(r->ri_ias15.br),N3);       
     double ratio = r->dt/dt_done;
     predict_next_step(ratio, N3, e, b, e, b);
     return 1; // Success.
@@ -598,6 +674,7 @@ static int reb_integrator_ias15_step(struct reb_simulation* r) {
 static void predict_next_step(double ratio, int N3,  const struct reb_dpconst7 _e, const struct reb_dpconst7 _b, const struct reb_dpconst7 e, const struct reb_dpconst7 b){
     if (ratio>20.){
         // Do not predict if stepsize increase is very large. 
+#pragma omp parallel for schedule(static) if(N3>3*REB_IAS15_OMP_MIN_N)
         for(int k=0;k<N3;++k) {
             e.p0[k] = 0.; e.p1[k] = 0.; e.p2[k] = 0.; e.p3[k] = 0.; e.p4[k] = 0.; e.p5[k] = 0.; e.p6[k] = 0.;
             b.p0[k] = 0.; b.p1[k] = 0.; b.p2[k] = 0.; b.p3[k] = 0.; b.p4[k] = 0.; b.p5[k] = 0.; b.p6[k] = 0.;
@@ -615,6 +692,7 @@ static void predict_next_step(double ratio, int N3,  const struct reb_dpconst7 _
         const double q6 = q3 * q3;
         const double q7 = q3 * q4;
 
+#pragma omp parallel for schedule(static) if(N3>3*REB_IAS15_OMP_MIN_N)
         for(int k=0;k<N3;++k) {
             double be0 = _b.p0[k] - _e.p0[k];
             double be1 = _b.p1[k] - _e.p1[k];
@@ -644,20 +722,606 @@ static void predict_next_step(double ratio, int N3,  const struct reb_dpconst7 _
     }
 }
 
-static void copybuffers(const struct reb_dpconst7 _a, const struct reb_dpconst7 _b, int N3){
-    for (int i=0;i<N3;i++){ 
-        _b.p0[i] = _a.p0[i];
-        _b.p1[i] = _a.p1[i];
-        _b.p2[i] = _a.p2[i];
-        _b.p3[i] = _a.p3[i];
-        _b.p4[i] = _a.p4[i];
-        _b.p5[i] = _a.p5[i];
-        _b.p6[i] = _a.p6[i];
+/////////////////////////
+//   Block timesteps 
+//
+// The block of length dt is divided into 2^(block_levels-1) ticks. A particle on 
+// level l advances with steps of 2^(block_levels-1-l) ticks. Steps are processed
+// at the tick at which they end, finest level first. During a step on level l 
+// the particles on coarser levels are predicted using their own (predicted) b 
+// values. Particles on finer levels have already completed their steps and their
+// positions and velocities at the substeps of level l have been recorded.
+
+/**
+ * @brief Maximum number of block timestep levels.
+ */
+#define REB_IAS15_BLOCK_MAX_LEVELS 16
+
+// Returns a copy of the coefficients of one particle, starting at index k. 
+static struct reb_dpconst7 dpshift(struct reb_dp7 dp, const int k){
+    struct reb_dpconst7 dpc = {
+        .p0 = dp.p0+k, 
+        .p1 = dp.p1+k, 
+        .p2 = dp.p2+k, 
+        .p3 = dp.p3+k, 
+        .p4 = dp.p4+k, 
+        .p5 = dp.p5+k, 
+        .p6 = dp.p6+k, 
+    };
+    return dpc;
+}
+
+// Rescales the b and e coefficients of particle i from a timestep dt to q*dt.
+static void block_rescale(struct reb_simulation_integrator_ias15* const ri, const int i, const double q){
+    double* const b[7] = {ri->b.p0, ri->b.p1, ri->b.p2, ri->b.p3, ri->b.p4, ri->b.p5, ri->b.p6};
+    double* const e[7] = {ri->e.p0, ri->e.p1, ri->e.p2, ri->e.p3, ri->e.p4, ri->e.p5, ri->e.p6};
+    double qj = 1.;
+    for (int j=0;j<7;j++){
+        qj = (q>20.)?0.:qj*q;   // Do not predict if stepsize increase is very large. 
+        for (int k=3*i;k<3*i+3;k++){
+            b[j][k] *= qj;
+            e[j][k] *= qj;
+        }
+    }
+}
+
+// Position and velocity of particle i at the fraction hh of its current step of length dt.
+static void block_predict(const struct reb_simulation_integrator_ias15* const ri, const int i, const double hh, const double dt, double* const xv){
+    const struct reb_dp7 b = ri->b;
+    double s[9];
+    s[0] = dt * hh;
+    s[1] = s[0] * s[0] / 2.;
+    s[2] = s[1] * hh / 3.;
+    s[3] = s[2] * hh / 2.;
+    s[4] = 3. * s[3] * hh / 5.;
+    s[5] = 2. * s[4] * hh / 3.;
+    s[6] = 5. * s[5] * hh / 7.;
+    s[7] = 3. * s[6] * hh / 4.;
+    s[8] = 7. * s[7] * hh / 9.;
+    for (int c=0;c<3;c++){
+        const int k = 3*i+c;
+        const double xk = -ri->csx[k] + (s[8]*b.p6[k] + s[7]*b.p5[k] + s[6]*b.p4[k] + s[5]*b.p3[k] + s[4]*b.p2[k] + s[3]*b.p1[k] + s[2]*b.p0[k] + s[1]*ri->a0[k] + s[0]*ri->v0[k] );
+        xv[c] = xk + ri->x0[k];
     }
-// The above code seems faster than the code below, probably due to some compiler optimizations. 
-//  for (int i=0;i<7;i++){  
-//      memcpy(_b[i],_a[i], sizeof(double)*N3);
-//  }
+    s[0] = dt * hh;
+    s[1] =      s[0] * hh / 2.;
+    s[2] = 2. * s[1] * hh / 3.;
+    s[3] = 3. * s[2] * hh / 4.;
+    s[4] = 4. * s[3] * hh / 5.;
+    s[5] = 5. * s[4] * hh / 6.;
+    s[6] = 6. * s[5] * hh / 7.;
+    s[7] = 7. * s[6] * hh / 8.;
+    for (int c=0;c<3;c++){
+        const int k = 3*i+c;
+        const double vk = -ri->csv[k] + s[7]*b.p6[k] + s[6]*b.p5[k] + s[5]*b.p4[k] + s[4]*b.p3[k] + s[3]*b.p2[k] + s[2]*b.p1[k] + s[1]*b.p0[k] + s[0]*ri->a0[k];
+        xv[3+c] = vk + ri->v0[k];
+    }
+}
+
+static void block_set_particle(struct reb_particle* const p, const double* const xv){
+    p->x  = xv[0];
+    p->y  = xv[1];
+    p->z  = xv[2];
+    p->vx = xv[3];
+    p->vy = xv[4];
+    p->vz = xv[5];
+}
+
+// Calculates the accelerations of the listed particles only. Same as REB_GRAVITY_BASIC without ghost boxes.
+static void block_accelerations(struct reb_simulation* const r, const int* const active, const int Na){
+    struct reb_particle* const particles = r->particles;
+    const int N = r->N;
+    const double G = r->G;
+    const double softening2 = r->softening*r->softening;
+    const unsigned int _gravity_ignore_10 = r->gravity_ignore_10;
+    const int _N_active = (r->N_active==-1)?N:r->N_active;
+    const int _gravity = (r->gravity==REB_GRAVITY_BASIC);
+#pragma omp parallel for schedule(guided)
+    for (int a=0;a<Na;a++){
+        const int i = active[a];
+        double ax = 0.;
+        double ay = 0.;
+        double az = 0.;
+        if (_gravity){
+            // Test particles only act on massive particles if testparticle_type is set.
+            const int _N_source = (r->testparticle_type && i<_N_active)?N:_N_active;
+            for (int j=0;j<_N_source;j++){
+                if (_gravity_ignore_10 && ((j==1 && i==0) || (i==1 && j==0))) continue;
+                if (i==j) continue;
+                const double dx = particles[i].x - particles[j].x;
+                const double dy = particles[i].y - particles[j].y;
+                const double dz = particles[i].z - particles[j].z;
+                const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+                const double prefact = -G/(_r*_r*_r)*particles[j].m;
+                ax += prefact*dx;
+                ay += prefact*dy;
+                az += prefact*dz;
+            }
+        }
+        particles[i].ax = ax;
+        particles[i].ay = ay;
+        particles[i].az = az;
+    }
+    if (r->additional_forces) r->additional_forces(r);
+}
+
+// Advances the Na particles in active, all on level l, by one step starting at tick_start. 
+// Returns 0 if one of them requires a significantly smaller timestep.
+static int block_step(struct reb_simulation* r, const int l, const int tick_start, const int ticks_l, const int ticks, const double t_block, const double Delta, const int* const active, const int Na){
+    struct reb_simulation_integrator_ias15* const ri = &(r->ri_ias15);
+    struct reb_particle* const particles = r->particles;
+    const int N = r->N;
+    const int* const level = ri->block_level;
+    const double dt = Delta*ticks_l/ticks;
+    double* restrict const csx = ri->csx; 
+    double* restrict const csv = ri->csv; 
+    double* restrict const at = ri->at; 
+    double* restrict const x0 = ri->x0; 
+    double* restrict const v0 = ri->v0; 
+    double* restrict const a0 = ri->a0; 
+    const struct reb_dpconst7 g  = dpcast(ri->g);
+    const struct reb_dpconst7 b  = dpcast(ri->b);
+    const struct reb_dpconst7 csb= dpcast(ri->csb);
+    double* const gp[7]   = {g.p0, g.p1, g.p2, g.p3, g.p4, g.p5, g.p6};
+    double* const bp[7]   = {b.p0, b.p1, b.p2, b.p3, b.p4, b.p5, b.p6};
+    double* const csbp[7] = {csb.p0, csb.p1, csb.p2, csb.p3, csb.p4, csb.p5, csb.p6};
+
+    for (int a=0;a<Na;a++){
+        for (int k=3*active[a];k<3*active[a]+3;k++){
+            g.p0[k] = b.p6[k]*d[15] + b.p5[k]*d[10] + b.p4[k]*d[6] + b.p3[k]*d[3]  + b.p2[k]*d[1]  + b.p1[k]*d[0]  + b.p0[k];
+            g.p1[k] = b.p6[k]*d[16] + b.p5[k]*d[11] + b.p4[k]*d[7] + b.p3[k]*d[4]  + b.p2[k]*d[2]  + b.p1[k];
+            g.p2[k] = b.p6[k]*d[17] + b.p5[k]*d[12] + b.p4[k]*d[8] + b.p3[k]*d[5]  + b.p2[k];
+            g.p3[k] = b.p6[k]*d[18] + b.p5[k]*d[13] + b.p4[k]*d[9] + b.p3[k];
+            g.p4[k] = b.p6[k]*d[19] + b.p5[k]*d[14] + b.p4[k];
+            g.p5[k] = b.p6[k]*d[20] + b.p5[k];
+            g.p6[k] = b.p6[k];
+            for (int j=0;j<7;j++){
+                csbp[j][k] = 0.;
+            }
+        }
+    }
+
+    double predictor_corrector_error = 1e300;
+    double predictor_corrector_error_last = 2;
+    int iterations = 0; 
+    // Predictor corrector loop. Same stopping criteria as for a global timestep.
+    while(1){
+        if(predictor_corrector_error<1e-16){
+            break;
+        }
+        if(iterations > 2 && predictor_corrector_error_last <= predictor_corrector_error){
+            break;
+        }
+        if (iterations>=12){
+            ri->iterations_max_exceeded++;
+            const int integrator_iterations_warning = 10;
+            if (ri->iterations_max_exceeded==integrator_iterations_warning ){
+                reb_warning("At least 10 predictor corrector loops in IAS15 did not converge. This is typically an indication of the timestep being too large.");
+            }
+            break;                              // Quit predictor corrector loop
+        }
+        predictor_corrector_error_last = predictor_corrector_error;
+        predictor_corrector_error = 0;
+        iterations++;
+
+        for(int n=1;n<8;n++) {                          // Loop over interval using Gauss-Radau spacings
+            const double tau = tick_start + h[n]*ticks_l;
+            r->t = t_block + tau/ticks*Delta;
+
+            // Prepare particles arrays for force calculation
+#pragma omp parallel for schedule(guided)
+            for (int j=0;j<N;j++){
+                double xv[6];
+                if (level[j]==l){                       // Active, predict using own b values
+                    block_predict(ri, j, h[n], dt, xv);
+                    block_set_particle(&particles[j], xv);
+                }else if (level[j]<l){                  // Coarser level, predict using own b values
+                    const int ticks_c = ticks>>level[j];
+                    const double tick_start_c = floor(tau/ticks_c)*ticks_c;
+                    block_predict(ri, j, (tau-tick_start_c)/ticks_c, Delta*ticks_c/ticks, xv);
+                    block_set_particle(&particles[j], xv);
+                }else{                                  // Finer level, already recorded
+                    const double* const rec = ri->block_rec + (((size_t)l*7+(n-1))*N+j)*6;
+                    block_set_particle(&particles[j], rec);
+                }
+            }
+
+            block_accelerations(r, active, Na);         // Calculate forces at interval n
+
+            const int ro = n*(n-1)/2;                   // Offset in rr
+            const int co = (n-1)*(n-2)/2;               // Offset in c
+            double maxak = 0.0;
+            double maxb6ktmp = 0.0;
+            for (int a=0;a<Na;a++){                     // Improve b and g values
+                const int i = active[a];
+                at[3*i]   = particles[i].ax;
+                at[3*i+1] = particles[i].ay;  
+                at[3*i+2] = particles[i].az;
+                for (int k=3*i;k<3*i+3;k++){
+                    double tmp = gp[n-1][k];
+                    double gk = at[k];
+                    double gk_cs = 0.;
+                    add_cs(&gk, &gk_cs, -a0[k]);
+                    double gn = gk/rr[ro];
+                    for (int j=0;j<n-1;j++){
+                        gn = (gn - gp[j][k])/rr[ro+j+1];
+                    }
+                    gp[n-1][k] = gn;
+                    tmp = gn - tmp;
+                    for (int j=0;j<n-1;j++){
+                        add_cs(&(bp[j][k]), &(csbp[j][k]), tmp * c[co+j]);
+                    }
+                    add_cs(&(bp[n-1][k]), &(csbp[n-1][k]), tmp);
+                    if (n==7){
+                        // Monitor change in b.p6[k] relative to at[k]. 
+                        if (ri->epsilon_global){
+                            const double ak  = fabs(at[k]);
+                            if (isnormal(ak) && ak>maxak){
+                                maxak = ak;
+                            }
+                            const double b6ktmp = fabs(tmp);
+                            if (isnormal(b6ktmp) && b6ktmp>maxb6ktmp){
+                                maxb6ktmp = b6ktmp;
+                            }
+                        }else{
+                            const double errork = fabs(tmp/at[k]);
+                            if (isnormal(errork) && errork>predictor_corrector_error){
+                                predictor_corrector_error = errork;
+                            }
+                        }
+                    }
+                }
+            }
+            if (n==7 && ri->epsilon_global){
+                predictor_corrector_error = maxb6ktmp/maxak;
+            }
+        }
+    }
+
+    // Error estimate for each particle individually
+    int reject = 0;
+    for (int a=0;a<Na;a++){
+        const int i = active[a];
+        double integrator_error = 0.0;
+        if (ri->epsilon_global){
+            double maxak = 0.0;
+            double maxb6k = 0.0;
+            for (int k=3*i;k<3*i+3;k++){
+                const double ak  = fabs(at[k]);
+                if (isnormal(ak) && ak>maxak){
+                    maxak = ak;
+                }
+                const double b6k = fabs(b.p6[k]); 
+                if (isnormal(b6k) && b6k>maxb6k){
+                    maxb6k = b6k;
+                }
+            }
+            integrator_error = maxb6k/maxak;
+        }else{
+            for (int k=3*i;k<3*i+3;k++){
+                const double errork = fabs(b.p6[k]/at[k]);
+                if (isnormal(errork) && errork>integrator_error){
+                    integrator_error = errork;
+                }
+            }
+        }
+        double dt_new;
+        if  (isnormal(integrator_error)){   
+            dt_new = pow(ri->epsilon/integrator_error,1./7.)*dt;
+        }else{
+            dt_new = dt/safety_factor;
+        }
+        if (fabs(dt_new)<ri->min_dt) dt_new = copysign(ri->min_dt,dt_new);
+        ri->block_dt[i] = dt_new;
+        if (fabs(dt_new/dt) < safety_factor){   // New timestep is significantly smaller.
+            reject = 1;
+        }
+    }
+    if (reject){
+        return 0;
+    }
+
+    // Record positions and velocities at the substeps of coarser levels which fall into this step
+    for (int lc=0;lc<l;lc++){
+        const int ticks_c = ticks>>lc;
+        const int tick_start_c = (tick_start/ticks_c)*ticks_c;
+        for (int n=1;n<8;n++){
+            const double tau = tick_start_c + h[n]*ticks_c;
+            if (tau<tick_start || tau>=tick_start+ticks_l) continue;
+            double* const rec = ri->block_rec + ((size_t)lc*7+(n-1))*N*6;
+            for (int a=0;a<Na;a++){
+                const int i = active[a];
+                block_predict(ri, i, (tau-tick_start)/ticks_l, dt, rec+6*i);
+            }
+        }
+    }
+
+    // Find new position and velocity values at end of the step
+    const double dt2 = dt * dt;
+    for (int a=0;a<Na;a++){
+        for (int k=3*active[a];k<3*active[a]+3;k++){
+            add_cs(&(x0[k]), &(csx[k]), b.p6[k]/72.*dt2);
+            add_cs(&(x0[k]), &(csx[k]), b.p5[k]/56.*dt2);
+            add_cs(&(x0[k]), &(csx[k]), b.p4[k]/42.*dt2);
+            add_cs(&(x0[k]), &(csx[k]), b.p3[k]/30.*dt2);
+            add_cs(&(x0[k]), &(csx[k]), b.p2[k]/20.*dt2);
+            add_cs(&(x0[k]), &(csx[k]), b.p1[k]/12.*dt2);
+            add_cs(&(x0[k]), &(csx[k]), b.p0[k]/6.*dt2);
+            add_cs(&(x0[k]), &(csx[k]), a0[k]/2.*dt2);
+            add_cs(&(x0[k]), &(csx[k]), v0[k]*dt);
+            add_cs(&(v0[k]), &(csv[k]), b.p6[k]/8.*dt);
+            add_cs(&(v0[k]), &(csv[k]), b.p5[k]/7.*dt);
+            add_cs(&(v0[k]), &(csv[k]), b.p4[k]/6.*dt);
+            add_cs(&(v0[k]), &(csv[k]), b.p3[k]/5.*dt);
+            add_cs(&(v0[k]), &(csv[k]), b.p2[k]/4.*dt);
+            add_cs(&(v0[k]), &(csv[k]), b.p1[k]/3.*dt);
+            add_cs(&(v0[k]), &(csv[k]), b.p0[k]/2.*dt);
+            add_cs(&(v0[k]), &(csv[k]), a0[k]*dt);
+        }
+    }
+
+    // Choose the level of the next step. Particles can move to any finer level, 
+    // but only one level up and only if the next step remains aligned with the blocks.
+    const int tick_end = tick_start + ticks_l;
+    for (int a=0;a<Na;a++){
+        const int i = active[a];
+        int l_want = 0;
+        while ((ticks>>l_want)>1 && fabs(Delta*(ticks>>l_want)/ticks)>fabs(ri->block_dt[i])){
+            l_want++;
+        }
+        int l_next = l;
+        if (tick_end<ticks){                    // At the end of the block levels get reassigned.
+            if (l_want>l){
+                l_next = l_want;
+            }else if (l_want<l && tick_end%(ticks>>(l-1))==0){
+                l_next = l-1;
+            }
+        }
+        ri->block_level_next[i] = l_next;
+        const double ratio = (double)(ticks>>l_next)/(double)ticks_l;
+        const struct reb_dpconst7 ei = dpshift(ri->e,3*i);
+        const struct reb_dpconst7 bi = dpshift(ri->b,3*i);
+        predict_next_step(ratio, 3, ei, bi, ei, bi);
+    }
+    return 1;
+}
+
+// Advances all particles by one block of length Delta. Returns 0 if the block needs to be rejected.
+static int block_try(struct reb_simulation* r, const int L, const double Delta, const double t_block){
+    struct reb_simulation_integrator_ias15* const ri = &(r->ri_ias15);
+    struct reb_particle* const particles = r->particles;
+    const int N = r->N;
+    const int ticks = 1<<(L-1);
+    int* const level = ri->block_level;
+    int* const active = ri->block_active;
+    for (int i=0;i<N;i++){
+        ri->x0[3*i]   = particles[i].x;
+        ri->x0[3*i+1] = particles[i].y;
+        ri->x0[3*i+2] = particles[i].z;
+        ri->v0[3*i]   = particles[i].vx;
+        ri->v0[3*i+1] = particles[i].vy;
+        ri->v0[3*i+2] = particles[i].vz;
+        ri->a0[3*i]   = particles[i].ax;
+        ri->a0[3*i+1] = particles[i].ay; 
+        ri->a0[3*i+2] = particles[i].az;
+    }
+
+    for (int tick=1;tick<=ticks;tick++){
+        // Find the levels whose steps end at this tick and their active particles
+        int Na_level[REB_IAS15_BLOCK_MAX_LEVELS];
+        int start_level[REB_IAS15_BLOCK_MAX_LEVELS];
+        int Na = 0;
+        int lmin = L;
+        for (int l=L-1;l>=0 && tick%(ticks>>l)==0;l--){
+            lmin = l;
+            start_level[l] = Na;
+            for (int i=0;i<N;i++){
+                if (level[i]==l){
+                    active[Na++] = i;
+                }
+            }
+            Na_level[l] = Na - start_level[l];
+        }
+        for (int l=L-1;l>=lmin;l--){
+            if (Na_level[l]==0) continue;
+            const int ticks_l = ticks>>l;
+            if (!block_step(r, l, tick-ticks_l, ticks_l, ticks, t_block, Delta, active+start_level[l], Na_level[l])){
+                return 0;
+            }
+        }
+        for (int a=0;a<Na;a++){
+            level[active[a]] = ri->block_level_next[active[a]];
+        }
+        if (tick<ticks && Na){
+            // Accelerations at the beginning of the next step of all particles which just completed a step.
+            r->t = t_block + (double)tick/ticks*Delta;
+            for (int j=0;j<N;j++){
+                double xv[6];
+                const int ticks_c = ticks>>level[j];
+                if (tick%ticks_c){                  // In the middle of a step
+                    const double tick_start_c = (tick/ticks_c)*ticks_c;
+                    block_predict(ri, j, (tick-tick_start_c)/ticks_c, Delta*ticks_c/ticks, xv);
+                    block_set_particle(&particles[j], xv);
+                }
+            }
+            for (int a=0;a<Na;a++){
+                const int i = active[a];
+                particles[i].x  = ri->x0[3*i];
+                particles[i].y  = ri->x0[3*i+1];
+                particles[i].z  = ri->x0[3*i+2];
+                particles[i].vx = ri->v0[3*i];
+                particles[i].vy = ri->v0[3*i+1];
+                particles[i].vz = ri->v0[3*i+2];
+            }
+            block_accelerations(r, active, Na);
+            for (int a=0;a<Na;a++){
+                const int i = active[a];
+                ri->a0[3*i]   = particles[i].ax;
+                ri->a0[3*i+1] = particles[i].ay;
+                ri->a0[3*i+2] = particles[i].az;
+            }
+        }
+    }
+    
+    for (int i=0;i<N;i++){
+        particles[i].x  = ri->x0[3*i];
+        particles[i].y  = ri->x0[3*i+1];
+        particles[i].z  = ri->x0[3*i+2];
+        particles[i].vx = ri->v0[3*i];
+        particles[i].vy = ri->v0[3*i+1];
+        particles[i].vz = ri->v0[3*i+2];
+    }
+    return 1;
+}
+
+// Assigns levels for a block of length Delta and rescales the b and e values. 
+// Before the call, these are scaled for a block of length Delta_b and the levels stored in block_save.
+static void block_assign_levels(struct reb_simulation* r, const int L, const double Delta, const double Delta_b){
+    struct reb_simulation_integrator_ias15* const ri = &(r->ri_ias15);
+    const int N = r->N;
+    for (int i=0;i<N;i++){
+        int l = 0;
+        if (ri->block_dt[i]!=0.){
+            while (l<L-1 && fabs(Delta/(double)(1<<l))>fabs(ri->block_dt[i])){
+                l++;
+            }
+        }
+        ri->block_level[i] = l;
+        const int l_b = (int)ri->block_save[16*i+15];
+        const double q = (Delta/(double)(1<<l)) / (Delta_b/(double)(1<<l_b));
+        if (q!=1.){
+            block_rescale(ri, i, q);
+        }
+    }
+}
+
+// Length of the block which accommodates the timesteps requested by all particles.
+static double block_length(struct reb_simulation* r, const int L, const double Delta){
+    struct reb_simulation_integrator_ias15* const ri = &(r->ri_ias15);
+    const int N = r->N;
+    double dt_min = INFINITY;
+    double dt_max = 0.;
+    for (int i=0;i<N;i++){
+        const double dt = fabs(ri->block_dt[i]);
+        if (dt==0.) continue;
+        if (dt<dt_min) dt_min = dt;
+        if (dt>dt_max) dt_max = dt;
+    }
+    if (dt_max==0.){
+        return Delta;
+    }
+    double Delta_new = dt_max;
+    if (Delta_new>dt_min*(1<<(L-1))) Delta_new = dt_min*(1<<(L-1));
+    if (Delta_new>fabs(Delta)/safety_factor) Delta_new = fabs(Delta)/safety_factor;
+    if (Delta_new<ri->min_dt) Delta_new = ri->min_dt;
+    return copysign(Delta_new,Delta);
+}
+
+// Returns 1 if the simulation can be integrated with block timesteps. 
+static int block_supported(struct reb_simulation* r){
+    if (r->gravity!=REB_GRAVITY_BASIC && r->gravity!=REB_GRAVITY_NONE) return 0;
+    if (r->nghostx || r->nghosty || r->nghostz) return 0;
+    if (r->N_var || r->calculate_megno) return 0;
+    if (r->collision==REB_COLLISION_SOFTSPHERE) return 0;
+    return 1;
+}
+
+void reb_integrator_ias15_block_alloc(struct reb_simulation* r, const int N){
+    struct reb_simulation_integrator_ias15* const ri = &(r->ri_ias15);
+    if (N == ri->block_allocatedN){
+        return;
+    }
+    ri->block_level      = realloc(ri->block_level,sizeof(int)*N);
+    ri->block_level_next = realloc(ri->block_level_next,sizeof(int)*N);
+    ri->block_active     = realloc(ri->block_active,sizeof(int)*N);
+    ri->block_dt         = realloc(ri->block_dt,sizeof(double)*N);
+    ri->block_save       = realloc(ri->block_save,sizeof(double)*16*N);
+    // Levels and timesteps belong to particles which might have been removed or reordered.
+    for (int i=0;i<N;i++){
+        ri->block_level[i] = 0;
+        ri->block_dt[i] = 0.;
+    }
+    ri->block_allocatedN = N;
+}
+
+// One block with hierarchical timesteps. 
+static void reb_integrator_ias15_block(struct reb_simulation* r){
+    struct reb_simulation_integrator_ias15* const ri = &(r->ri_ias15);
+    struct reb_particle* const particles = r->particles;
+    const int N = r->N;
+    const int N3 = 3*N;
+    const int L = ri->block_levels>REB_IAS15_BLOCK_MAX_LEVELS?REB_IAS15_BLOCK_MAX_LEVELS:ri->block_levels;
+    reb_integrator_ias15_alloc(r,N3);
+    reb_integrator_ias15_block_alloc(r,N);
+    if ((size_t)(L-1)*42*N > (size_t)ri->block_rec_allocatedN){
+        ri->block_rec_allocatedN = (L-1)*42*N;
+        ri->block_rec = realloc(ri->block_rec,sizeof(double)*ri->block_rec_allocatedN);
+    }
+    if (r->dt_last_done==0.){
+        // No timestep information available yet.
+        for (int i=0;i<N;i++){
+            ri->block_level[i] = 0;
+            ri->block_dt[i] = 0.;
+        }
+    }
+
+    // Save the state at the beginning of the block 
+    double* const save = ri->block_save;
+    for (int i=0;i<N;i++){
+        double* const si = save+16*i;
+        si[0]  = particles[i].x;
+        si[1]  = particles[i].y;
+        si[2]  = particles[i].z;
+        si[3]  = particles[i].vx;
+        si[4]  = particles[i].vy;
+        si[5]  = particles[i].vz;
+        si[6]  = particles[i].ax;
+        si[7]  = particles[i].ay;
+        si[8]  = particles[i].az;
+        for (int c=0;c<3;c++){
+            si[9+c]  = ri->csx[3*i+c];
+            si[12+c] = ri->csv[3*i+c];
+        }
+        si[15] = ri->block_level[i];
+    }
+    copy_dp7(&(ri->e),&(ri->er),N3);       
+    copy_dp7(&(ri->b),&(ri->br),N3);       
+    
+    const double t_block = r->t;
+    const double Delta_b = (r->dt_last_done!=0.)?r->dt_last_done:r->dt;
+    double Delta = r->dt;
+    while(1){
+        block_assign_levels(r, L, Delta, Delta_b);
+        if (block_try(r, L, Delta, t_block)){
+            break;
+        }
+        // Block rejected. Reset particles and try again with updated timesteps.
+        for (int i=0;i<N;i++){
+            const double* const si = save+16*i;
+            particles[i].x  = si[0];
+            particles[i].y  = si[1];
+            particles[i].z  = si[2];
+            particles[i].vx = si[3];
+            particles[i].vy = si[4];
+            particles[i].vz = si[5];
+            particles[i].ax = si[6];
+            particles[i].ay = si[7];
+            particles[i].az = si[8];
+            for (int c=0;c<3;c++){
+                ri->csx[3*i+c] = si[9+c];
+                ri->csv[3*i+c] = si[12+c];
+            }
+        }
+        copy_dp7(&(ri->er),&(ri->e),N3);       
+        copy_dp7(&(ri->br),&(ri->b),N3);       
+        const double Delta_new = block_length(r, L, Delta);
+        Delta = fabs(Delta_new)<fabs(Delta)?Delta_new:Delta;
+    }
+    r->t = t_block + Delta;
+    r->dt_last_done = Delta;
+    r->dt = block_length(r, L, Delta);
+    // b and e are now scaled for the levels at the end of the block. 
+    // They get rescaled when the levels are assigned for the next block.
 }
 
 // Do nothing here. This is only used in a leapfrog-like DKD integrator. IAS15 performs one complete timestep.
@@ -668,6 +1332,22 @@ void reb_integrator_ias15_part2(struct reb_simulation* r){
 #ifdef GENERATE_CONSTANTS
     integrator_generate_constants();
 #endif  // GENERATE_CONSTANTS
+    if (r->ri_ias15.block_levels>1 && r->ri_ias15.epsilon>0){
+        if (block_supported(r)){
+            reb_integrator_ias15_block(r);
+            return;
+        }
+        // Use a global timestep for this step only, block_levels is left unchanged.
+        r->ri_ias15.block_unsupported++;
+        if (r->ri_ias15.block_unsupported==1){
+            reb_warning("Block timesteps in IAS15 require REB_GRAVITY_BASIC or REB_GRAVITY_NONE without ghost boxes, variational particles, MEGNO or soft-sphere collisions. Using a global timestep.");
+        }
+        // All particles are on level 0, as expected by the next block.
+        for (int i=0;i<r->ri_ias15.block_allocatedN;i++){
+            r->ri_ias15.block_level[i] = 0;
+            r->ri_ias15.block_dt[i] = 0.;
+        }
+    }
     // Try until a step was successful.
     while(!reb_integrator_ias15_step(r));
 }
@@ -692,10 +1372,88 @@ void reb_integrator_ias15_clear(struct reb_simulation* r){
             csv[i] = 0;
         }
     }
+    for (int i=0;i<r->ri_ias15.block_allocatedN;i++){
+        r->ri_ias15.block_level[i] = 0;
+        r->ri_ias15.block_dt[i] = 0.;
+    }
+}
+
+// Collects the arrays of IAS15 that carry information from one timestep to the next.
+static void reb_integrator_ias15_state_arrays(struct reb_simulation_integrator_ias15* const ri, double** const arrays){
+    const struct reb_dp7* const dp7s[6] = {&(ri->g), &(ri->b), &(ri->csb), &(ri->e), &(ri->br), &(ri->er)};
+    for (int j=0;j<6;j++){
+        arrays[7*j+0] = dp7s[j]->p0;
+        arrays[7*j+1] = dp7s[j]->p1;
+        arrays[7*j+2] = dp7s[j]->p2;
+        arrays[7*j+3] = dp7s[j]->p3;
+        arrays[7*j+4] = dp7s[j]->p4;
+        arrays[7*j+5] = dp7s[j]->p5;
+        arrays[7*j+6] = dp7s[j]->p6;
+    }
+    arrays[42] = ri->csx;
+    arrays[43] = ri->csv;
+}
+
+void reb_integrator_ias15_permute(struct reb_simulation* r, const int* const index_old, const int N){
+    struct reb_simulation_integrator_ias15* const ri = &(r->ri_ias15);
+    const int N3_old = ri->allocatedN;
+    const int N3 = 3*N;
+    double* arrays[44];
+    double* old = NULL;
+    if (N3_old){
+        old = malloc(sizeof(double)*44*N3_old);
+        reb_integrator_ias15_state_arrays(ri, arrays);
+        for (int a=0;a<44;a++){
+            memcpy(old+a*N3_old, arrays[a], sizeof(double)*N3_old);
+        }
+    }
+    // May reallocate and clear all arrays.
+    reb_integrator_ias15_alloc(r,N3);
+    reb_integrator_ias15_state_arrays(ri, arrays);
+    for (int k=0;k<N;k++){
+        const int i = index_old[k];
+        const int valid = i>=0 && 3*i<N3_old;
+        for (int a=0;a<44;a++){
+            for (int d=0;d<3;d++){
+                arrays[a][3*k+d] = valid?old[a*N3_old+3*i+d]:0.;
+            }
+        }
+    }
+    free(old);
+    const int N_block_old = ri->block_allocatedN;
+    if (N_block_old){
+        int* level_old = malloc(sizeof(int)*N_block_old);
+        double* dt_old = malloc(sizeof(double)*N_block_old);
+        memcpy(level_old, ri->block_level, sizeof(int)*N_block_old);
+        memcpy(dt_old, ri->block_dt, sizeof(double)*N_block_old);
+        reb_integrator_ias15_block_alloc(r,N);
+        for (int k=0;k<N;k++){
+            const int i = index_old[k];
+            const int valid = i>=0 && i<N_block_old;
+            ri->block_level[k] = valid?level_old[i]:0;
+            ri->block_dt[k] = valid?dt_old[i]:0.;
+        }
+        free(level_old);
+        free(dt_old);
+    }
 }
 
 void reb_integrator_ias15_reset(struct reb_simulation* r){
     r->ri_ias15.allocatedN  = 0;
+    r->ri_ias15.block_allocatedN = 0;
+    free(r->ri_ias15.block_level);
+    r->ri_ias15.block_level = NULL;
+    free(r->ri_ias15.block_level_next);
+    r->ri_ias15.block_level_next = NULL;
+    free(r->ri_ias15.block_active);
+    r->ri_ias15.block_active = NULL;
+    free(r->ri_ias15.block_dt);
+    r->ri_ias15.block_dt = NULL;
+    free(r->ri_ias15.block_save);
+    r->ri_ias15.block_save = NULL;
+    r->ri_ias15.block_rec_allocatedN = 0;
+    free(r->ri_ias15.block_rec);
+    r->ri_ias15.block_rec = NULL;
     free_dp7(&(r->ri_ias15.g));
     free_dp7(&(r->ri_ias15.e));
     free_dp7(&(r->ri_ias15.b));
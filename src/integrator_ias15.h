@@ -29,4 +29,23 @@ void reb_integrator_ias15_part2(struct reb_simulation* r);              ///< Int
 void reb_integrator_ias15_synchronize(struct reb_simulation* r);        ///< Internal function used to call a specific integrator
 void reb_integrator_ias15_reset(struct reb_simulation* r);              ///< Internal function used to call a specific integrator
 void reb_integrator_ias15_clear(struct reb_simulation* r);              ///< Internal function used to call a specific integrator
+
+/**
+ * @brief Reorders the internal state of IAS15 after particles have been added, removed or reordered.
+ * @details index_old[k] is the index that the k-th of the N particles had before. 
+ * If it is -1, the particle is new and its predictors are set to zero. 
+ */
+void reb_integrator_ias15_permute(struct reb_simulation* r, const int* const index_old, const int N);
+
+/**
+ * @brief Allocates the per particle arrays of the block timestepping for N particles.
+ * @details Levels and timesteps are indexed by particle. If N changes, they are reset and rebuilt in the next step.
+ */
+void reb_integrator_ias15_block_alloc(struct reb_simulation* r, const int N);
+
+/**
+ * @brief Allocates the seven arrays of a reb_dp7 for N3 values each and sets them to zero.
+ * @details The arrays are stored in a single 64 byte aligned block. Only p0 needs to be freed.
+ */
+void reb_integrator_ias15_alloc_dp7(struct reb_dp7* const dp7, const int N3);
 #endif
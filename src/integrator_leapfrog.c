@@ -33,42 +33,135 @@
 #include <math.h>
 #include <time.h>
 #include "rebound.h"
+#include "gravity.h"
+#include "integrator.h"
+#include "integrator_leapfrog.h"
+
+#define MIN(a, b) ((a) > (b) ? (b) : (a))    ///< Returns the minimum of a and b
 
 // Leapfrog integrator (Drift-Kick-Drift)
 // for non-rotating frame.
+// Higher order splittings perform additional kicks and force evaluations in part2.
+static int reb_integrator_leapfrog_coefficients(struct reb_simulation* r, double* const c, double* const d){
+	if (r->ri_leapfrog.splitting!=REB_SPLITTING_LEAPFROG && (r->gravity==REB_GRAVITY_TREE || r->collision==REB_COLLISION_TREE)){
+		reb_warning("Higher order splittings are not supported with tree gravity or tree collisions. Using second order leapfrog.");
+		r->ri_leapfrog.splitting = REB_SPLITTING_LEAPFROG;
+	}
+	return reb_integrator_splitting_coefficients(r->ri_leapfrog.splitting, c, d);
+}
+
 void reb_integrator_leapfrog_part1(struct reb_simulation* r){
 	const int N = r->N;
 	struct reb_particle* restrict const particles = r->particles;
 	const double dt = r->dt;
+	double c[REB_SPLITTING_MAX_KICKS+1];
+	double d[REB_SPLITTING_MAX_KICKS];
+	reb_integrator_leapfrog_coefficients(r, c, d);
+	const double c0dt = c[0]*dt;
 #pragma omp parallel for schedule(guided)
 	for (int i=0;i<N;i++){
-		particles[i].x  += 0.5* dt * particles[i].vx;
-		particles[i].y  += 0.5* dt * particles[i].vy;
-		particles[i].z  += 0.5* dt * particles[i].vz;
+		particles[i].x  += c0dt * particles[i].vx;
+		particles[i].y  += c0dt * particles[i].vy;
+		particles[i].z  += c0dt * particles[i].vz;
 	}
-	r->t+=dt/2.;
+	// The first force evaluation happens at the time of the first stage.
+	r->t+=c0dt;
 }
 void reb_integrator_leapfrog_part2(struct reb_simulation* r){
 	const int N = r->N;
 	struct reb_particle* restrict const particles = r->particles;
 	const double dt = r->dt;
+	double c[REB_SPLITTING_MAX_KICKS+1];
+	double d[REB_SPLITTING_MAX_KICKS];
+	const int n = reb_integrator_leapfrog_coefficients(r, c, d);
+	const double t_first = r->t;
+	double t_stage = 0.;
+	for (int k=0;k<n;k++){
+		if (k>0){
+			// Forces at the intermediate stage. Time is set for time dependent forces.
+			r->t = t_first + t_stage*dt;
+			reb_update_acceleration(r);
+		}
+		const double ddt = d[k]*dt;
+		const double cdt = c[k+1]*dt;
 #pragma omp parallel for schedule(guided)
-	for (int i=0;i<N;i++){
-		particles[i].vx += dt * particles[i].ax;
-		particles[i].vy += dt * particles[i].ay;
-		particles[i].vz += dt * particles[i].az;
-		particles[i].x  += 0.5* dt * particles[i].vx;
-		particles[i].y  += 0.5* dt * particles[i].vy;
-		particles[i].z  += 0.5* dt * particles[i].vz;
+		for (int i=0;i<N;i++){
+			particles[i].vx += ddt * particles[i].ax;
+			particles[i].vy += ddt * particles[i].ay;
+			particles[i].vz += ddt * particles[i].az;
+			particles[i].x  += cdt * particles[i].vx;
+			particles[i].y  += cdt * particles[i].vy;
+			particles[i].z  += cdt * particles[i].vz;
+		}
+		t_stage += c[k+1];
 	}
-	r->t+=dt/2.;
+	r->t = t_first+(1.-c[0])*dt;
 	r->dt_last_done = r->dt;
 }
 	
+void reb_integrator_leapfrog_fused_step(struct reb_simulation* r, const int N_sources){
+	const int N = r->N;
+	struct reb_particle* restrict const particles = r->particles;
+	const double dt = r->dt;
+	const int gravity = r->gravity==REB_GRAVITY_BASIC;
+	double c[REB_SPLITTING_MAX_KICKS+1];
+	double d[REB_SPLITTING_MAX_KICKS];
+	reb_integrator_leapfrog_coefficients(r, c, d);
+	const double c0dt = c[0]*dt;
+	const double ddt = d[0]*dt;
+	const double c1dt = c[1]*dt;
+	// Sources of gravity are drifted before any force is calculated.
+#pragma omp parallel for schedule(guided)
+	for (int i=0;i<N_sources;i++){
+		particles[i].x  += c0dt * particles[i].vx;
+		particles[i].y  += c0dt * particles[i].vy;
+		particles[i].z  += c0dt * particles[i].vz;
+	}
+	if (gravity){
+#pragma omp parallel for schedule(guided)
+		for (int i0=0;i0<N_sources;i0+=REB_INTEGRATOR_FUSED_TILE){
+			reb_calculate_acceleration_range(r, i0, MIN(i0+REB_INTEGRATOR_FUSED_TILE, N_sources));
+		}
+	}
+	// All other particles: drift, force calculation, kick and drift while the tile is in cache.
+#pragma omp parallel for schedule(guided)
+	for (int i0=N_sources;i0<N;i0+=REB_INTEGRATOR_FUSED_TILE){
+		const int i1 = MIN(i0+REB_INTEGRATOR_FUSED_TILE, N);
+		for (int i=i0;i<i1;i++){
+			particles[i].x  += c0dt * particles[i].vx;
+			particles[i].y  += c0dt * particles[i].vy;
+			particles[i].z  += c0dt * particles[i].vz;
+		}
+		if (gravity){
+			reb_calculate_acceleration_range(r, i0, i1);
+		}
+		for (int i=i0;i<i1;i++){
+			particles[i].vx += ddt * particles[i].ax;
+			particles[i].vy += ddt * particles[i].ay;
+			particles[i].vz += ddt * particles[i].az;
+			particles[i].x  += c1dt * particles[i].vx;
+			particles[i].y  += c1dt * particles[i].vy;
+			particles[i].z  += c1dt * particles[i].vz;
+		}
+	}
+#pragma omp parallel for schedule(guided)
+	for (int i=0;i<N_sources;i++){
+		particles[i].vx += ddt * particles[i].ax;
+		particles[i].vy += ddt * particles[i].ay;
+		particles[i].vz += ddt * particles[i].az;
+		particles[i].x  += c1dt * particles[i].vx;
+		particles[i].y  += c1dt * particles[i].vy;
+		particles[i].z  += c1dt * particles[i].vz;
+	}
+	r->t+=dt/2.;
+	r->t+=dt/2.;
+	r->dt_last_done = r->dt;
+}
+
 void reb_integrator_leapfrog_synchronize(struct reb_simulation* r){
 	// Do nothing.
 }
 
 void reb_integrator_leapfrog_reset(struct reb_simulation* r){
-	// Do nothing.
+	r->ri_leapfrog.splitting = REB_SPLITTING_LEAPFROG;
 }
@@ -28,4 +28,5 @@ void reb_integrator_leapfrog_part1(struct reb_simulation* r);          ///< Inte
 void reb_integrator_leapfrog_part2(struct reb_simulation* r);          ///< Internal function used to call a specific integrator
 void reb_integrator_leapfrog_synchronize(struct reb_simulation* r);    ///< Internal function used to call a specific integrator
 void reb_integrator_leapfrog_reset(struct reb_simulation* r);          ///< Internal function used to call a specific integrator
+void reb_integrator_leapfrog_fused_step(struct reb_simulation* r, const int N_sources); ///< Drift, force calculation and kick in one pass (see reb_integrator_fused_step())
 #endif
@@ -41,13 +41,14 @@
 #include "integrator.h"
 #include "integrator_sei.h"
 
+#define MIN(a, b) ((a) > (b) ? (b) : (a))    ///< Returns the minimum of a and b
 
-static void operator_H012(double dt, const struct reb_simulation_integrator_sei ri_sei, struct reb_particle* p);
-static void operator_phi1(double dt, struct reb_particle* p);
 
-void reb_integrator_sei_part1(struct reb_simulation* const r){
-	const int N = r->N;
-	struct reb_particle* const particles = r->particles;
+static inline void operator_H012(double dt, const struct reb_simulation_integrator_sei ri_sei, struct reb_particle* p);
+static inline void operator_phi1(double dt, struct reb_particle* p);
+
+// Sets OMEGAZ and pre-calculates sin() and tan() if needed.
+static void reb_integrator_sei_prepare(struct reb_simulation* const r){
 	if (r->ri_sei.OMEGAZ==-1){
 		r->ri_sei.OMEGAZ=r->ri_sei.OMEGA;
 	}
@@ -61,6 +62,12 @@ void reb_integrator_sei_part1(struct reb_simulation* const r){
 		r->ri_sei.tandtz = tan(r->ri_sei.OMEGAZ*(-r->dt/4.));
 		r->ri_sei.lastdt = r->dt;
 	}
+}
+
+void reb_integrator_sei_part1(struct reb_simulation* const r){
+	const int N = r->N;
+	struct reb_particle* const particles = r->particles;
+	reb_integrator_sei_prepare(r);
 	const struct reb_simulation_integrator_sei ri_sei = r->ri_sei;
 #pragma omp parallel for schedule(guided)
 	for (int i=0;i<N;i++){
@@ -73,15 +80,81 @@ void reb_integrator_sei_part2(struct reb_simulation* r){
 	const int N = r->N;
 	struct reb_particle* const particles = r->particles;
 	const struct reb_simulation_integrator_sei ri_sei = r->ri_sei;
+	const double dt = r->dt;
+	if (r->boundary==REB_BOUNDARY_SHEAR){
+		// Particles are shifted back into the box in the same pass. 
+		// reb_step() then skips reb_boundary_check(). The offset is calculated at the end of the timestep.
+		const struct reb_vec3d boxsize = r->boxsize;
+		const double offsetp1 = reb_boundary_shear_offset(boxsize, ri_sei.OMEGA, r->t+dt/2.);
 #pragma omp parallel for schedule(guided)
-	for (int i=0;i<N;i++){
-		operator_phi1(r->dt, &(particles[i]));
-		operator_H012(r->dt, ri_sei, &(particles[i]));
+		for (int i=0;i<N;i++){
+			operator_phi1(dt, &(particles[i]));
+			operator_H012(dt, ri_sei, &(particles[i]));
+			reb_boundary_shear_wrap(&(particles[i]), boxsize, ri_sei.OMEGA, offsetp1);
+		}
+	}else{
+#pragma omp parallel for schedule(guided)
+		for (int i=0;i<N;i++){
+			operator_phi1(dt, &(particles[i]));
+			operator_H012(dt, ri_sei, &(particles[i]));
+		}
 	}
 	r->t+=r->dt/2.;
 	r->dt_last_done = r->dt;
 }
 
+void reb_integrator_sei_fused_step(struct reb_simulation* r, const int N_sources){
+	const int N = r->N;
+	struct reb_particle* const particles = r->particles;
+	const double dt = r->dt;
+	const int gravity = r->gravity==REB_GRAVITY_BASIC;
+	const int shear = r->boundary==REB_BOUNDARY_SHEAR;
+	reb_integrator_sei_prepare(r);
+	const struct reb_simulation_integrator_sei ri_sei = r->ri_sei;
+	const struct reb_vec3d boxsize = r->boxsize;
+	const double t_mid = r->t+dt/2.;
+	const double offsetp1 = shear?reb_boundary_shear_offset(boxsize, ri_sei.OMEGA, t_mid+dt/2.):0.;
+	// Sources of gravity are drifted before any force is calculated.
+#pragma omp parallel for schedule(guided)
+	for (int i=0;i<N_sources;i++){
+		operator_H012(dt, ri_sei, &(particles[i]));
+	}
+	if (gravity){
+#pragma omp parallel for schedule(guided)
+		for (int i0=0;i0<N_sources;i0+=REB_INTEGRATOR_FUSED_TILE){
+			reb_calculate_acceleration_range(r, i0, MIN(i0+REB_INTEGRATOR_FUSED_TILE, N_sources));
+		}
+	}
+	// All other particles: drift, force calculation, kick and drift while the tile is in cache.
+#pragma omp parallel for schedule(guided)
+	for (int i0=N_sources;i0<N;i0+=REB_INTEGRATOR_FUSED_TILE){
+		const int i1 = MIN(i0+REB_INTEGRATOR_FUSED_TILE, N);
+		for (int i=i0;i<i1;i++){
+			operator_H012(dt, ri_sei, &(particles[i]));
+		}
+		if (gravity){
+			reb_calculate_acceleration_range(r, i0, i1);
+		}
+		for (int i=i0;i<i1;i++){
+			operator_phi1(dt, &(particles[i]));
+			operator_H012(dt, ri_sei, &(particles[i]));
+			if (shear){
+				reb_boundary_shear_wrap(&(particles[i]), boxsize, ri_sei.OMEGA, offsetp1);
+			}
+		}
+	}
+#pragma omp parallel for schedule(guided)
+	for (int i=0;i<N_sources;i++){
+		operator_phi1(dt, &(particles[i]));
+		operator_H012(dt, ri_sei, &(particles[i]));
+		if (shear){
+			reb_boundary_shear_wrap(&(particles[i]), boxsize, ri_sei.OMEGA, offsetp1);
+		}
+	}
+	r->t = t_mid+dt/2.;
+	r->dt_last_done = r->dt;
+}
+
 void reb_integrator_sei_synchronize(struct reb_simulation* r){
 	// Do nothing.
 }
@@ -97,7 +170,7 @@ void reb_integrator_sei_reset(struct reb_simulation* r){
  * @param dt Timestep
  * @param ri_sei Integrator struct
  */
-static void operator_H012(double dt, const struct reb_simulation_integrator_sei ri_sei, struct reb_particle* p){
+static inline void operator_H012(double dt, const struct reb_simulation_integrator_sei ri_sei, struct reb_particle* p){
 		
 	// Integrate vertical motion
 	const double zx = p->z * ri_sei.OMEGAZ;
@@ -139,7 +212,7 @@ static void operator_H012(double dt, const struct reb_simulation_integrator_sei
  * @param p reb_particle to evolve.
  * @param dt Timestep
  */
-static void operator_phi1(double dt, struct reb_particle* p){
+static inline void operator_phi1(double dt, struct reb_particle* p){
 	// The force used here is for test cases 2 and 3 
 	// in Rein & Tremaine 2011. 
 	p->vx += p->ax * dt;
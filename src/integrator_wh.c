@@ -48,7 +48,7 @@
 #include "integrator.h"
 #include "integrator_wh.h"
 
-static void reb_drift_wh(struct reb_particle* const particles, const double G, double _dt, const int N, const int N_active);
+static void reb_drift_wh(struct reb_particle* const particles, double* const mu, const double G, double _dt, const int N, const int N_active);
 static void reb_drift_dan(struct reb_particle* pv, double mu, double dt, int* iflag);
 static void reb_drift_kepu(double dt, double r0, double mu, double alpha, double u, double* fp, double* c1, double* c2, double* c3, int* iflag);
 static void reb_drift_kepu_guess(double dt0, double r0, double mu, double alpha, double u, double* s);
@@ -72,6 +72,7 @@ void reb_integrator_wh_part1(struct reb_simulation* r){
 	int _N_active = (N_active==-1)?N:N_active;
 	if (_N_active!=r->ri_wh.allocatedN){
 		r->ri_wh.eta = realloc(r->ri_wh.eta,sizeof(double)*_N_active);
+		r->ri_wh.mu  = realloc(r->ri_wh.mu,sizeof(double)*_N_active);
 		r->ri_wh.allocatedN = _N_active;
 	}
 	// DRIFT
@@ -81,7 +82,7 @@ void reb_integrator_wh_part1(struct reb_simulation* r){
 	  eta[i] = eta[i-1] + particles[i].m;
 	}
 	reb_integrator_wh_to_jacobi(particles, eta, N, N_active);
-	reb_drift_wh(particles, r->G, r->dt/2., N, N_active);
+	reb_drift_wh(particles, r->ri_wh.mu, r->G, r->dt/2., N, N_active);
 	reb_integrator_wh_from_jacobi(particles, eta, N, N_active);
 	r->t+=r->dt/2.;
 }
@@ -105,7 +106,7 @@ void reb_integrator_wh_part2(struct reb_simulation* r){
 	}
 	// DRIFT
 	reb_integrator_wh_to_jacobi(particles, eta, N, N_active);
-	reb_drift_wh(particles, r->G, r->dt/2., N, N_active);
+	reb_drift_wh(particles, r->ri_wh.mu, r->G, r->dt/2., N, N_active);
 	reb_integrator_wh_from_jacobi(particles, eta, N, N_active);
 	r->t+=r->dt/2.;
 	r->dt_last_done = r->dt;
@@ -116,6 +117,9 @@ void reb_integrator_wh_synchronize(struct reb_simulation* r){
 }
 void reb_integrator_wh_reset(struct reb_simulation* r){
 	free(r->ri_wh.eta);
+	r->ri_wh.eta = NULL;
+	free(r->ri_wh.mu);
+	r->ri_wh.mu = NULL;
 	r->ri_wh.allocatedN = 0;
 }
 
@@ -272,40 +276,35 @@ static void reb_integrator_wh_aj(struct reb_particle* const particles, const dou
 
 /**
  * @brief This function integrates the Keplerian motion of all particles.
+ * @details The gravitational parameters of the massive particles are calculated 
+ * first (in mu, an array of size N_active), so that all particles are independent 
+ * of each other and can be drifted in parallel.
  */
-static void reb_drift_wh(struct reb_particle* const particles, const double G, double _dt, const int N, const int N_active){
+static void reb_drift_wh(struct reb_particle* const particles, double* const mu, const double G, double _dt, const int N, const int N_active){
 	int _N_active = (N_active==-1)?N:N_active;
 	double mass0 = particles[0].m;
 	double etajm1 = mass0;
-	// Massive particles
+	// Massive particles orbit the mass interior to them.
 	for (int i=1;i<_N_active;i++){
 		struct reb_particle* p = &(particles[i]);
 		double etaj = etajm1 + p->m;
-		double mu = G*mass0*etaj/etajm1;
+		mu[i] = G*mass0*etaj/etajm1;
 		if (wh_check_normal(p)!=0){
-			etaj = etajm1;
-			continue;
-		}
-		int iflag = 0;
-		reb_drift_dan(p,mu,_dt,&iflag);
-		if (iflag != 0){ // Try again with 10 times smaller timestep.
-			for (int j=0;j<10;j++){
-				reb_drift_dan(p,mu,_dt/10.,&iflag);
-				if (iflag != 0) break;
-			}
+			continue; // Mass not included for the following particles.
 		}
 		etajm1 = etaj;  // Fixed by Subo
 	}
-	// Testparticles
 #pragma omp parallel for schedule(guided)
-	for (int i=_N_active;i<N;i++){
+	for (int i=1;i<N;i++){
 		struct reb_particle* p = &(particles[i]);
 		if (wh_check_normal(p)!=0) continue;
+		// Test particles only orbit the central object.
+		const double mu_i = (i<_N_active)?mu[i]:G*mass0;
 		int iflag = 0;
-		reb_drift_dan(p,G*mass0,_dt,&iflag);
+		reb_drift_dan(p,mu_i,_dt,&iflag);
 		if (iflag != 0){ // Try again with 10 times smaller timestep.
 			for (int j=0;j<10;j++){
-				reb_drift_dan(p,G*mass0,_dt/10.,&iflag);
+				reb_drift_dan(p,mu_i,_dt/10.,&iflag);
 				if (iflag != 0) break;
 			}
 		}
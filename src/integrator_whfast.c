@@ -27,6 +27,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
@@ -181,7 +182,7 @@ double X;
 	if(fastabs(X-oldX) > 0.01*X_per_period){
 		// Linear guess
 		X = beta*_dt/M;
-		static double prevX[WHFAST_NMAX_QUART+1];
+		double prevX[WHFAST_NMAX_QUART+1];
 		for(int n_lag=1; n_lag < WHFAST_NMAX_QUART; n_lag++){
 			stiefel_Gs3(Gs, beta, X);
 			const double f = r0*X + eta0*Gs[2] + zeta0*Gs[3] - _dt;
@@ -228,9 +229,12 @@ double X;
 			double sqrt_beta = sqrt(beta);
 			double invperiod = sqrt_beta*beta/(2.*M_PI*M);
 			double X_per_period = 2.*M_PI/sqrt_beta;
-			if (fabs(_dt)*invperiod>1. && *timestep_warning == 0){
-				(*timestep_warning)++;
-				reb_warning("Timestep is larger than at least one orbital period.");
+			if (fabs(_dt)*invperiod>1.){
+#pragma omp critical
+				if (*timestep_warning == 0){
+					(*timestep_warning)++;
+					reb_warning("Timestep is larger than at least one orbital period.");
+				}
 			}
 			X_min = X_per_period * floor(_dt*invperiod);
 			X_max = X_min + X_per_period;
@@ -307,16 +311,180 @@ double X;
 
 }
 
+#define WHFAST_KEPLER_LANES  4	///< Number of particles processed together by the batched Kepler solver
+#define WHFAST_STUMPFF_TERMS 6	///< Number of series terms used by the batched Stumpff functions (sufficient for |z|<=0.1)
+
+/**
+ * @brief Same as stumpff_cs3() but for WHFAST_KEPLER_LANES arguments at once.
+ * @details The series uses a fixed number of terms and the argument reduction is 
+ * masked per lane, so that the compiler can vectorize the loops over lanes. 
+ * For |z|<=0.1 the additional terms are below machine precision and the result
+ * is identical to stumpff_cs3().
+ */
+static void stumpff_cs3_lanes(double cs[4][WHFAST_KEPLER_LANES], const double* const restrict z0) {
+	double z[WHFAST_KEPLER_LANES];
+	unsigned int n[WHFAST_KEPLER_LANES];
+	unsigned int n_max = 0;
+	for (int l=0;l<WHFAST_KEPLER_LANES;l++){
+		z[l] = z0[l];
+		n[l] = 0;
+		while(fabs(z[l])>0.1){
+			z[l] = z[l]/4.;
+			n[l]++;
+		}
+		n_max = MAX(n_max,n[l]);
+	}
+	for (int l=0;l<WHFAST_KEPLER_LANES;l++){
+		const double zm = -z[l];
+		double c2 = invfactorial[2] - z[l]*invfactorial[4];
+		double c3 = invfactorial[3] - z[l]*invfactorial[5];
+		double _pow = zm;
+		for (int k=6;k<6+2*WHFAST_STUMPFF_TERMS;k+=2){
+			_pow *= zm;
+			c2 += _pow*invfactorial[k];
+			c3 += _pow*invfactorial[k+1];
+		}
+		cs[2][l] = c2;
+		cs[3][l] = c3;
+		cs[1][l] = 1.-z[l]*c3;
+		cs[0][l] = 1.-z[l]*c2;
+	}
+	for (unsigned int j=0;j<n_max;j++){
+		for (int l=0;l<WHFAST_KEPLER_LANES;l++){
+			const int active = j<n[l];
+			const double c3 = (cs[2][l]+cs[0][l]*cs[3][l])*0.25;
+			const double c2 = cs[1][l]*cs[1][l]*0.5;
+			const double c1 = cs[0][l]*cs[1][l];
+			const double c0 = 2.*cs[0][l]*cs[0][l]-1.;
+			cs[3][l] = active?c3:cs[3][l];
+			cs[2][l] = active?c2:cs[2][l];
+			cs[1][l] = active?c1:cs[1][l];
+			cs[0][l] = active?c0:cs[0][l];
+		}
+	}
+}
+
+/**
+ * @brief Kepler step for the WHFAST_KEPLER_LANES particles starting at index i0.
+ * @details Uses the same initial guess and Newton iteration as kepler_step() but 
+ * iterates all lanes together. Lanes that have converged are masked out. Lanes which 
+ * require the quartic solver or do not converge within WHFAST_NMAX_NEWT iterations 
+ * are passed to kepler_step(). The results are identical to calling kepler_step() 
+ * for each particle. Does not support variational particles.
+ * The warning counter of lane l is timestep_warning[l*timestep_warning_stride].
+ */
+static void kepler_step_lanes(const struct reb_simulation* const r, struct reb_particle* const restrict p_j, const double* const eta, const double G, const unsigned int i0, const double _dt, unsigned int* timestep_warning, const int timestep_warning_stride){
+	double M[WHFAST_KEPLER_LANES], r0[WHFAST_KEPLER_LANES], r0i[WHFAST_KEPLER_LANES];
+	double beta[WHFAST_KEPLER_LANES], eta0[WHFAST_KEPLER_LANES], zeta0[WHFAST_KEPLER_LANES];
+	double X[WHFAST_KEPLER_LANES], oldX[WHFAST_KEPLER_LANES], oldX2[WHFAST_KEPLER_LANES];
+	double ri[WHFAST_KEPLER_LANES], z[WHFAST_KEPLER_LANES];
+	double Gs[4][WHFAST_KEPLER_LANES];
+	int done[WHFAST_KEPLER_LANES];
+	for (int l=0;l<WHFAST_KEPLER_LANES;l++){
+		const struct reb_particle p1 = p_j[i0+l];
+		M[l] = G*eta[i0+l];
+		r0[l] = sqrt(p1.x*p1.x + p1.y*p1.y + p1.z*p1.z);
+		r0i[l] = 1./r0[l];
+		const double v2 =  p1.vx*p1.vx + p1.vy*p1.vy + p1.vz*p1.vz;
+		beta[l] = 2.*M[l]*r0i[l] - v2;
+		eta0[l] = p1.x*p1.vx + p1.y*p1.vy + p1.z*p1.vz;
+		zeta0[l] = M[l] - beta[l]*r0[l];
+		const double dtr0i = _dt*r0i[l];
+		X[l] = beta[l]>0.?dtr0i * (1. - dtr0i*eta0[l]*0.5*r0i[l]):0.; // Same initial guess as kepler_step()
+		oldX[l] = X[l];
+		z[l] = beta[l]*(X[l]*X[l]);
+	}
+	stumpff_cs3_lanes(Gs, z);
+	for (int l=0;l<WHFAST_KEPLER_LANES;l++){
+		const double X2 = X[l]*X[l];
+		const double Gs1 = Gs[1][l]*X[l];
+		const double Gs2 = Gs[2][l]*X2;
+		const double Gs3 = Gs[3][l]*(X2*X[l]);
+		const double eta0Gs1zeta0Gs2 = eta0[l]*Gs1 + zeta0[l]*Gs2;
+		ri[l] = 1./(r0[l] + eta0Gs1zeta0Gs2);
+		X[l]  = ri[l]*(X[l]*eta0Gs1zeta0Gs2-eta0[l]*Gs2-zeta0[l]*Gs3+_dt);
+		const double X_per_period = 2.*M_PI/sqrt(beta[l]);
+		// Lanes that need the quartic solver are done here and handled by kepler_step() below.
+		done[l] = fastabs(X[l]-oldX[l]) > 0.01*X_per_period;
+		oldX2[l] = nan("");
+	}
+	
+	int converged[WHFAST_KEPLER_LANES] = {0};
+	double Gs1[WHFAST_KEPLER_LANES], Gs2[WHFAST_KEPLER_LANES], Gs3[WHFAST_KEPLER_LANES];
+	for (int n_hg=1;n_hg<WHFAST_NMAX_NEWT;n_hg++){
+		int all_done = 1;
+		for (int l=0;l<WHFAST_KEPLER_LANES;l++){
+			all_done &= done[l];
+			z[l] = beta[l]*(X[l]*X[l]);
+		}
+		if (all_done) break;
+		stumpff_cs3_lanes(Gs, z);
+		for (int l=0;l<WHFAST_KEPLER_LANES;l++){
+			const double X2 = X[l]*X[l];
+			const double _Gs1 = Gs[1][l]*X[l];
+			const double _Gs2 = Gs[2][l]*X2;
+			const double _Gs3 = Gs[3][l]*(X2*X[l]);
+			const double eta0Gs1zeta0Gs2 = eta0[l]*_Gs1 + zeta0[l]*_Gs2;
+			const double _ri = 1./(r0[l] + eta0Gs1zeta0Gs2);
+			const double _X  = _ri*(X[l]*eta0Gs1zeta0Gs2-eta0[l]*_Gs2-zeta0[l]*_Gs3+_dt);
+			if (!done[l]){
+				oldX2[l] = oldX[l];
+				oldX[l] = X[l];
+				X[l] = _X;
+				ri[l] = _ri;
+				Gs1[l] = _Gs1;
+				Gs2[l] = _Gs2;
+				Gs3[l] = _Gs3;
+				if (X[l]==oldX[l]||X[l]==oldX2[l]){
+					// Converged.
+					converged[l] = 1;
+					done[l] = 1;
+				}
+			}
+		}
+	}
+
+	for (int l=0;l<WHFAST_KEPLER_LANES;l++){
+		const unsigned int i = i0+l;
+		if (!converged[l]){
+			// Fallback to scalar solver (quartic solver and bisection). 
+			kepler_step(r, p_j, eta, G, i, _dt, timestep_warning+l*timestep_warning_stride);
+			continue;
+		}
+		const struct reb_particle p1 = p_j[i];
+		// Note: These are not the traditional f and g functions.
+		const double f = -M[l]*Gs2[l]*r0i[l];
+		const double g = _dt - M[l]*Gs3[l];
+		const double fd = -M[l]*Gs1[l]*r0i[l]*ri[l]; 
+		const double gd = -M[l]*Gs2[l]*ri[l]; 
+			
+		p_j[i].x += f*p1.x + g*p1.vx;
+		p_j[i].y += f*p1.y + g*p1.vy;
+		p_j[i].z += f*p1.z + g*p1.vz;
+			
+		p_j[i].vx += fd*p1.x + gd*p1.vx;
+		p_j[i].vy += fd*p1.y + gd*p1.vy;
+		p_j[i].vz += fd*p1.z + gd*p1.vz;
+	}
+}
+
 /****************************** 
  * Coordinate transformations */
-static void to_jacobi_posvel(const struct reb_particle* const particles, struct reb_particle* const p_j, const double* const eta, const struct reb_particle* const p_mass, const int N){
+/**
+ * @brief Minimum number of particles for which the WHFast loops are run in parallel.
+ */
+#define WHFAST_OMP_MIN_N 1000
+
+// Massless particles at the end of the particle array do not change the Jacobi centres of mass.
+// The transformations treat the first N_massive particles sequentially and the remaining ones in parallel.
+static void to_jacobi_posvel(const struct reb_particle* const particles, struct reb_particle* const p_j, const double* const eta, const struct reb_particle* const p_mass, const int N, const int N_massive){
 	double s_x = eta[0] * particles[0].x;
 	double s_y = eta[0] * particles[0].y;
 	double s_z = eta[0] * particles[0].z;
 	double s_vx = eta[0] * particles[0].vx;
 	double s_vy = eta[0] * particles[0].vy;
 	double s_vz = eta[0] * particles[0].vz;
-	for (unsigned int i=1;i<N;i++){
+	for (unsigned int i=1;i<N_massive;i++){
 		const double ei = 1./eta[i-1];
 		const struct reb_particle pi = particles[i];
 		const double pme = eta[i]*ei;
@@ -333,6 +501,40 @@ static void to_jacobi_posvel(const struct reb_particle* const particles, struct
 		s_vy = s_vy * pme + p_mass[i].m*p_j[i].vy;
 		s_vz = s_vz * pme + p_mass[i].m*p_j[i].vz;
 	}
+	// The sum is still rescaled by pme for every massless particle. Do this sequentially 
+	// until the rounding no longer changes the sum, the remaining particles all see the same sum.
+	const double ei = 1./eta[N_massive-1];
+	const double pme = eta[N-1]*ei;
+	int i_par = N_massive;
+	int stable = 0;
+	while (i_par<N && !stable){
+		const struct reb_particle pi = particles[i_par];
+		p_j[i_par].x = pi.x - s_x*ei;
+		p_j[i_par].y = pi.y - s_y*ei;
+		p_j[i_par].z = pi.z - s_z*ei;
+		p_j[i_par].vx = pi.vx - s_vx*ei;
+		p_j[i_par].vy = pi.vy - s_vy*ei;
+		p_j[i_par].vz = pi.vz - s_vz*ei;
+		const double t_x  = s_x  * pme + p_mass[i_par].m*p_j[i_par].x ;
+		const double t_y  = s_y  * pme + p_mass[i_par].m*p_j[i_par].y ;
+		const double t_z  = s_z  * pme + p_mass[i_par].m*p_j[i_par].z ;
+		const double t_vx = s_vx * pme + p_mass[i_par].m*p_j[i_par].vx;
+		const double t_vy = s_vy * pme + p_mass[i_par].m*p_j[i_par].vy;
+		const double t_vz = s_vz * pme + p_mass[i_par].m*p_j[i_par].vz;
+		stable = t_x==s_x && t_y==s_y && t_z==s_z && t_vx==s_vx && t_vy==s_vy && t_vz==s_vz;
+		s_x = t_x; s_y = t_y; s_z = t_z; s_vx = t_vx; s_vy = t_vy; s_vz = t_vz;
+		i_par++;
+	}
+#pragma omp parallel for schedule(guided) if(N-i_par>WHFAST_OMP_MIN_N)
+	for (int i=i_par;i<N;i++){
+		const struct reb_particle pi = particles[i];
+		p_j[i].x = pi.x - s_x*ei;
+		p_j[i].y = pi.y - s_y*ei;
+		p_j[i].z = pi.z - s_z*ei;
+		p_j[i].vx = pi.vx - s_vx*ei;
+		p_j[i].vy = pi.vy - s_vy*ei;
+		p_j[i].vz = pi.vz - s_vz*ei;
+	}
 	const double Mtotal  = eta[N-1];
 	const double Mtotali = 1./Mtotal;
 	p_j[0].x = s_x * Mtotali;
@@ -343,11 +545,11 @@ static void to_jacobi_posvel(const struct reb_particle* const particles, struct
 	p_j[0].vz = s_vz * Mtotali;
 }
 
-static void to_jacobi_acc(const struct reb_particle* const particles, struct reb_particle* const p_j, const double* const eta, const struct reb_particle* const p_mass, const int N){
+static void to_jacobi_acc(const struct reb_particle* const particles, struct reb_particle* const p_j, const double* const eta, const struct reb_particle* const p_mass, const int N, const int N_massive){
 	double s_ax = eta[0] * particles[0].ax;
 	double s_ay = eta[0] * particles[0].ay;
 	double s_az = eta[0] * particles[0].az;
-	for (unsigned int i=1;i<N;i++){
+	for (unsigned int i=1;i<N_massive;i++){
 		const double ei = 1./eta[i-1];
 		const struct reb_particle pi = particles[i];
 		const double pme = eta[i]*ei;
@@ -358,10 +560,35 @@ static void to_jacobi_acc(const struct reb_particle* const particles, struct reb
 		s_ay = s_ay * pme + p_mass[i].m*p_j[i].ay;
 		s_az = s_az * pme + p_mass[i].m*p_j[i].az;
 	}
-	// p_j[0].a is not needed and thus not calculated 
+	const double ei = 1./eta[N_massive-1];
+	// p_j[0].a contains the acceleration subtracted from massless particles (used by the restricted kick)
+	p_j[0].ax = s_ax*ei;
+	p_j[0].ay = s_ay*ei;
+	p_j[0].az = s_az*ei;
+	// Rescale the sum sequentially until the rounding no longer changes it (see to_jacobi_posvel).
+	const double pme = eta[N-1]*ei;
+	int i_par = N_massive;
+	int stable = 0;
+	while (i_par<N && !stable){
+		p_j[i_par].ax = particles[i_par].ax - s_ax*ei;
+		p_j[i_par].ay = particles[i_par].ay - s_ay*ei;
+		p_j[i_par].az = particles[i_par].az - s_az*ei;
+		const double t_ax = s_ax * pme + p_mass[i_par].m*p_j[i_par].ax;
+		const double t_ay = s_ay * pme + p_mass[i_par].m*p_j[i_par].ay;
+		const double t_az = s_az * pme + p_mass[i_par].m*p_j[i_par].az;
+		stable = t_ax==s_ax && t_ay==s_ay && t_az==s_az;
+		s_ax = t_ax; s_ay = t_ay; s_az = t_az;
+		i_par++;
+	}
+#pragma omp parallel for schedule(guided) if(N-i_par>WHFAST_OMP_MIN_N)
+	for (int i=i_par;i<N;i++){
+		p_j[i].ax = particles[i].ax - s_ax*ei;
+		p_j[i].ay = particles[i].ay - s_ay*ei;
+		p_j[i].az = particles[i].az - s_az*ei;
+	}
 }
 
-static void to_inertial_posvel(struct reb_particle* const particles, const struct reb_particle* const p_j, const double* const eta, const struct reb_particle* const p_mass, const int N){
+static void to_inertial_posvel(struct reb_particle* const particles, const struct reb_particle* const p_j, const double* const eta, const struct reb_particle* const p_mass, const int N, const int N_massive){
 	const double Mtotal  = eta[N-1];
 	double s_x  = p_j[0].x  * Mtotal; 
 	double s_y  = p_j[0].y  * Mtotal; 
@@ -369,7 +596,54 @@ static void to_inertial_posvel(struct reb_particle* const particles, const struc
 	double s_vx = p_j[0].vx * Mtotal; 
 	double s_vy = p_j[0].vy * Mtotal; 
 	double s_vz = p_j[0].vz * Mtotal; 
-	for (unsigned int i=N-1;i>0;i--){
+	if (N_massive<N){
+		// The sum is still divided and multiplied by Mtotal for every massless particle. Do this 
+		// sequentially until the rounding no longer changes the sum, the remaining particles all 
+		// see the same sum.
+		const double ei = 1./eta[N-1];
+		int i_par = N-1;
+		int stable = 0;
+		while (i_par>=N_massive && !stable){
+			const struct reb_particle pji = p_j[i_par];
+			const double n_x  = (s_x  - p_mass[i_par].m * pji.x ) * ei;
+			const double n_y  = (s_y  - p_mass[i_par].m * pji.y ) * ei;
+			const double n_z  = (s_z  - p_mass[i_par].m * pji.z ) * ei;
+			const double n_vx = (s_vx - p_mass[i_par].m * pji.vx) * ei;
+			const double n_vy = (s_vy - p_mass[i_par].m * pji.vy) * ei;
+			const double n_vz = (s_vz - p_mass[i_par].m * pji.vz) * ei;
+			particles[i_par].x  = pji.x  + n_x ;
+			particles[i_par].y  = pji.y  + n_y ;
+			particles[i_par].z  = pji.z  + n_z ;
+			particles[i_par].vx = pji.vx + n_vx;
+			particles[i_par].vy = pji.vy + n_vy;
+			particles[i_par].vz = pji.vz + n_vz;
+			const double t_x  = n_x  * Mtotal;
+			const double t_y  = n_y  * Mtotal;
+			const double t_z  = n_z  * Mtotal;
+			const double t_vx = n_vx * Mtotal;
+			const double t_vy = n_vy * Mtotal;
+			const double t_vz = n_vz * Mtotal;
+			stable = t_x==s_x && t_y==s_y && t_z==s_z && t_vx==s_vx && t_vy==s_vy && t_vz==s_vz;
+			s_x = t_x; s_y = t_y; s_z = t_z; s_vx = t_vx; s_vy = t_vy; s_vz = t_vz;
+			i_par--;
+		}
+		const double n_x  = s_x  * ei;
+		const double n_y  = s_y  * ei;
+		const double n_z  = s_z  * ei;
+		const double n_vx = s_vx * ei;
+		const double n_vy = s_vy * ei;
+		const double n_vz = s_vz * ei;
+#pragma omp parallel for schedule(guided) if(i_par-N_massive>WHFAST_OMP_MIN_N)
+		for (int i=N_massive;i<=i_par;i++){
+			particles[i].x  = p_j[i].x  + n_x ;
+			particles[i].y  = p_j[i].y  + n_y ;
+			particles[i].z  = p_j[i].z  + n_z ;
+			particles[i].vx = p_j[i].vx + n_vx;
+			particles[i].vy = p_j[i].vy + n_vy;
+			particles[i].vz = p_j[i].vz + n_vz;
+		}
+	}
+	for (unsigned int i=N_massive-1;i>0;i--){
 		const struct reb_particle pji = p_j[i];
 		const double ei = 1./eta[i];
 		s_x  = (s_x  - p_mass[i].m * pji.x ) * ei;
@@ -400,12 +674,42 @@ static void to_inertial_posvel(struct reb_particle* const particles, const struc
 	particles[0].vz = s_vz * mi;
 }
 
-static void to_inertial_pos(struct reb_particle* const particles, const struct reb_particle* const p_j, const double* const eta, const struct reb_particle* const p_mass, const int N){
+static void to_inertial_pos(struct reb_particle* const particles, const struct reb_particle* const p_j, const double* const eta, const struct reb_particle* const p_mass, const int N, const int N_massive){
 	const double Mtotal  = eta[N-1];
 	double s_x  = p_j[0].x  * Mtotal; 
 	double s_y  = p_j[0].y  * Mtotal; 
 	double s_z  = p_j[0].z  * Mtotal; 
-	for (unsigned int i=N-1;i>0;i--){
+	if (N_massive<N){
+		// Rescale the sum sequentially until the rounding no longer changes it (see to_inertial_posvel).
+		const double ei = 1./eta[N-1];
+		int i_par = N-1;
+		int stable = 0;
+		while (i_par>=N_massive && !stable){
+			const struct reb_particle pji = p_j[i_par];
+			const double n_x  = (s_x  - p_mass[i_par].m * pji.x ) * ei;
+			const double n_y  = (s_y  - p_mass[i_par].m * pji.y ) * ei;
+			const double n_z  = (s_z  - p_mass[i_par].m * pji.z ) * ei;
+			particles[i_par].x  = pji.x  + n_x ;
+			particles[i_par].y  = pji.y  + n_y ;
+			particles[i_par].z  = pji.z  + n_z ;
+			const double t_x  = n_x  * Mtotal;
+			const double t_y  = n_y  * Mtotal;
+			const double t_z  = n_z  * Mtotal;
+			stable = t_x==s_x && t_y==s_y && t_z==s_z;
+			s_x = t_x; s_y = t_y; s_z = t_z;
+			i_par--;
+		}
+		const double n_x  = s_x  * ei;
+		const double n_y  = s_y  * ei;
+		const double n_z  = s_z  * ei;
+#pragma omp parallel for schedule(guided) if(i_par-N_massive>WHFAST_OMP_MIN_N)
+		for (int i=N_massive;i<=i_par;i++){
+			particles[i].x  = p_j[i].x  + n_x ;
+			particles[i].y  = p_j[i].y  + n_y ;
+			particles[i].z  = p_j[i].z  + n_z ;
+		}
+	}
+	for (unsigned int i=N_massive-1;i>0;i--){
 		const struct reb_particle pji = p_j[i];
 		const double ei = 1./eta[i];
 		s_x  = (s_x  - p_mass[i].m * pji.x ) * ei;
@@ -424,16 +728,127 @@ static void to_inertial_pos(struct reb_particle* const particles, const struct r
 	particles[0].z  = s_z  * mi;
 }
 
+// Democratic heliocentric and WHDS coordinates. 
+// p_j[0] contains the centre of mass, p_j[i] the heliocentric position and the barycentric velocity 
+// of particle i. For WHDS the velocity is multiplied by (m0+mi)/m0. 
+// The sums run sequentially over the massive particles, all other loops run in parallel.
+static void to_dh_posvel(const struct reb_particle* const particles, struct reb_particle* const p_j, const double Mtotal, const int N, const int N_massive, const int whds){
+	const double m0 = particles[0].m;
+	double s_x = 0., s_y = 0., s_z = 0., s_vx = 0., s_vy = 0., s_vz = 0.;
+	for (int i=0;i<N_massive;i++){
+		const struct reb_particle pi = particles[i];
+		s_x  += pi.m*pi.x;
+		s_y  += pi.m*pi.y;
+		s_z  += pi.m*pi.z;
+		s_vx += pi.m*pi.vx;
+		s_vy += pi.m*pi.vy;
+		s_vz += pi.m*pi.vz;
+	}
+	const double Mtotali = 1./Mtotal;
+	p_j[0].x  = s_x *Mtotali;
+	p_j[0].y  = s_y *Mtotali;
+	p_j[0].z  = s_z *Mtotali;
+	p_j[0].vx = s_vx*Mtotali;
+	p_j[0].vy = s_vy*Mtotali;
+	p_j[0].vz = s_vz*Mtotali;
+	const struct reb_particle p0 = particles[0];
+	const struct reb_particle com = p_j[0];
+#pragma omp parallel for schedule(guided) if(N>WHFAST_OMP_MIN_N)
+	for (int i=1;i<N;i++){
+		const struct reb_particle pi = particles[i];
+		const double f = whds?(m0+pi.m)/m0:1.;
+		p_j[i].x  = pi.x - p0.x;
+		p_j[i].y  = pi.y - p0.y;
+		p_j[i].z  = pi.z - p0.z;
+		p_j[i].vx = (pi.vx - com.vx)*f;
+		p_j[i].vy = (pi.vy - com.vy)*f;
+		p_j[i].vz = (pi.vz - com.vz)*f;
+	}
+}
+
+static void to_inertial_dh(struct reb_particle* const particles, const struct reb_particle* const p_j, const double Mtotal, const int N, const int N_massive, const int whds, const int vel){
+	const double m0 = particles[0].m;
+	double s_x = 0., s_y = 0., s_z = 0., s_vx = 0., s_vy = 0., s_vz = 0.;
+	for (int i=1;i<N_massive;i++){
+		const struct reb_particle pji = p_j[i];
+		const double m = particles[i].m;
+		const double mf = whds?m*m0/(m0+m):m;
+		s_x  += m*pji.x;
+		s_y  += m*pji.y;
+		s_z  += m*pji.z;
+		s_vx += mf*pji.vx;
+		s_vy += mf*pji.vy;
+		s_vz += mf*pji.vz;
+	}
+	const double Mtotali = 1./Mtotal;
+	const struct reb_particle com = p_j[0];
+	particles[0].x  = com.x - s_x*Mtotali;
+	particles[0].y  = com.y - s_y*Mtotali;
+	particles[0].z  = com.z - s_z*Mtotali;
+	const struct reb_particle p0 = particles[0];
+#pragma omp parallel for schedule(guided) if(N>WHFAST_OMP_MIN_N)
+	for (int i=1;i<N;i++){
+		particles[i].x = p_j[i].x + p0.x;
+		particles[i].y = p_j[i].y + p0.y;
+		particles[i].z = p_j[i].z + p0.z;
+		if (vel){
+			const double f = whds?m0/(m0+particles[i].m):1.;
+			particles[i].vx = p_j[i].vx*f + com.vx;
+			particles[i].vy = p_j[i].vy*f + com.vy;
+			particles[i].vz = p_j[i].vz*f + com.vz;
+		}
+	}
+	if (vel){
+		const double m0i = 1./m0;
+		particles[0].vx = com.vx - s_vx*m0i;
+		particles[0].vy = com.vy - s_vy*m0i;
+		particles[0].vz = com.vz - s_vz*m0i;
+	}
+}
+
+/***************************** 
+ * Jump Hamiltonian           */
+
+// Drifts the heliocentric positions with the total barycentric momentum divided by m0. 
+// For WHDS, the particle's own momentum is not included (it is part of the Kepler step).
+static void jump_step(const struct reb_particle* const particles, struct reb_particle* const p_j, const double _dt, const int N, const int N_massive, const int whds){
+	const double m0 = particles[0].m;
+	double s_vx = 0., s_vy = 0., s_vz = 0.;
+	for (int i=1;i<N_massive;i++){
+		const double m = particles[i].m;
+		const double mf = whds?m*m0/(m0+m):m;
+		s_vx += mf*p_j[i].vx;
+		s_vy += mf*p_j[i].vy;
+		s_vz += mf*p_j[i].vz;
+	}
+	const double dtm0 = _dt/m0;
+#pragma omp parallel for schedule(guided) if(N>WHFAST_OMP_MIN_N)
+	for (int i=1;i<N;i++){
+		double px = s_vx, py = s_vy, pz = s_vz;
+		if (whds){
+			const double m = particles[i].m;
+			const double mf = m*m0/(m0+m);
+			px -= mf*p_j[i].vx;
+			py -= mf*p_j[i].vy;
+			pz -= mf*p_j[i].vz;
+		}
+		p_j[i].x += dtm0*px;
+		p_j[i].y += dtm0*py;
+		p_j[i].z += dtm0*pz;
+	}
+}
+
 /***************************** 
  * Interaction Hamiltonian  */
 
 static void interaction_step(struct reb_simulation* const r, struct reb_particle* const p_j, const double* const eta, const double G, const double softening, const double _dt, const int N_real){
-	for (unsigned int i=1;i<N_real;i++){
+#pragma omp parallel for schedule(guided) if(N_real>WHFAST_OMP_MIN_N)
+	for (int i=1;i<N_real;i++){
 		// Eq 132
 		const struct reb_particle pji = p_j[i];
-		static double rj2i;
-		static double rj3iM;
-		static double prefac1;
+		double rj2i = 0.;
+		double rj3iM = 0.;
+		double prefac1 = 0.;
 		p_j[i].vx += _dt * pji.ax;
 		p_j[i].vy += _dt * pji.ay;
 		p_j[i].vz += _dt * pji.az;
@@ -464,11 +879,156 @@ static void interaction_step(struct reb_simulation* const r, struct reb_particle
 	}
 }
 
+// Kick for democratic heliocentric and WHDS coordinates. Gravity does not include 
+// any interactions with the central object, so the acceleration of the centre of mass 
+// only comes from additional forces.
+static void interaction_step_dh(const struct reb_particle* const particles, struct reb_particle* const p_j, const double Mtotal, const double _dt, const int N, const int N_massive, const int whds){
+	const double m0 = particles[0].m;
+	double s_ax = 0., s_ay = 0., s_az = 0.;
+	for (int i=0;i<N_massive;i++){
+		const struct reb_particle pi = particles[i];
+		s_ax += pi.m*pi.ax;
+		s_ay += pi.m*pi.ay;
+		s_az += pi.m*pi.az;
+	}
+	const double Mtotali = 1./Mtotal;
+	s_ax *= Mtotali;
+	s_ay *= Mtotali;
+	s_az *= Mtotali;
+#pragma omp parallel for schedule(guided) if(N>WHFAST_OMP_MIN_N)
+	for (int i=1;i<N;i++){
+		const struct reb_particle pi = particles[i];
+		const double dtf = whds?_dt*(m0+pi.m)/m0:_dt;
+		p_j[i].vx += dtf*(pi.ax - s_ax);
+		p_j[i].vy += dtf*(pi.ay - s_ay);
+		p_j[i].vz += dtf*(pi.az - s_az);
+	}
+	p_j[0].vx += _dt*s_ax;
+	p_j[0].vy += _dt*s_ay;
+	p_j[0].vz += _dt*s_az;
+}
+
+/***************************** 
+ * Restricted problem        */
+
+int reb_integrator_whfast_restricted(const struct reb_simulation* const r){
+	const struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+	return r->integrator==REB_INTEGRATOR_WHFAST
+		&& ri_whfast->coordinates==REB_WHFAST_COORDINATES_JACOBI
+		&& ri_whfast->N_massive>1 && ri_whfast->N_massive<r->N
+		&& (r->N_active==-1 || r->N_active>=ri_whfast->N_massive)
+		&& r->N_var==0
+		&& r->gravity==REB_GRAVITY_BASIC
+		&& r->nghostx==0 && r->nghosty==0 && r->nghostz==0
+		&& r->collision!=REB_COLLISION_SOFTSPHERE
+		&& r->additional_forces==NULL;
+}
+
+/**
+ * @brief Kick for the n<=WHFAST_KEPLER_LANES massless particles starting at index i0.
+ * @details Combines the force calculation, the transformation to Jacobi accelerations and the 
+ * interaction step. Requires the inertial positions of all particles and p_j[0].a from to_jacobi_acc().
+ */
+static inline void restricted_kick_lanes(struct reb_particle* const restrict particles, struct reb_particle* const restrict p_j, const double* const eta, const double G, const double softening2, const int N_massive, const int i0, const int n, const double _dt){
+	double x[WHFAST_KEPLER_LANES], y[WHFAST_KEPLER_LANES], z[WHFAST_KEPLER_LANES];
+	double ax[WHFAST_KEPLER_LANES], ay[WHFAST_KEPLER_LANES], az[WHFAST_KEPLER_LANES];
+	for (int l=0;l<n;l++){
+		x[l] = particles[i0+l].x;
+		y[l] = particles[i0+l].y;
+		z[l] = particles[i0+l].z;
+		ax[l] = 0.;
+		ay[l] = 0.;
+		az[l] = 0.;
+	}
+	for (int j=0;j<N_massive;j++){
+		const struct reb_particle pj = particles[j];
+		for (int l=0;l<n;l++){
+			const double dx = x[l] - pj.x;
+			const double dy = y[l] - pj.y;
+			const double dz = z[l] - pj.z;
+			const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+			const double prefact = -G/(_r*_r*_r)*pj.m;
+			ax[l] += prefact*dx;
+			ay[l] += prefact*dy;
+			az[l] += prefact*dz;
+		}
+	}
+	for (int l=0;l<n;l++){
+		const int i = i0+l;
+		particles[i].ax = ax[l];
+		particles[i].ay = ay[l];
+		particles[i].az = az[l];
+		const struct reb_particle pji = p_j[i];
+		p_j[i].vx += _dt * (ax[l] - p_j[0].ax);
+		p_j[i].vy += _dt * (ay[l] - p_j[0].ay);
+		p_j[i].vz += _dt * (az[l] - p_j[0].az);
+		const double rj2i = 1./(pji.x*pji.x + pji.y*pji.y + pji.z*pji.z + softening2);
+		const double rji  = sqrt(rj2i);
+		const double prefac1 = _dt*(rji*rj2i*G*eta[i]);
+		p_j[i].vx += prefac1*pji.x;
+		p_j[i].vy += prefac1*pji.y;
+		p_j[i].vz += prefac1*pji.z;
+	}
+}
+
+/**
+ * @brief Force calculation and interaction step for restricted problems.
+ * @details Used instead of reb_calculate_acceleration() and whfast_kick() if 
+ * reb_integrator_whfast_restricted() is true. Forces are only calculated 
+ * between the massive particles and from the massive particles on the massless 
+ * particles. The results, including the accelerations stored in the particles, 
+ * are identical to the general kick.
+ */
+static void restricted_kick(struct reb_simulation* const r, const double _dt){
+	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+	struct reb_particle* restrict const particles = r->particles;
+	struct reb_particle* restrict const p_j = ri_whfast->p_j;
+	const double* const eta = ri_whfast->eta;
+	const int N = r->N;
+	const int N_massive = ri_whfast->N_massive;
+	const double G = r->G;
+	const double softening2 = r->softening*r->softening;
+#pragma omp parallel for schedule(guided) if(N_massive>WHFAST_OMP_MIN_N)
+	for (int i=0;i<N_massive;i++){
+		double ax = 0., ay = 0., az = 0.;
+		for (int j=0;j<N_massive;j++){
+			if ((j==1 && i==0) || (i==1 && j==0) || i==j) continue;
+			const double dx = particles[i].x - particles[j].x;
+			const double dy = particles[i].y - particles[j].y;
+			const double dz = particles[i].z - particles[j].z;
+			const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+			const double prefact = -G/(_r*_r*_r)*particles[j].m;
+			ax += prefact*dx;
+			ay += prefact*dy;
+			az += prefact*dz;
+		}
+		particles[i].ax = ax;
+		particles[i].ay = ay;
+		particles[i].az = az;
+	}
+	to_jacobi_acc(particles, p_j, eta, particles, N_massive, N_massive);
+	interaction_step(r, p_j, eta, G, r->softening, _dt, N_massive);
+	const int N_lanes = (N-N_massive)/WHFAST_KEPLER_LANES;
+#pragma omp parallel for schedule(guided) if(N-N_massive>WHFAST_OMP_MIN_N)
+	for (int l=0;l<N_lanes;l++){
+		restricted_kick_lanes(particles, p_j, eta, G, softening2, N_massive, N_massive+l*WHFAST_KEPLER_LANES, WHFAST_KEPLER_LANES, _dt);
+	}
+	const int i_rest = N_massive+N_lanes*WHFAST_KEPLER_LANES;
+	restricted_kick_lanes(particles, p_j, eta, G, softening2, N_massive, i_rest, N-i_rest, _dt);
+}
+
 /***************************** 
  * DKD Scheme                */
 
 static void kepler_drift(const struct reb_simulation* const r, struct reb_particle* const p_j, const double* const eta, const double G, const double _dt, unsigned int* timestep_warning, const int N_real){
-	for (unsigned int i=1;i<N_real;i++){
+	// Number of groups handled by the batched solver
+	const int N_lanes = (r->var_config_N==0)?(N_real-1)/WHFAST_KEPLER_LANES:0;
+#pragma omp parallel for schedule(guided) if(N_real>WHFAST_OMP_MIN_N)
+	for (int l=0;l<N_lanes;l++){
+		kepler_step_lanes(r, p_j, eta, G, 1+l*WHFAST_KEPLER_LANES, _dt, timestep_warning, 0);
+	}
+#pragma omp parallel for schedule(guided) if(N_real>WHFAST_OMP_MIN_N)
+	for (int i=1+N_lanes*WHFAST_KEPLER_LANES;i<N_real;i++){
 		kepler_step(r, p_j, eta, G, i, _dt, timestep_warning);
 	}
 	p_j[0].x += _dt*p_j[0].vx;
@@ -494,92 +1054,160 @@ const static double b_114 = -14556229./19015920.*4.980119205559973422e-02;
 const static double b_115 = 3394141./2328480.*4.980119205559973422e-02;
 
 
-static void corrector_Z(struct reb_simulation* r, const double a, const double b){
+// Kick used by the corrector: positions to inertial coordinates, force evaluation and interaction step.
+static void corrector_kick(struct reb_simulation* r, const double b){
 	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
 	struct reb_particle* restrict const particles = r->particles;
 	const int N_real = r->N-r->N_var;
-	kepler_drift(r, ri_whfast->p_j, ri_whfast->eta,  r->G, a, &(ri_whfast->timestep_warning), N_real);
-	to_inertial_pos(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real);
+	to_inertial_pos(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
     for (int v=0;v<r->var_config_N;v++){
         struct reb_variational_configuration const vc = r->var_config[v];
-		to_inertial_pos(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real);
+		to_inertial_pos(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
 	}
 	reb_update_acceleration(r);
-	to_jacobi_acc(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real);
+	to_jacobi_acc(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
     for (int v=0;v<r->var_config_N;v++){
         struct reb_variational_configuration const vc = r->var_config[v];
-		to_jacobi_acc(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real);
-	}
-	interaction_step(r, ri_whfast->p_j, ri_whfast->eta, r->G, r->softening, -b, N_real);
-	kepler_drift(r, ri_whfast->p_j, ri_whfast->eta, r->G, -2.*a, &(ri_whfast->timestep_warning), N_real);
-	to_inertial_pos(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real);
-    for (int v=0;v<r->var_config_N;v++){
-        struct reb_variational_configuration const vc = r->var_config[v];
-		to_inertial_pos(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real);
-	}
-	reb_update_acceleration(r);
-	to_jacobi_acc(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real);
-    for (int v=0;v<r->var_config_N;v++){
-        struct reb_variational_configuration const vc = r->var_config[v];
-		to_jacobi_acc(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real);
+		to_jacobi_acc(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
 	}
 	interaction_step(r, ri_whfast->p_j, ri_whfast->eta, r->G, r->softening, b, N_real);
-	kepler_drift(r, ri_whfast->p_j, ri_whfast->eta, r->G, a, &(ri_whfast->timestep_warning), N_real);
 }
 
-static void apply_corrector(struct reb_simulation* r, double inv){
+static void corrector_drift(struct reb_simulation* r, const double a){
+	if (a!=0.){
+		struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+		kepler_drift(r, ri_whfast->p_j, ri_whfast->eta, r->G, a, &(ri_whfast->timestep_warning), r->N-r->N_var);
+	}
+}
+
+/**
+ * @brief Applies the symplectic corrector (inv=1) or its inverse (inv=-1).
+ * @details The corrector is a sequence of stages Z(a,b) = K(a) I(-b) K(-2a) I(b) K(a),
+ * where K is a Kepler drift and I an interaction kick. The last drift of one stage 
+ * and the first drift of the next stage are combined into one drift. The drifts
+ * drift_before and drift_after are combined with the first and last drift of the sequence.
+ * Stages with opposite drifts (the central pair of every corrector) then require 
+ * no Kepler step at all, and their two kicks are combined into one force evaluation.
+ */
+static void apply_corrector(struct reb_simulation* r, const double inv, const double drift_before, const double drift_after){
 	const double dt = r->dt;
-	if (r->ri_whfast.corrector==3){
-		// Third order corrector
-		corrector_Z(r, a_1*dt,-inv*b_31*dt);
-		corrector_Z(r, -a_1*dt,inv*b_31*dt);
-	}
-	if (r->ri_whfast.corrector==5){
-		// Fifth order corrector
-		corrector_Z(r, -a_2*dt,-inv*b_51*dt);
-		corrector_Z(r, -a_1*dt,-inv*b_52*dt);
-		corrector_Z(r, a_1*dt,inv*b_52*dt);
-		corrector_Z(r, a_2*dt,inv*b_51*dt);
-	}
-	if (r->ri_whfast.corrector==7){
-		// Seventh order corrector
-		corrector_Z(r, -a_3*dt,-inv*b_71*dt);
-		corrector_Z(r, -a_2*dt,-inv*b_72*dt);
-		corrector_Z(r, -a_1*dt,-inv*b_73*dt);
-		corrector_Z(r, a_1*dt,inv*b_73*dt);
-		corrector_Z(r, a_2*dt,inv*b_72*dt);
-		corrector_Z(r, a_3*dt,inv*b_71*dt);
-	}
-	if (r->ri_whfast.corrector==11){
-		// Eleventh order corrector
-		corrector_Z(r, -a_5*dt,-inv*b_111*dt);
-		corrector_Z(r, -a_4*dt,-inv*b_112*dt);
-		corrector_Z(r, -a_3*dt,-inv*b_113*dt);
-		corrector_Z(r, -a_2*dt,-inv*b_114*dt);
-		corrector_Z(r, -a_1*dt,-inv*b_115*dt);
-		corrector_Z(r, a_1*dt,inv*b_115*dt);
-		corrector_Z(r, a_2*dt,inv*b_114*dt);
-		corrector_Z(r, a_3*dt,inv*b_113*dt);
-		corrector_Z(r, a_4*dt,inv*b_112*dt);
-		corrector_Z(r, a_5*dt,inv*b_111*dt);
+	double a[10];
+	double b[10];
+	int stages = 0;
+	switch (r->ri_whfast.corrector){
+		case 3:
+			// Third order corrector
+			stages = 2;
+			a[0] = a_1; b[0] = -b_31;
+			break;
+		case 5:
+			// Fifth order corrector
+			stages = 4;
+			a[0] = -a_2; b[0] = -b_51;
+			a[1] = -a_1; b[1] = -b_52;
+			break;
+		case 7:
+			// Seventh order corrector
+			stages = 6;
+			a[0] = -a_3; b[0] = -b_71;
+			a[1] = -a_2; b[1] = -b_72;
+			a[2] = -a_1; b[2] = -b_73;
+			break;
+		case 11:
+			// Eleventh order corrector
+			stages = 10;
+			a[0] = -a_5; b[0] = -b_111;
+			a[1] = -a_4; b[1] = -b_112;
+			a[2] = -a_3; b[2] = -b_113;
+			a[3] = -a_2; b[3] = -b_114;
+			a[4] = -a_1; b[4] = -b_115;
+			break;
+		default:
+			corrector_drift(r, drift_before+drift_after);
+			return;
+	}
+	// The second half of the stages mirrors the first half with opposite signs
+	for (int k=0;k<stages/2;k++){
+		a[stages-1-k] = -a[k];
+		b[stages-1-k] = -b[k];
+	}
+	corrector_drift(r, drift_before + a[0]*dt);
+	double b_pending = 0.;  // Kick not yet applied. Kicks without a drift in between are combined.
+	for (int k=0;k<stages;k++){
+		corrector_kick(r, b_pending - inv*b[k]*dt);
+		corrector_drift(r, -2.*a[k]*dt);
+		b_pending = inv*b[k]*dt;
+		if (k<stages-1 && a[k]+a[k+1]!=0.){
+			corrector_kick(r, b_pending);
+			b_pending = 0.;
+			corrector_drift(r, (a[k]+a[k+1])*dt);
+		}
 	}
+	corrector_kick(r, b_pending);
+	corrector_drift(r, a[stages-1]*dt + drift_after);
 }
 
-void reb_integrator_whfast_part1(struct reb_simulation* const r){
-    for (int v=0;v<r->var_config_N;v++){
-        struct reb_variational_configuration const vc = r->var_config[v];
-        if (vc.order!=1){
-            reb_exit("WHFast/MEGNO only supports first order variational equations.");
-        }
-        if (vc.testparticle>=0){
-            reb_exit("Test particle variations not supported with WHFast. Use IAS15.");
-        }
-    }
+// Jump step (democratic heliocentric and WHDS coordinates only) and 
+// positions (and velocities if needed) in inertial coordinates for the force calculation.
+static void whfast_prepare_kick(struct reb_simulation* const r, const double _dt){
+	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+	struct reb_particle* restrict const particles = r->particles;
+	const int N_real = r->N-r->N_var;
+	if (ri_whfast->coordinates!=REB_WHFAST_COORDINATES_JACOBI){
+		const int whds = ri_whfast->coordinates==REB_WHFAST_COORDINATES_WHDS;
+		jump_step(particles, ri_whfast->p_j, _dt/2., N_real, ri_whfast->N_massive, whds);
+		to_inertial_dh(particles, ri_whfast->p_j, ri_whfast->Mtotal, N_real, ri_whfast->N_massive, whds, r->force_is_velocity_dependent);
+	}else if (r->force_is_velocity_dependent){
+		to_inertial_posvel(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
+	}else{
+		to_inertial_pos(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
+	}
+}
+
+// Interaction step using the accelerations in the particle structure. 
+static void whfast_kick(struct reb_simulation* const r, const double _dt){
+	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+	struct reb_particle* restrict const particles = r->particles;
+	const int N_real = r->N-r->N_var;
+	if (ri_whfast->coordinates!=REB_WHFAST_COORDINATES_JACOBI){
+		const int whds = ri_whfast->coordinates==REB_WHFAST_COORDINATES_WHDS;
+		interaction_step_dh(particles, ri_whfast->p_j, ri_whfast->Mtotal, _dt, N_real, ri_whfast->N_massive, whds);
+		jump_step(particles, ri_whfast->p_j, _dt/2., N_real, ri_whfast->N_massive, whds);
+	}else{
+		to_jacobi_acc(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
+		for (int v=0;v<r->var_config_N;v++){
+			struct reb_variational_configuration const vc = r->var_config[v];
+			to_jacobi_acc(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
+		}
+		interaction_step(r, ri_whfast->p_j, ri_whfast->eta, r->G, r->softening, _dt, N_real);
+	}
+}
+
+// Force calculation followed by the interaction step.
+static void whfast_calculate_and_kick(struct reb_simulation* const r, const double _dt){
+	if (reb_integrator_whfast_restricted(r)){
+		restricted_kick(r, _dt);
+	}else{
+		reb_update_acceleration(r);
+		whfast_kick(r, _dt);
+	}
+}
+
+static void whfast_drift(struct reb_simulation* const r, const double _dt){
+	if (_dt!=0.){
+		struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+		kepler_drift(r, ri_whfast->p_j, ri_whfast->eta, r->G, _dt, &(ri_whfast->timestep_warning), r->N-r->N_var);
+	}
+}
+
+// Allocates memory and calculates the Jacobi (or democratic heliocentric/WHDS) coordinates if needed. 
+static void whfast_prepare_coordinates(struct reb_simulation* const r){
 	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
 	struct reb_particle* restrict const particles = r->particles;
 	const int N = r->N;
 	const int N_real = N-r->N_var;
-	r->gravity_ignore_10 = 1;
+	const int jacobi = ri_whfast->coordinates==REB_WHFAST_COORDINATES_JACOBI;
+	const int whds = ri_whfast->coordinates==REB_WHFAST_COORDINATES_WHDS;
 	if (ri_whfast->allocated_N != N){
 		ri_whfast->allocated_N = N;
 		ri_whfast->p_j = realloc(ri_whfast->p_j,sizeof(struct reb_particle)*N);
@@ -597,37 +1225,221 @@ void reb_integrator_whfast_part1(struct reb_simulation* const r){
 		}
 		ri_whfast->eta[0] = particles[0].m;
 		ri_whfast->p_j[0].m = particles[0].m;
+		ri_whfast->Mtotal = particles[0].m;
 		for (unsigned int i=1;i<N_real;i++){
-			ri_whfast->eta[i] = ri_whfast->eta[i-1] + particles[i].m;
+			ri_whfast->Mtotal += particles[i].m;
+			if (jacobi){
+				ri_whfast->eta[i] = ri_whfast->eta[i-1] + particles[i].m;
+			}else{
+				// Mass of the central object in the Kepler step
+				ri_whfast->eta[i] = whds?particles[0].m + particles[i].m:particles[0].m;
+			}
 			ri_whfast->p_j[i].m = particles[i].m;
 		}
 		for (unsigned int i=N_real;i<N;i++){
 			ri_whfast->p_j[i].m = particles[i].m;
 		}
+		ri_whfast->N_massive = N_real;
+		while (ri_whfast->N_massive>1 && particles[ri_whfast->N_massive-1].m==0.){
+			ri_whfast->N_massive--;
+		}
 		ri_whfast->recalculate_jacobi_this_timestep = 0;
-		to_jacobi_posvel(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real);
+		if (!jacobi){
+			to_dh_posvel(particles, ri_whfast->p_j, ri_whfast->Mtotal, N_real, ri_whfast->N_massive, whds);
+		}else{
+			to_jacobi_posvel(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
+		}
         for (int v=0;v<r->var_config_N;v++){
             struct reb_variational_configuration const vc = r->var_config[v];
-			to_jacobi_posvel(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real);
+			to_jacobi_posvel(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
+		}
+	}
+}
+
+// One step with timestep _dt, starting and ending with synchronized coordinates (adaptive timestep only).
+static void whfast_adaptive_substep(struct reb_simulation* const r, const double t, const double _dt, const double* const c, const double* const d, const int n){
+	double t_stage = 0.;
+	for (int k=0;k<n;k++){
+		whfast_drift(r, c[k]*_dt);
+		t_stage += c[k];
+		r->t = t + t_stage*_dt;
+		whfast_prepare_kick(r, d[k]*_dt);
+		whfast_calculate_and_kick(r, d[k]*_dt);
+	}
+	whfast_drift(r, c[n]*_dt);
+}
+
+// Largest relative difference in position and velocity between two sets of coordinates.
+// The absolute difference is used if a position or velocity is zero.
+static double whfast_adaptive_error(const struct reb_particle* const p_j, const struct reb_particle* const p_j1, const int N){
+	double error = 0.;
+	for (int i=1;i<N;i++){
+		const double dx  = p_j[i].x  - p_j1[i].x;
+		const double dy  = p_j[i].y  - p_j1[i].y;
+		const double dz  = p_j[i].z  - p_j1[i].z;
+		const double dvx = p_j[i].vx - p_j1[i].vx;
+		const double dvy = p_j[i].vy - p_j1[i].vy;
+		const double dvz = p_j[i].vz - p_j1[i].vz;
+		const double r2 = p_j[i].x*p_j[i].x + p_j[i].y*p_j[i].y + p_j[i].z*p_j[i].z;
+		const double v2 = p_j[i].vx*p_j[i].vx + p_j[i].vy*p_j[i].vy + p_j[i].vz*p_j[i].vz;
+		const double dr2 = dx*dx + dy*dy + dz*dz;
+		const double dv2 = dvx*dvx + dvy*dvy + dvz*dvz;
+		const double e2 = MAX(r2>0.?dr2/r2:dr2, v2>0.?dv2/v2:dv2);
+		if (isnan(e2)){
+			return e2;
+		}
+		if (e2>error*error){
+			error = sqrt(e2);
+		}
+	}
+	return error;
+}
+
+// Factor by which the timestep changes. The difference between one step and two half steps scales as dt^3.
+static double whfast_adaptive_factor(const double error, const double epsilon){
+	const double f = 0.9*cbrt(epsilon/error);
+	if (!(f>=0.1)){ // Also catches NaNs
+		return 0.1;
+	}
+	return f>4.?4.:f;
+}
+
+/**
+ * @brief Error estimate by step doubling and timestep control. 
+ * @details On entry, p_j contains the synchronized coordinates after one step with dt and 
+ * p_j_save the coordinates at the beginning of the step. Rejected steps are repeated with a 
+ * smaller timestep. On exit, the particles contain the result of the two half steps.
+ */
+static void whfast_adaptive_step(struct reb_simulation* const r, const double* const c, const double* const d, const int n){
+	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+	const int N = r->N;
+	struct reb_particle* const p_j0 = ri_whfast->p_j_save;
+	struct reb_particle* const p_j1 = ri_whfast->p_j_save+N;
+	const double t0 = r->t - c[0]*r->dt;
+	double dt = r->dt;
+	double error;
+	int failed = 0;
+	while(1){
+		memcpy(p_j1, ri_whfast->p_j, sizeof(struct reb_particle)*N);
+		memcpy(ri_whfast->p_j, p_j0, sizeof(struct reb_particle)*N);
+		whfast_adaptive_substep(r, t0, dt/2., c, d, n);
+		whfast_adaptive_substep(r, t0+dt/2., dt/2., c, d, n);
+		error = whfast_adaptive_error(ri_whfast->p_j, p_j1, N);
+		if (!isfinite(error)){
+			reb_warning("WHFast error estimate is not finite. Timestep not adjusted.");
+			failed = 1;
+			break;
+		}
+		if (error<=ri_whfast->epsilon || fabs(dt)<=ri_whfast->min_dt){
+			break;
+		}
+		// Step rejected. Try again with a smaller timestep.
+		double dt_new = dt*whfast_adaptive_factor(error, ri_whfast->epsilon);
+		if (fabs(dt_new)<ri_whfast->min_dt){
+			dt_new = copysign(ri_whfast->min_dt, dt);
+		}
+		if (t0+dt_new==t0){
+			reb_warning("WHFast timestep underflow. Accuracy epsilon cannot be reached. Timestep not adjusted.");
+			failed = 1;
+			break;
+		}
+		dt = dt_new;
+		memcpy(ri_whfast->p_j, p_j0, sizeof(struct reb_particle)*N);
+		whfast_adaptive_substep(r, t0, dt, c, d, n);
+	}
+	if (failed && dt!=r->dt){
+		// Repeat the step with the old timestep.
+		dt = r->dt;
+		memcpy(ri_whfast->p_j, p_j0, sizeof(struct reb_particle)*N);
+		whfast_adaptive_substep(r, t0, dt/2., c, d, n);
+		whfast_adaptive_substep(r, t0+dt/2., dt/2., c, d, n);
+	}
+	if (ri_whfast->coordinates!=REB_WHFAST_COORDINATES_JACOBI){
+		to_inertial_dh(r->particles, ri_whfast->p_j, ri_whfast->Mtotal, N, ri_whfast->N_massive, ri_whfast->coordinates==REB_WHFAST_COORDINATES_WHDS, 1);
+	}else{
+		to_inertial_posvel(r->particles, ri_whfast->p_j, ri_whfast->eta, r->particles, N, ri_whfast->N_massive);
+	}
+	ri_whfast->is_synchronized = 1;
+	r->t = t0 + dt;
+	r->dt_last_done = dt;
+	if (failed){
+		return;
+	}
+	r->dt = dt*whfast_adaptive_factor(error, ri_whfast->epsilon);
+	if (fabs(r->dt)<ri_whfast->min_dt){
+		r->dt = copysign(ri_whfast->min_dt, r->dt);
+	}
+}
+
+void reb_integrator_whfast_part1(struct reb_simulation* const r){
+    if (r->ri_whfast.epsilon>0.){
+        if (r->var_config_N){
+            reb_exit("Variational particles are not supported with the adaptive timestep in WHFast.");
+        }
+        if (r->ri_whfast.corrector){
+            reb_warning("Symplectic correctors are not supported with the adaptive timestep in WHFast. Correctors turned off.");
+            r->ri_whfast.corrector = 0;
+        }
+    }
+    for (int v=0;v<r->var_config_N;v++){
+        struct reb_variational_configuration const vc = r->var_config[v];
+        if (vc.order!=1){
+            reb_exit("WHFast/MEGNO only supports first order variational equations.");
+        }
+        if (vc.testparticle>=0){
+            reb_exit("Test particle variations not supported with WHFast. Use IAS15.");
+        }
+    }
+	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+	struct reb_particle* restrict const particles = r->particles;
+	const int N = r->N;
+	const int N_real = N-r->N_var;
+	const int jacobi = ri_whfast->coordinates==REB_WHFAST_COORDINATES_JACOBI;
+	if (!jacobi){
+		if (r->var_config_N){
+			reb_exit("Variational particles are only supported with Jacobi coordinates in WHFast.");
+		}
+		if (ri_whfast->corrector){
+			reb_warning("Symplectic correctors are only supported with Jacobi coordinates in WHFast. Correctors turned off.");
+			ri_whfast->corrector = 0;
+		}
+	}
+	if (ri_whfast->splitting!=REB_SPLITTING_LEAPFROG){
+		if (r->var_config_N){
+			reb_exit("Variational particles are only supported with the default splitting in WHFast.");
+		}
+		if (ri_whfast->corrector){
+			reb_warning("Symplectic correctors are only supported with the default splitting in WHFast. Correctors turned off.");
+			ri_whfast->corrector = 0;
+		}
+	}
+	double c[REB_SPLITTING_MAX_KICKS+1];
+	double d[REB_SPLITTING_MAX_KICKS];
+	const int n = reb_integrator_splitting_coefficients(ri_whfast->splitting, c, d);
+	r->gravity_ignore_10 = 1;
+	whfast_prepare_coordinates(r);
+	if (ri_whfast->epsilon>0.){
+		// Save coordinates for the error estimate
+		if (ri_whfast->allocated_N_save != N){
+			ri_whfast->allocated_N_save = N;
+			ri_whfast->p_j_save = realloc(ri_whfast->p_j_save,sizeof(struct reb_particle)*2*N);
 		}
+		memcpy(ri_whfast->p_j_save, ri_whfast->p_j, sizeof(struct reb_particle)*N);
 	}
 	double _dt2 = r->dt/2.;
 	if (ri_whfast->is_synchronized){
-		// First half DRIFT step
+		// First DRIFT step (half timestep for the default splitting), combined with the last drift of the corrector
 		if (ri_whfast->corrector){
-			apply_corrector(r, 1.);
+			apply_corrector(r, 1., 0., c[0]*r->dt);
+		}else{
+			whfast_drift(r, c[0]*r->dt);
 		}
-		kepler_drift(r, ri_whfast->p_j, ri_whfast->eta, r->G, _dt2, &(ri_whfast->timestep_warning), N_real);	// half timestep
 	}else{
-		// Combined DRIFT step
-		kepler_drift(r, ri_whfast->p_j, ri_whfast->eta, r->G, r->dt, &(ri_whfast->timestep_warning), N_real);	// full timestep
+		// Combined DRIFT step (full timestep for the default splitting)
+		whfast_drift(r, (c[n]+c[0])*r->dt);
 	}
 	// Prepare coordinates for KICK step
-	if (r->force_is_velocity_dependent){
-		to_inertial_posvel(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real);
-	}else{
-		to_inertial_pos(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real);
-	}
+	whfast_prepare_kick(r, d[0]*r->dt);
 	
     for (int v=0;v<r->var_config_N;v++){
         struct reb_variational_configuration const vc = r->var_config[v];
@@ -635,27 +1447,37 @@ void reb_integrator_whfast_part1(struct reb_simulation* const r){
 		ri_whfast->p_j[vc.index].y += _dt2*ri_whfast->p_j[vc.index].vy;
 		ri_whfast->p_j[vc.index].z += _dt2*ri_whfast->p_j[vc.index].vz;
 		if (r->force_is_velocity_dependent){
-			to_inertial_posvel(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real);
+			to_inertial_posvel(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
 		}else{
-			to_inertial_pos(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real);
+			to_inertial_pos(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
 		}
 	}
 
-	r->t+=_dt2;
+	// The first force evaluation happens at the time of the first stage.
+	r->t+=c[0]*r->dt;
 }
 
 void reb_integrator_whfast_synchronize(struct reb_simulation* const r){
 	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
 	const int N_real = r->N-r->N_var;
 	if (ri_whfast->is_synchronized == 0){
-		kepler_drift(r, ri_whfast->p_j, ri_whfast->eta, r->G, r->dt/2., &(ri_whfast->timestep_warning), N_real);
+		double c[REB_SPLITTING_MAX_KICKS+1];
+		double d[REB_SPLITTING_MAX_KICKS];
+		const int n = reb_integrator_splitting_coefficients(ri_whfast->splitting, c, d);
 		if (ri_whfast->corrector){
-			apply_corrector(r, -1.);
+			// Last DRIFT step combined with the first drift of the inverse corrector
+			apply_corrector(r, -1., c[n]*r->dt, 0.);
+		}else{
+			whfast_drift(r, c[n]*r->dt);
+		}
+		if (ri_whfast->coordinates!=REB_WHFAST_COORDINATES_JACOBI){
+			to_inertial_dh(r->particles, ri_whfast->p_j, ri_whfast->Mtotal, N_real, ri_whfast->N_massive, ri_whfast->coordinates==REB_WHFAST_COORDINATES_WHDS, 1);
+		}else{
+			to_inertial_posvel(r->particles, ri_whfast->p_j, ri_whfast->eta, r->particles, N_real, ri_whfast->N_massive);
 		}
-		to_inertial_posvel(r->particles, ri_whfast->p_j, ri_whfast->eta, r->particles, N_real);
         for (int v=0;v<r->var_config_N;v++){
             struct reb_variational_configuration const vc = r->var_config[v];
-			to_inertial_posvel(r->particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta,r-> particles, N_real);
+			to_inertial_posvel(r->particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta,r-> particles, N_real, ri_whfast->N_massive);
 		}
 		ri_whfast->is_synchronized = 1;
 	}
@@ -665,20 +1487,41 @@ void reb_integrator_whfast_part2(struct reb_simulation* const r){
 	struct reb_particle* restrict const particles = r->particles;
 	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
 	const int N_real = r->N-r->N_var;
-	to_jacobi_acc(particles, ri_whfast->p_j, ri_whfast->eta, particles, N_real);
-    for (int v=0;v<r->var_config_N;v++){
-        struct reb_variational_configuration const vc = r->var_config[v];
-		to_jacobi_acc(particles+vc.index, ri_whfast->p_j+vc.index, ri_whfast->eta, particles, N_real);
+	double _dt2 = r->dt/2.;
+	double c[REB_SPLITTING_MAX_KICKS+1];
+	double d[REB_SPLITTING_MAX_KICKS];
+	const int n = reb_integrator_splitting_coefficients(ri_whfast->splitting, c, d);
+	if (reb_integrator_whfast_restricted(r)){
+		// Forces have not been calculated in reb_step()
+		restricted_kick(r, d[0]*r->dt);
+	}else{
+		whfast_kick(r, d[0]*r->dt);
+	}
+	// Additional stages of higher order splittings
+	const double t_first = r->t;
+	double t_stage = 0.;
+	for (int k=1;k<n;k++){
+		whfast_drift(r, c[k]*r->dt);
+		t_stage += c[k];
+		r->t = t_first + t_stage*r->dt;
+		whfast_prepare_kick(r, d[k]*r->dt);
+		whfast_calculate_and_kick(r, d[k]*r->dt);
+	}
+	r->t = t_first;
+
+	if (ri_whfast->epsilon>0.){
+		// Last DRIFT step, followed by the error estimate
+		whfast_drift(r, c[n]*r->dt);
+		whfast_adaptive_step(r, c, d, n);
+		return;
 	}
-	interaction_step(r, ri_whfast->p_j, ri_whfast->eta, r->G, r->softening, r->dt, N_real);
 
-	double _dt2 = r->dt/2.;
 	ri_whfast->is_synchronized = 0;
 	if (ri_whfast->safe_mode){
 		reb_integrator_whfast_synchronize(r);
 	}
 	
-	r->t+=_dt2;
+	r->t+=(1.-c[0])*r->dt;
 	r->dt_last_done = r->dt;
 
 	
@@ -694,7 +1537,7 @@ void reb_integrator_whfast_part2(struct reb_simulation* const r){
             ri_whfast->p_j[index].x += _dt2*ri_whfast->p_j[index].vx;
             ri_whfast->p_j[index].y += _dt2*ri_whfast->p_j[index].vy;
             ri_whfast->p_j[index].z += _dt2*ri_whfast->p_j[index].vz;
-            to_inertial_posvel(particles_var1, ri_whfast->p_j+index, ri_whfast->eta, particles, N_real);
+            to_inertial_posvel(particles_var1, ri_whfast->p_j+index, ri_whfast->eta, particles, N_real, ri_whfast->N_massive);
             reb_calculate_acceleration_var(r);
             const double dx = particles[0].x - particles[1].x;
             const double dy = particles[0].y - particles[1].y;
@@ -739,6 +1582,9 @@ void reb_integrator_whfast_part2(struct reb_simulation* const r){
 void reb_integrator_whfast_reset(struct reb_simulation* const r){
 	struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
 	ri_whfast->corrector = 0;
+	ri_whfast->coordinates = REB_WHFAST_COORDINATES_JACOBI;
+	ri_whfast->epsilon = 0;
+	ri_whfast->min_dt = 0;
 	ri_whfast->is_synchronized = 1;
 	ri_whfast->safe_mode = 1;
 	ri_whfast->recalculate_jacobi_this_timestep = 0;
@@ -753,4 +1599,279 @@ void reb_integrator_whfast_reset(struct reb_simulation* const r){
         free(ri_whfast->eta);
         ri_whfast->eta = NULL;
     }
+	ri_whfast->allocated_N_save = 0;
+	free(ri_whfast->p_j_save);
+	ri_whfast->p_j_save = NULL;
+}
+
+/***************************** 
+ * Batched integration       */
+
+// The batched functions below work on M simulations at once. All arrays are stored with the 
+// simulation index running fastest, i.e. element k=i*M+m belongs to particle i of simulation m. 
+// The innermost loops run over simulations and are free of dependencies, so they vectorize. 
+// The operations within each simulation are carried out in the same order as in the 
+// functions above, so the results are identical to integrating each simulation on its own.
+
+// timestep_warning has one counter per simulation.
+static void kepler_drift_batch(const struct reb_simulation* const r, struct reb_particle* const p_j, const double* const eta, const double G, const double _dt, unsigned int* timestep_warning, const int N, const int M){
+	const int M_lanes = M/WHFAST_KEPLER_LANES;
+#pragma omp parallel for schedule(guided) if(N*M>WHFAST_OMP_MIN_N)
+	for (int i=1;i<N;i++){
+		for (int l=0;l<M_lanes;l++){
+			kepler_step_lanes(r, p_j, eta, G, i*M+l*WHFAST_KEPLER_LANES, _dt, timestep_warning+l*WHFAST_KEPLER_LANES, 1);
+		}
+		for (int m=M_lanes*WHFAST_KEPLER_LANES;m<M;m++){
+			kepler_step(r, p_j, eta, G, i*M+m, _dt, timestep_warning+m);
+		}
+	}
+	for (int m=0;m<M;m++){
+		p_j[m].x += _dt*p_j[m].vx;
+		p_j[m].y += _dt*p_j[m].vy;
+		p_j[m].z += _dt*p_j[m].vz;
+	}
+}
+
+static void to_inertial_pos_batch(double* const x, double* const y, double* const z, const struct reb_particle* const p_j, const double* const eta, double* const s, const int N, const int M){
+	double* const s_x = s;
+	double* const s_y = s+M;
+	double* const s_z = s+2*M;
+	const double* const Mtotal = eta+(N-1)*M;
+	for (int m=0;m<M;m++){
+		s_x[m] = p_j[m].x * Mtotal[m];
+		s_y[m] = p_j[m].y * Mtotal[m];
+		s_z[m] = p_j[m].z * Mtotal[m];
+	}
+	for (int i=N-1;i>0;i--){
+		for (int m=0;m<M;m++){
+			const int k = i*M+m;
+			const struct reb_particle pji = p_j[k];
+			const double ei = 1./eta[k];
+			s_x[m] = (s_x[m] - pji.m * pji.x) * ei;
+			s_y[m] = (s_y[m] - pji.m * pji.y) * ei;
+			s_z[m] = (s_z[m] - pji.m * pji.z) * ei;
+			x[k] = pji.x + s_x[m];
+			y[k] = pji.y + s_y[m];
+			z[k] = pji.z + s_z[m];
+			s_x[m] *= eta[k-M];
+			s_y[m] *= eta[k-M];
+			s_z[m] *= eta[k-M];
+		}
+	}
+	for (int m=0;m<M;m++){
+		const double mi = 1./eta[m];
+		x[m] = s_x[m] * mi;
+		y[m] = s_y[m] * mi;
+		z[m] = s_z[m] * mi;
+	}
+}
+
+// Direct summation with the interaction between particles 0 and 1 ignored (see gravity_ignore_10). 
+static void gravity_batch(const double* const x, const double* const y, const double* const z, double* const ax, double* const ay, double* const az, const struct reb_particle* const p_j, const double G, const double softening2, const int N, const int M){
+#pragma omp parallel for schedule(guided) if(N*M>WHFAST_OMP_MIN_N)
+	for (int i=0;i<N;i++){
+		double* const axi = ax+i*M;
+		double* const ayi = ay+i*M;
+		double* const azi = az+i*M;
+		const double* const xi = x+i*M;
+		const double* const yi = y+i*M;
+		const double* const zi = z+i*M;
+		for (int m=0;m<M;m++){
+			axi[m] = 0.;
+			ayi[m] = 0.;
+			azi[m] = 0.;
+		}
+		for (int j=0;j<N;j++){
+			if ((j==1 && i==0) || (i==1 && j==0)) continue;
+			if (i==j) continue;
+			const double* const xj = x+j*M;
+			const double* const yj = y+j*M;
+			const double* const zj = z+j*M;
+			const struct reb_particle* const pj = p_j+j*M;
+			for (int m=0;m<M;m++){
+				const double dx = xi[m] - xj[m];
+				const double dy = yi[m] - yj[m];
+				const double dz = zi[m] - zj[m];
+				const double _r = sqrt(dx*dx + dy*dy + dz*dz + softening2);
+				const double prefact = -G/(_r*_r*_r)*pj[m].m;
+				axi[m] += prefact*dx;
+				ayi[m] += prefact*dy;
+				azi[m] += prefact*dz;
+			}
+		}
+	}
+}
+
+static void to_jacobi_acc_batch(const double* const ax, const double* const ay, const double* const az, struct reb_particle* const p_j, const double* const eta, double* const s, const int N, const int M){
+	double* const s_ax = s;
+	double* const s_ay = s+M;
+	double* const s_az = s+2*M;
+	for (int m=0;m<M;m++){
+		s_ax[m] = eta[m] * ax[m];
+		s_ay[m] = eta[m] * ay[m];
+		s_az[m] = eta[m] * az[m];
+	}
+	for (int i=1;i<N;i++){
+		for (int m=0;m<M;m++){
+			const int k = i*M+m;
+			const double ei = 1./eta[k-M];
+			const double pme = eta[k]*ei;
+			p_j[k].ax = ax[k] - s_ax[m]*ei;
+			p_j[k].ay = ay[k] - s_ay[m]*ei;
+			p_j[k].az = az[k] - s_az[m]*ei;
+			s_ax[m] = s_ax[m] * pme + p_j[k].m*p_j[k].ax;
+			s_ay[m] = s_ay[m] * pme + p_j[k].m*p_j[k].ay;
+			s_az[m] = s_az[m] * pme + p_j[k].m*p_j[k].az;
+		}
+	}
+}
+
+static void interaction_step_batch(struct reb_particle* const p_j, const double* const eta, const double G, const double softening, const double _dt, const int N, const int M){
+#pragma omp parallel for schedule(guided) if(N*M>WHFAST_OMP_MIN_N)
+	for (int i=1;i<N;i++){
+		for (int m=0;m<M;m++){
+			const int k = i*M+m;
+			const struct reb_particle pji = p_j[k];
+			p_j[k].vx += _dt * pji.ax;
+			p_j[k].vy += _dt * pji.ay;
+			p_j[k].vz += _dt * pji.az;
+			if (i>1){
+				const double rj2i = 1./(pji.x*pji.x + pji.y*pji.y + pji.z*pji.z + softening*softening);
+				const double rji  = sqrt(rj2i);
+				const double rj3iM = rji*rj2i*G*eta[k];
+				const double prefac1 = _dt*rj3iM;
+				p_j[k].vx += prefac1*pji.x;
+				p_j[k].vy += prefac1*pji.y;
+				p_j[k].vz += prefac1*pji.z;
+			}
+		}
+	}
+}
+
+// Returns a description of why simulation r cannot be integrated in a batch together with r0, or NULL if it can.
+static const char* whfast_batch_unsupported(const struct reb_simulation* const r, const struct reb_simulation* const r0){
+	const struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+	if (r->integrator!=REB_INTEGRATOR_WHFAST) return "All simulations in a batch need to use WHFast.";
+	if (ri_whfast->coordinates!=REB_WHFAST_COORDINATES_JACOBI) return "Batched integrations only support Jacobi coordinates.";
+	if (ri_whfast->corrector) return "Batched integrations do not support symplectic correctors.";
+	if (ri_whfast->epsilon>0.) return "Batched integrations do not support the adaptive timestep.";
+	if (r->N_var) return "Batched integrations do not support variational particles.";
+	if (r->N_active!=-1 && r->N_active!=r->N) return "Batched integrations do not support test particles (set N_active to -1).";
+	if (r->gravity!=REB_GRAVITY_BASIC || r->nghostx || r->nghosty || r->nghostz) return "Batched integrations only support REB_GRAVITY_BASIC without ghost boxes.";
+	if (r->collision!=REB_COLLISION_NONE || r->boundary!=REB_BOUNDARY_NONE) return "Batched integrations do not support collisions or boundaries.";
+	if (r->additional_forces || r->post_timestep_modifications || r->heartbeat) return "Batched integrations do not support additional forces, post timestep modifications or heartbeat functions.";
+	if (r->exit_max_distance || r->exit_min_distance) return "Batched integrations do not support exit_max_distance or exit_min_distance.";
+	if (r->N<2 || r->N!=r0->N) return "All simulations in a batch need to have the same number of particles (at least 2).";
+	if (r->t!=r0->t || r->dt!=r0->dt) return "All simulations in a batch need to have the same time and timestep.";
+	if (r->G!=r0->G || r->softening!=r0->softening) return "All simulations in a batch need to have the same gravitational constant and softening.";
+	if (ri_whfast->splitting!=r0->ri_whfast.splitting) return "All simulations in a batch need to use the same splitting.";
+	return NULL;
+}
+
+enum REB_STATUS reb_integrate_whfast_batch(struct reb_simulation** const sims, const int M, const double tmax){
+	if (M<1){
+		return REB_EXIT_SUCCESS;
+	}
+	struct reb_simulation* const r0 = sims[0];
+	for (int m=0;m<M;m++){
+		const char* const msg = whfast_batch_unsupported(sims[m], r0);
+		if (msg){
+			reb_warning(msg);
+			return REB_EXIT_ERROR;
+		}
+	}
+	// Coordinates are set up exactly as in the first step of a non-batched integration.
+	int is_synchronized = 1;
+	for (int m=0;m<M;m++){
+		struct reb_simulation* const r = sims[m];
+		r->gravity_ignore_10 = 1;
+		whfast_prepare_coordinates(r);
+		is_synchronized &= r->ri_whfast.is_synchronized;
+		if (r->ri_whfast.N_massive!=r0->ri_whfast.N_massive){
+			reb_warning("All simulations in a batch need to have the same number of massive particles.");
+			return REB_EXIT_ERROR;
+		}
+	}
+	if (!is_synchronized){
+		for (int m=0;m<M;m++){
+			reb_integrator_whfast_synchronize(sims[m]);
+		}
+		is_synchronized = 1;
+	}
+
+	const int N = r0->N;
+	const int N_massive = r0->ri_whfast.N_massive;
+	struct reb_particle* const p_j = malloc(sizeof(struct reb_particle)*N*M);
+	double* const eta = malloc(sizeof(double)*N*M);
+	double* const buffer = malloc(sizeof(double)*(6*N*M+3*M));
+	double* const x  = buffer;
+	double* const y  = buffer+N*M;
+	double* const z  = buffer+2*N*M;
+	double* const ax = buffer+3*N*M;
+	double* const ay = buffer+4*N*M;
+	double* const az = buffer+5*N*M;
+	double* const s  = buffer+6*N*M;
+	for (int m=0;m<M;m++){
+		const struct reb_simulation_integrator_whfast* const ri_whfast = &(sims[m]->ri_whfast);
+		for (int i=0;i<N;i++){
+			p_j[i*M+m] = ri_whfast->p_j[i];
+			eta[i*M+m] = ri_whfast->eta[i];
+		}
+	}
+
+	double c[REB_SPLITTING_MAX_KICKS+1];
+	double d[REB_SPLITTING_MAX_KICKS];
+	const int n = reb_integrator_splitting_coefficients(r0->ri_whfast.splitting, c, d);
+	const double G = r0->G;
+	const double softening = r0->softening;
+	const double dt = r0->dt;
+	const double dtsign = copysign(1.,dt);
+	// Each simulation keeps its own warning counter, as in a non-batched integration.
+	unsigned int* const timestep_warning = malloc(sizeof(unsigned int)*M);
+	for (int m=0;m<M;m++){
+		timestep_warning[m] = sims[m]->ri_whfast.timestep_warning;
+	}
+	double t = r0->t;
+	while(t*dtsign<tmax*dtsign){
+		for (int k=0;k<n;k++){
+			double drift = c[k]*dt;
+			if (k==0 && !is_synchronized){
+				drift = (c[n]+c[0])*dt;
+			}
+			if (drift!=0.){
+				kepler_drift_batch(r0, p_j, eta, G, drift, timestep_warning, N, M);
+			}
+			to_inertial_pos_batch(x, y, z, p_j, eta, s, N, M);
+			gravity_batch(x, y, z, ax, ay, az, p_j, G, softening*softening, N, M);
+			to_jacobi_acc_batch(ax, ay, az, p_j, eta, s, N, M);
+			interaction_step_batch(p_j, eta, G, softening, d[k]*dt, N, M);
+		}
+		is_synchronized = 0;
+		// Same arithmetic as in reb_integrator_whfast_part1/2
+		t+=c[0]*dt;
+		t+=(1.-c[0])*dt;
+	}
+	if (!is_synchronized){
+		kepler_drift_batch(r0, p_j, eta, G, c[n]*dt, timestep_warning, N, M);
+	}
+
+	for (int m=0;m<M;m++){
+		struct reb_simulation* const r = sims[m];
+		struct reb_simulation_integrator_whfast* const ri_whfast = &(r->ri_whfast);
+		if (!is_synchronized){
+			for (int i=0;i<N;i++){
+				ri_whfast->p_j[i] = p_j[i*M+m];
+			}
+			to_inertial_posvel(r->particles, ri_whfast->p_j, ri_whfast->eta, r->particles, N, N_massive);
+			r->dt_last_done = dt;
+		}
+		ri_whfast->timestep_warning = timestep_warning[m];
+		r->t = t;
+		r->status = REB_EXIT_SUCCESS;
+	}
+	free(p_j);
+	free(eta);
+	free(buffer);
+	free(timestep_warning);
+	return REB_EXIT_SUCCESS;
 }
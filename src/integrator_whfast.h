@@ -28,4 +28,5 @@ void reb_integrator_whfast_part1(struct reb_simulation* r);		///< Internal funct
 void reb_integrator_whfast_part2(struct reb_simulation* r);		///< Internal function used to call a specific integrator
 void reb_integrator_whfast_synchronize(struct reb_simulation* r);	///< Internal function used to call a specific integrator
 void reb_integrator_whfast_reset(struct reb_simulation* r);		///< Internal function used to call a specific integrator
+int reb_integrator_whfast_restricted(const struct reb_simulation* const r);	///< Returns 1 if WHFast calculates the forces for a restricted problem itself
 #endif
@@ -61,11 +61,11 @@ int reb_output_check(struct reb_simulation* r, double interval){
 
 
 #ifdef PROFILING
-#warning PROFILING enabled. Rebound is NOT thread-safe.
-double profiling_time_sum[PROFILING_CAT_NUM];
-double profiling_time_initial   = 0;
-double profiling_timing_initial = 0;
-double profiling_time_final     = 0;
+// Timings are accumulated per thread, so that simulations running on different threads do not interfere.
+static __thread double profiling_time_sum[PROFILING_CAT_NUM];
+static __thread double profiling_time_initial   = 0;
+static __thread double profiling_timing_initial = 0;
+static __thread double profiling_time_final     = 0;
 void profiling_start(void){
     struct timeval tim;
     gettimeofday(&tim, NULL);
@@ -259,6 +259,12 @@ void reb_output_binary(struct reb_simulation* r, char* filename){
         reb_save_dp7(&(r->ri_ias15.br) ,N3,of);
         reb_save_dp7(&(r->ri_ias15.er) ,N3,of);
     }
+    // Output levels and timesteps of the IAS15 block timestepping
+    if (r->ri_ias15.block_allocatedN){
+        int N = r->ri_ias15.block_allocatedN;
+        fwrite(r->ri_ias15.block_level,sizeof(int),N,of);
+        fwrite(r->ri_ias15.block_dt,sizeof(double),N,of);
+    }
     fclose(of);
 }
 
@@ -57,6 +57,7 @@ static void reb_add_local(struct reb_simulation* const r, struct reb_particle pt
 
 	r->particles[r->N] = pt;
 	r->particles[r->N].sim = r;
+	r->softsphere.particles_changed++;
 	if (r->gravity==REB_GRAVITY_TREE || r->collision==REB_COLLISION_TREE){
 		reb_tree_add_particle_to_tree(r, r->N);
 	}
@@ -120,6 +121,7 @@ void reb_remove_all(struct reb_simulation* const r){
 	r->allocatedN 	= 0;
 	r->N_active 	= -1;
 	r->N_var 	= 0;
+	r->softsphere.particles_changed++;
 	free(r->particles);
 	r->particles 	= NULL;
 }
@@ -152,6 +154,7 @@ int reb_remove(struct reb_simulation* const r, int index, int keepSorted){
     }
 	if (r->N==1){
 	    r->N = 0;
+		r->softsphere.particles_changed++;
 		fprintf(stderr, "Last particle removed.\n");
 		return 1;
 	}
@@ -184,10 +187,79 @@ int reb_remove(struct reb_simulation* const r, int index, int keepSorted){
 		    r->particles[index] = r->particles[r->N];
         }
 	}
+	r->softsphere.particles_changed++;
 
 	return 1;
 }
 
+int reb_remove_marked(struct reb_simulation* const r, const int* const remove, const int N_remove){
+	if (r->N_var){
+		fprintf(stderr, "\nRemoving particles not supported when calculating MEGNO.  Did not remove particle.\n");
+		return 0;
+	}
+	if (r->tree_root){
+		fprintf(stderr, "\nREBOUND cannot remove a particle a tree and keep the particles sorted. Did not remove particle.\n");
+		return 0;
+	}
+	const int N_mark = (N_remove<r->N)?N_remove:r->N;
+	if (r->ri_hermes.global){
+		// This is a mini simulation. Need to remove particles from two simulations.
+		struct reb_simulation* global = r->ri_hermes.global;
+		int* const global_index = global->ri_hermes.global_index_from_mini_index;
+		int* const is_in_mini = global->ri_hermes.is_in_mini;
+		const int N_global = global->N;
+		const int N_active_global = global->N_active;
+		// Flag particles in global, then compact global particles and is_in_mini in one pass.
+		int* global_remove = calloc(N_global,sizeof(int));
+		for (int k=0;k<N_mark;k++){
+			if (remove[k]) global_remove[global_index[k]] = 1;
+		}
+		// global_remove[j] becomes the new index of particle j in global.
+		int j_new = 0;
+		for (int j=0;j<N_global;j++){
+			const int removed = global_remove[j];
+			if (!removed){
+				global->particles[j_new] = global->particles[j];
+				is_in_mini[j_new] = is_in_mini[j];
+			}else if (j<N_active_global){
+				global->N_active--;
+			}
+			global_remove[j] = j_new;
+			j_new += !removed;
+		}
+		global->N = j_new;
+		// Compact and renumber the mini to global map in one pass.
+		int k_new = 0;
+		for (int k=0;k<global->ri_hermes.global_index_from_mini_index_N;k++){
+			if (k<N_mark && remove[k]) continue;
+			global_index[k_new] = global_remove[global_index[k]];
+			k_new++;
+		}
+		global->ri_hermes.global_index_from_mini_index_N = k_new;
+		free(global_remove);
+	}
+	int i_new = 0;
+	const int N_active = r->N_active;
+	for (int i=0;i<r->N;i++){
+		if (i<N_mark && remove[i]){
+			if (i<N_active){
+				r->N_active--;
+			}
+			continue;
+		}
+		if (i_new!=i){
+			r->particles[i_new] = r->particles[i];
+		}
+		i_new++;
+	}
+	if (i_new==0 && r->N>0){
+		fprintf(stderr, "Last particle removed.\n");
+	}
+	r->N = i_new;
+	r->softsphere.particles_changed++;
+	return 1;
+}
+
 int reb_remove_by_hash(struct reb_simulation* const r, uint32_t hash, int keepSorted){
     struct reb_particle* p = reb_get_particle_by_hash(r, hash);
     if(p == NULL){
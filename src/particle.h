@@ -41,4 +41,17 @@ int reb_get_rootbox_for_particle(const struct reb_simulation* const r, struct re
  * @param r REBOUND simulation to be considered.
  */
 void reb_update_particle_lookup_table(struct reb_simulation* const r);
+
+/**
+ * @brief Removes all flagged particles in a single pass and keeps the remaining particles sorted.
+ * @details This is equivalent to calling reb_remove() with keepSorted=1 for every flagged
+ * particle, but shifts each particle at most once. If r is a HERMES mini simulation,
+ * the particles are also removed from the global simulation and the is_in_mini and 
+ * global_index_from_mini_index arrays are compacted accordingly.
+ * @param r REBOUND simulation to be considered.
+ * @param remove Array of flags, particle i is removed if remove[i] is non-zero.
+ * @param N_remove Length of remove. Particles with an index >= N_remove are kept.
+ * @return 1 if particles were removed, 0 otherwise.
+ */
+int reb_remove_marked(struct reb_simulation* const r, const int* const remove, const int N_remove);
 #endif // _PARTICLE_H
@@ -65,7 +65,8 @@ static const char* logo[];              /**< Logo of rebound. */
 const char* reb_build_str = __DATE__ " " __TIME__;  // Date and time build string. 
 const char* reb_version_str = "2.18.7";         // **VERSIONLINE** This line gets updated automatically. Do not edit manually.
 
-void reb_step(struct reb_simulation* const r){
+// Timestep with separate passes for the integrator, the tree and the force calculation.
+static void reb_step_split(struct reb_simulation* const r){
     // A 'DKD'-like integrator will do the first 'D' part.
     PROFILING_START()
     reb_integrator_part1(r);
@@ -104,18 +105,35 @@ void reb_step(struct reb_simulation* const r){
 #endif // MPI
     }
 
-    // Calculate accelerations. 
-    reb_calculate_acceleration(r);
-    if (r->N_var){
-        reb_calculate_acceleration_var(r);
+    // Calculate accelerations. WHFast calculates them itself for restricted problems.
+    if (!reb_integrator_whfast_restricted(r)){
+        reb_calculate_acceleration(r);
+        if (r->collision==REB_COLLISION_SOFTSPHERE){
+            reb_collision_softsphere_forces(r);
+        }
+        if (r->N_var){
+            reb_calculate_acceleration_var(r);
+        }
+        // Calculate non-gravity accelerations. 
+        if (r->additional_forces) r->additional_forces(r);
     }
-    // Calculate non-gravity accelerations. 
-    if (r->additional_forces) r->additional_forces(r);
     PROFILING_STOP(PROFILING_CAT_GRAVITY)
 
     // A 'DKD'-like integrator will do the 'KD' part.
     PROFILING_START()
     reb_integrator_part2(r);
+    PROFILING_STOP(PROFILING_CAT_INTEGRATOR)
+}
+
+void reb_step(struct reb_simulation* const r){
+    // Leapfrog and SEI do the entire step in a single pass over most particles if possible.
+    PROFILING_START()
+    const int fused = reb_integrator_fused_step(r);
+    PROFILING_STOP(PROFILING_CAT_INTEGRATOR)
+    if (!fused){
+        reb_step_split(r);
+    }
+    PROFILING_START()
     if (r->post_timestep_modifications){
         reb_integrator_synchronize(r);
         r->post_timestep_modifications(r);
@@ -126,7 +144,10 @@ void reb_step(struct reb_simulation* const r){
     // Do collisions here. We need both the positions and velocities at the same time.
     // Check for root crossings.
     PROFILING_START()
-    reb_boundary_check(r);     
+    // SEI already shifts particles back into a shearing sheet box in reb_integrator_sei_part2() and reb_integrator_sei_fused_step().
+    if (r->integrator!=REB_INTEGRATOR_SEI || r->boundary!=REB_BOUNDARY_SHEAR || r->post_timestep_modifications){
+        reb_boundary_check(r);     
+    }
     if (r->tree_needs_update){
         // Update tree (this will remove particles which left the box)
         reb_tree_update(r);          
@@ -205,25 +226,45 @@ void reb_free_simulation(struct reb_simulation* const r){
 void reb_free_pointers(struct reb_simulation* const r){
     reb_tree_delete(r);
     free(r->gravity_cs  );
+    free(r->gravity_var_geometry);
     free(r->collisions  );
+    reb_collision_softsphere_reset(r);
+    reb_collision_bvh_reset(r);
+    free(r->ghostbox_table);
     reb_integrator_wh_reset(r);
     reb_integrator_whfast_reset(r);
     reb_integrator_ias15_reset(r);
     free(r->particles   );
     free(r->particle_lookup_table);
+    free(r->var_config);
 }
 
 void reb_reset_temporary_pointers(struct reb_simulation* const r){
     // Note: this will not clear the particle array.
     r->gravity_cs_allocatedN    = 0;
     r->gravity_cs           = NULL;
+    r->gravity_var_geometry_allocatedN = 0;
+    r->gravity_var_geometry = NULL;
     r->collisions_allocatedN    = 0;
     r->collisions           = NULL;
+    r->softsphere.pairs_allocatedN  = 0;
+    r->softsphere.pairs_N           = 0;
+    r->softsphere.pairs             = NULL;
+    r->softsphere.x0_allocatedN     = 0;
+    r->softsphere.x0                = NULL;
+    r->bvh_nodes_allocatedN     = 0;
+    r->bvh_nodes_N              = 0;
+    r->bvh_nodes                = NULL;
+    r->bvh_N                    = 0;
+    r->ghostbox_table_allocatedN    = 0;
+    r->ghostbox_table               = NULL;
     r->extras               = NULL;
     // ********** WHFAST
     r->ri_whfast.allocated_N    = 0;
     r->ri_whfast.eta        = NULL;
     r->ri_whfast.p_j        = NULL;
+    r->ri_whfast.allocated_N_save = 0;
+    r->ri_whfast.p_j_save   = NULL;
     // ********** IAS15
     r->ri_ias15.allocatedN      = 0;
     set_dp7_null(&(r->ri_ias15.g));
@@ -240,20 +281,35 @@ void reb_reset_temporary_pointers(struct reb_simulation* const r){
     r->ri_ias15.csv         = NULL;
     r->ri_ias15.csa0        = NULL;
     r->ri_ias15.at          = NULL;
+    r->ri_ias15.block_allocatedN    = 0;
+    r->ri_ias15.block_level         = NULL;
+    r->ri_ias15.block_level_next    = NULL;
+    r->ri_ias15.block_active        = NULL;
+    r->ri_ias15.block_dt            = NULL;
+    r->ri_ias15.block_save          = NULL;
+    r->ri_ias15.block_rec_allocatedN= 0;
+    r->ri_ias15.block_rec           = NULL;
     // ********** WH
     r->ri_wh.allocatedN         = 0;
     r->ri_wh.eta            = NULL;
+    r->ri_wh.mu             = NULL;
     // ********** HERMES
     r->ri_hermes.mini      = NULL;
     r->ri_hermes.global    = NULL;
     r->ri_hermes.global_index_from_mini_index = NULL;
     r->ri_hermes.global_index_from_mini_index_N = 0;
     r->ri_hermes.global_index_from_mini_index_Nmax = 0;
+    r->ri_hermes.mini_index_old = NULL;
+    r->ri_hermes.mini_index_old_Nmax = 0;
     r->ri_hermes.is_in_mini = NULL;
     r->ri_hermes.is_in_mini_Nmax = 0;
     r->ri_hermes.a_Nmax = 0;
     r->ri_hermes.a_i = NULL;
     r->ri_hermes.a_f = NULL;
+    r->ri_hermes.rhill = NULL;
+    r->ri_hermes.rhill_Nmax = 0;
+    r->ri_hermes.grid = NULL;
+    r->ri_hermes.grid_Nmax = 0;
 }
 
 int reb_reset_function_pointers(struct reb_simulation* const r){
@@ -322,11 +378,26 @@ void reb_init_simulation(struct reb_simulation* r){
     r->gravity_ignore_10    = 0;
     r->calculate_megno  = 0;
     r->output_timing_last   = -1;
+    {
+        // The address makes the seed differ for simulations created at the same time on different threads.
+        struct timeval tim;
+        gettimeofday(&tim, NULL);
+        r->rand_seed = tim.tv_usec + getpid() + (unsigned int)(uintptr_t)r;
+    }
+    r->rand_counter = 0;
 
     r->minimum_collision_velocity = 0;
     r->collisions_plog  = 0;
     r->collisions_Nlog  = 0;    
     r->collision_resolve_keep_sorted  = 0;    
+    r->softsphere.k     = 0;
+    r->softsphere.gamma = 0;
+    r->softsphere.skin  = 0;
+    r->softsphere.rebuilds_N = 0;
+    r->softsphere.N_last = 0;
+    r->softsphere.shift0 = 0;
+    r->softsphere.particles_changed = 0;
+    r->softsphere.particles_changed_last = 0;
     
     // Default modules
     r->integrator   = REB_INTEGRATOR_IAS15;
@@ -340,6 +411,10 @@ void reb_init_simulation(struct reb_simulation* r){
     // the defaults below are chosen to safeguard the user against spurious results, but
     // will be slower and less accurate
     r->ri_whfast.corrector = 0;
+    r->ri_whfast.splitting = REB_SPLITTING_LEAPFROG;
+    r->ri_whfast.coordinates = REB_WHFAST_COORDINATES_JACOBI;
+    r->ri_whfast.epsilon = 0;
+    r->ri_whfast.min_dt = 0;
     r->ri_whfast.safe_mode = 1;
     r->ri_whfast.recalculate_jacobi_this_timestep = 0;
     r->ri_whfast.is_synchronized = 1;
@@ -350,7 +425,12 @@ void reb_init_simulation(struct reb_simulation* r){
     r->ri_ias15.epsilon         = 1e-9;
     r->ri_ias15.min_dt      = 0;
     r->ri_ias15.epsilon_global  = 1;
+    r->ri_ias15.block_levels    = 0;
     r->ri_ias15.iterations_max_exceeded = 0;    
+    r->ri_ias15.block_unsupported = 0;
+    
+    // ********** LEAPFROG
+    r->ri_leapfrog.splitting = REB_SPLITTING_LEAPFROG;
     
     // ********** SEI
     r->ri_sei.OMEGA     = 1;
@@ -52,6 +52,28 @@ enum REB_STATUS {
     REB_EXIT_USER = 5,      ///< User caused exit, simulation did not finish successfully.
 };
 
+/**
+ * @brief Enumeration of the splitting schemes available for the LEAPFROG and WHFast integrators.
+ * @details All schemes are symmetric sequences of drift and kick steps and reuse the 
+ * drift and kick operators of the integrator. Every kick after the first one requires 
+ * an additional force evaluation. The Yoshida (1990) schemes are compositions of the 
+ * second order scheme and work for any splitting. The SABA and SBAB schemes of 
+ * Laskar & Robutel (2001) are designed for near-integrable problems, such as WHFast 
+ * with small planet masses, where they remove all error terms of order epsilon*dt^n.
+ */
+enum REB_SPLITTING {
+    REB_SPLITTING_LEAPFROG = 0, ///< Second order drift-kick-drift scheme (default)
+    REB_SPLITTING_YOSHIDA4 = 1, ///< Fourth order composition, 3 kicks
+    REB_SPLITTING_YOSHIDA6 = 2, ///< Sixth order composition (solution A), 7 kicks
+    REB_SPLITTING_YOSHIDA8 = 3, ///< Eighth order composition (solution D), 15 kicks
+    REB_SPLITTING_SABA2 = 4,    ///< SABA2, 2 kicks
+    REB_SPLITTING_SABA3 = 5,    ///< SABA3, 3 kicks
+    REB_SPLITTING_SABA4 = 6,    ///< SABA4, 4 kicks
+    REB_SPLITTING_SBAB2 = 7,    ///< SBAB2 (kick-drift-kick), 3 kicks
+    REB_SPLITTING_SBAB3 = 8,    ///< SBAB3 (kick-drift-kick), 4 kicks
+    REB_SPLITTING_SBAB4 = 9,    ///< SBAB4 (kick-drift-kick), 5 kicks
+};
+
 struct reb_simulation;
 
 /**
@@ -170,6 +192,20 @@ struct reb_simulation_integrator_ias15 {
      **/
     unsigned int epsilon_global;
 
+    /** 
+     * @brief Number of power-of-two timestep levels used by IAS15.
+     * @details If set to a value larger than 1, IAS15 uses hierarchical block timesteps. 
+     * The timestep dt is then the length of one block. Each particle advances with a 
+     * timestep dt/2^l, where its level l is chosen from its own error estimate and 
+     * can take values from 0 to block_levels-1. Forces are only calculated on the 
+     * particles that are active on a given level. Particles on other levels are 
+     * predicted (coarser levels) or interpolated (finer levels) at the substeps. 
+     * Only supported for REB_GRAVITY_BASIC or REB_GRAVITY_NONE without ghost boxes, 
+     * variational particles, MEGNO or soft-sphere collisions. Otherwise, a global 
+     * timestep is used until block timesteps are supported again. The default is 0 
+     * (one global timestep).
+     **/
+    unsigned int block_levels;
 
     
     /**
@@ -181,6 +217,11 @@ struct reb_simulation_integrator_ias15 {
      */
     unsigned long iterations_max_exceeded;
 
+    /**
+     * @brief Counter how many steps used a global timestep because block timesteps are not supported.
+     */
+    unsigned long block_unsupported;
+
 
 
     int allocatedN;             ///< Size of allocated arrays.
@@ -201,6 +242,15 @@ struct reb_simulation_integrator_ias15 {
     // The following values are used for resetting the b and e coefficients if a timestep gets rejected
     struct reb_dp7 br;
     struct reb_dp7 er;
+
+    int block_allocatedN;       ///< Size of allocated block timestep arrays.
+    int* block_level;           ///< Timestep level of each particle
+    int* block_level_next;      ///< Timestep level of each particle after the current tick
+    int* block_active;          ///< Indices of particles active on each level during the current tick
+    double* block_dt;           ///< Timestep each particle would like to take next
+    double* block_save;         ///< State at the beginning of the block, used if the block gets rejected
+    double* block_rec;          ///< Positions and velocities of finer particles at the substeps of coarser levels
+    int block_rec_allocatedN;   ///< Size of allocated block_rec array
     /**
      * @endcond
      */
@@ -218,11 +268,12 @@ struct reb_simulation_integrator_hermes {
     
     int mini_active;                        ///< Flag that is set to 1 by HERMES if the mini simulation is active in this timestep.
     int collision_this_global_dt;           
-    double energy_before_timestep;            ///< Store energy at the beginning of timestep. Used to track energy_offset.
     
     int* global_index_from_mini_index;
     int global_index_from_mini_index_N;
     int global_index_from_mini_index_Nmax;
+    int* mini_index_old;                    ///< Scratch space used to match the particles of the mini simulation with those of the previous timestep.
+    int mini_index_old_Nmax;
     
     int* is_in_mini;
     int is_in_mini_Nmax;
@@ -231,6 +282,11 @@ struct reb_simulation_integrator_hermes {
     double* a_f;
     int a_Nmax;
     
+    double* rhill;                          ///< Hill radii of all particles, calculated during encounter detection.
+    int rhill_Nmax;
+    int* grid;                              ///< Spatial hash of the massive particles used during encounter detection.
+    int grid_Nmax;
+    
     int timestep_too_large_warning;
     unsigned long long steps;
     unsigned long long steps_miniactive;
@@ -259,6 +315,21 @@ struct reb_simulation_integrator_sei {
     /** @endcond */
 };
 
+/**
+ * @brief This structure contains variables used by the LEAPFROG integrator.
+ */
+struct reb_simulation_integrator_leapfrog {
+    /**
+     * @brief Splitting scheme used by the LEAPFROG integrator.
+     * @details The default is the standard second order drift-kick-drift scheme.
+     * Use REB_SPLITTING_YOSHIDA4, REB_SPLITTING_YOSHIDA6 or REB_SPLITTING_YOSHIDA8 
+     * for a higher order scheme. A higher order scheme with a larger timestep is 
+     * usually more efficient than the second order scheme with a small timestep. 
+     * Higher order schemes are not supported with tree gravity or tree collisions.
+     */
+    enum REB_SPLITTING splitting;
+};
+
 /**
  * @brief This structure contains variables used by the WH integrator.
  * @details Nothing needs to be changed by the user. All the variables are just for internal use.
@@ -270,6 +341,7 @@ struct reb_simulation_integrator_wh {
      */
     int allocatedN;
     double* eta;
+    double* mu;
     /** @endcond */
 };
 
@@ -285,6 +357,10 @@ struct reb_simulation_integrator_whfast {
      * - 5: uses fifth order (four-stage) corrector 
      * - 7: uses seventh order (six-stage) corrector 
      * - 11: uses eleventh order (ten-stage) corrector 
+     * 
+     * The corrector and its inverse are only applied when the particles get synchronized.
+     * With safe_mode set to 0, the cost of the corrector is therefore only incurred 
+     * when outputs are needed, not every timestep.
      */
     unsigned int corrector;
 
@@ -309,9 +385,62 @@ struct reb_simulation_integrator_whfast {
      */
     unsigned int safe_mode;
 
+    /**
+     * @brief Splitting scheme used by WHFast. 
+     * @details The default is the standard second order Wisdom-Holman scheme. 
+     * The higher order SABA and SBAB schemes are well suited for planetary systems.
+     * Symplectic correctors and variational particles are only supported with the 
+     * default scheme.
+     */
+    enum REB_SPLITTING splitting;
+
+    /**
+     * @brief Coordinate system used by WHFast.
+     * @details Democratic heliocentric coordinates use heliocentric positions and
+     * barycentric velocities. Every particle then moves on a Kepler orbit around the
+     * central object alone and the interaction step only includes forces between
+     * particles other than the central object. The WHDS coordinates (Hernandez & Dehnen 2017)
+     * split the kinetic energy such that each Kepler step solves the two body problem
+     * of the central object and one particle exactly. Both are well suited for
+     * simulations in which the order of the particles in terms of their distance
+     * to the central object changes. Symplectic correctors and variational
+     * particles are only supported with Jacobi coordinates. The coordinates should
+     * only be changed while the simulation is synchronized.
+     */
+    enum {
+        REB_WHFAST_COORDINATES_JACOBI = 0,                  ///< Jacobi coordinates (default)
+        REB_WHFAST_COORDINATES_DEMOCRATICHELIOCENTRIC = 1,  ///< Democratic heliocentric coordinates
+        REB_WHFAST_COORDINATES_WHDS = 2,                    ///< WHDS coordinates (Hernandez & Dehnen 2017)
+        } coordinates;
+
+    /**
+     * @brief Accuracy parameter of the adaptive timestep.
+     * @details The default value 0 uses the fixed timestep dt. If set to a positive value,
+     * WHFast estimates the error of every step by step doubling: the result of one step with dt 
+     * is compared to that of two steps with dt/2, relative to the Jacobi (or heliocentric) 
+     * positions and velocities. Steps with an error above epsilon get rejected and repeated 
+     * with a smaller timestep. Accepted steps continue from the more accurate result of the 
+     * two half steps and dt is adjusted for the next step. This requires three times as many 
+     * force evaluations per step and the particles are synchronized after every step. 
+     * Note that the integrator is then neither symplectic nor time-reversible. 
+     * Symplectic correctors and variational particles are not supported.
+     * If the error estimate is not finite or the timestep underflows, a warning is issued 
+     * and the step is taken with the old timestep.
+     */
+    double epsilon;
+
+    /**
+     * @brief The minimum allowed timestep if epsilon is positive.
+     * @details The default value is 0 (no minimal timestep).
+     */
+    double min_dt;
+
     /**
      * @brief Jacobi coordinates
      * @details This array contains the Jacobi coordinates of all particles.
+     * If coordinates is not set to REB_WHFAST_COORDINATES_JACOBI, it contains
+     * the heliocentric positions and the corresponding velocities instead.
+     * The first element then contains the position and velocity of the centre of mass.
      * It is automatically filled and updated by WHfast.
      * Access this array with caution.
      */
@@ -321,13 +450,16 @@ struct reb_simulation_integrator_whfast {
      * @cond PRIVATE
      * Internal data structures below. Nothing to be changed by the user.
      */
-    double* restrict eta;       ///< Struct containg Jacobi eta parameters 
+    double* restrict eta;       ///< Struct containg Jacobi eta parameters (the mass of the central object in the Kepler step for other coordinates)
     double Mtotal;          ///< Total mass, used for Jacobi coordinates 
 
     unsigned int is_synchronized;   ///< Flag to determine if current particle structure is synchronized
     unsigned int allocated_N;   ///< Space allocated in arrays
     unsigned int timestep_warning;  ///< Counter of timestep warnings
     unsigned int recalculate_jacobi_but_not_synchronized_warning;   ///< Counter of Jacobi synchronization errors
+    unsigned int N_massive;     ///< Number of particles before the trailing massless particles, which do not change the Jacobi centres of mass
+    struct reb_particle* restrict p_j_save; ///< Coordinates at the beginning of the step and after one full step (adaptive timestep only)
+    unsigned int allocated_N_save;  ///< Space allocated in p_j_save
     /**
      * @endcond
      */
@@ -350,6 +482,60 @@ struct reb_collision{
     int ri;         ///< Index of rootcell (needed for MPI only).
 };
 
+struct reb_softsphere_pair;
+struct reb_bvh_node;
+
+/**
+ * @brief This structure contains variables used by the soft-sphere contact model.
+ * @details Particles which overlap feel a linear spring-dashpot force along the line 
+ * connecting their centres. Contacts are found using a Verlet neighbour list which 
+ * includes all pairs closer than the sum of their radii plus the skin distance. The 
+ * list is only rebuilt once particles have moved far enough to possibly create new contacts.
+ * The contact model is enabled by setting collision to REB_COLLISION_SOFTSPHERE.
+ * If IAS15 is used, force_is_velocity_dependent needs to be set to 1 when gamma is non-zero.
+ */
+struct reb_simulation_collision_softsphere {
+    /**
+     * @brief Spring constant k of the contact force (default: 0).
+     * @details The repulsive force is k times the overlap of the two particles.
+     */
+    double k;
+
+    /**
+     * @brief Damping coefficient gamma of the contact force (default: 0).
+     * @details The damping force is gamma times the relative normal velocity.
+     * gamma has units of mass over time. 
+     */
+    double gamma;
+
+    /**
+     * @brief Skin distance of the neighbour list (default: 0). 
+     * @details Larger values result in fewer neighbour list rebuilds but 
+     * more pairs to check every timestep. With the default of 0 the list 
+     * is rebuilt every timestep.
+     */
+    double skin;
+
+    long rebuilds_N;        ///< Number of times the neighbour list has been rebuilt.
+    
+    /**
+     * @cond PRIVATE
+     * Internal data structures below. Nothing to be changed by the user.
+     */
+    struct reb_softsphere_pair* pairs;  ///< Neighbour list.
+    int pairs_N;                        ///< Number of pairs in the neighbour list.
+    int pairs_allocatedN;               ///< Size allocated for pairs.
+    struct reb_vec3d* x0;               ///< Particle positions at last rebuild.
+    int x0_allocatedN;                  ///< Size allocated for x0.
+    int N_last;                         ///< Number of particles at last rebuild.
+    double shift0;                      ///< Ghostbox shift at last rebuild (only changes for shearing sheet).
+    unsigned long particles_changed;    ///< Incremented whenever particles are added or removed.
+    unsigned long particles_changed_last;   ///< Value of particles_changed at last rebuild.
+    /**
+     * @endcond
+     */
+};
+
 /**
  * @brief Holds a particle's hash and the particle's index in the particles array.
  * @details This structure is used for the simulation's particle_lookup_table.
@@ -384,6 +570,13 @@ struct reb_variational_configuration{
  * @details This structure contains all variables, status flags and pointers of one 
  * REBOUND simulation. To create a REBOUND simulation use the reb_create_simulation()
  * function. This will ensure that all variables and pointers are initialized correctly.
+ *
+ * Simulations do not share any state with each other. Different simulations can therefore 
+ * be created, integrated and freed concurrently on different threads of the same process, 
+ * as long as each simulation is only used by one thread at a time. Exceptions are builds 
+ * with MPI or OpenGL visualization, reb_random_uniform(), reb_random_powerlaw(), reb_random_normal(), 
+ * reb_random_rayleigh() and the reb_random_sim functions called without a simulation, 
+ * which draw from the global random number generator of the C library. 
  */
 struct reb_simulation {
     /**
@@ -409,6 +602,8 @@ struct reb_simulation {
     struct reb_particle* particles; ///< Main particle array. This contains all particles on this node.  
     struct reb_vec3d* gravity_cs;   ///< Vector containing the information for compensated gravity summation 
     int     gravity_cs_allocatedN;  ///< Current number of allocated space for cs array
+    double* gravity_var_geometry;   ///< Pairwise geometry shared by all variational particles
+    int     gravity_var_geometry_allocatedN;  ///< Current number of particle pairs allocated in gravity_var_geometry
     struct reb_treecell** tree_root;///< Pointer to the roots of the trees. 
     int     tree_needs_update;      ///< Flag to force a tree update (after boundary check)
     double opening_angle2;          ///< Square of the cell opening angle \f$ \theta \f$. 
@@ -423,6 +618,8 @@ struct reb_simulation {
     double usleep;                  ///< Wait this number of microseconds after each timestep, useful for slowing down visualization. Set to negative value to disable visualization (despite compiling with OPENGL=1).  
     int track_energy_offset;        ///< Track energy change during collisions and ejections (default: 0).
     double energy_offset;           ///< Energy offset due to collisions and ejections (only calculated if track_energy_offset=1).
+    unsigned int rand_seed;         ///< Seed of the random number generator of this simulation (see reb_random_sim_uniform()). Set from the time, process id and address in reb_init_simulation(). Set to a fixed value for reproducible runs.
+    uint64_t rand_counter;          ///< Number of random numbers drawn from the generator of this simulation so far.
     /** @} */
 
     /**
@@ -439,6 +636,15 @@ struct reb_simulation {
     int     nghostx;        ///< Number of ghostboxes in x direction. 
     int     nghosty;        ///< Number of ghostboxes in y direction. 
     int     nghostz;        ///< Number of ghostboxes in z direction. 
+    /**
+     * @cond PRIVATE
+     * Internal data structures below. Nothing to be changed by the user.
+     */
+    struct reb_ghostbox* ghostbox_table;    ///< Precalculated ghostboxes, see reb_boundary_get_ghostbox_table().
+    int     ghostbox_table_allocatedN;      ///< Size allocated for ghostbox_table.
+    /**
+     * @endcond
+     */
     /** @} */
 #ifdef MPI
     /**
@@ -476,6 +682,19 @@ struct reb_simulation {
     double collisions_plog;             ///< Keep track of momentum exchange (used to calculate collisional viscosity in ring systems.
     double max_radius[2];               ///< Two largest particle radii, set automatically, needed for collision search.
     long collisions_Nlog;               ///< Keep track of number of collisions. 
+    struct reb_simulation_collision_softsphere softsphere;  ///< The soft-sphere contact model struct.
+    /**
+     * @cond PRIVATE
+     * Bounding volume hierarchy used by REB_COLLISION_BVH. Nothing to be changed by the user.
+     */
+    struct reb_bvh_node* bvh_nodes;     ///< Nodes of the bounding volume hierarchy.
+    int bvh_nodes_N;                    ///< Number of nodes in use.
+    int bvh_nodes_allocatedN;           ///< Size allocated for bvh_nodes.
+    int bvh_N;                          ///< Number of particles at last rebuild.
+    double bvh_area;                    ///< Summed surface area of internal nodes at last rebuild.
+    /**
+     * @endcond
+     */
     /** @} */
 
     /**
@@ -503,6 +722,8 @@ struct reb_simulation {
         REB_COLLISION_NONE = 0,     ///< Do not search for collisions (default)
         REB_COLLISION_DIRECT = 1,   ///< Direct collision search O(N^2)
         REB_COLLISION_TREE = 2,     ///< Tree based collision search O(N log(N))
+        REB_COLLISION_SOFTSPHERE = 3,   ///< Soft-sphere (spring-dashpot) contact forces using a Verlet neighbour list
+        REB_COLLISION_BVH = 4,      ///< Collision search using a bounding volume hierarchy over swept particle bounding boxes O(N log(N))
         } collision;
     /**
      * @brief Available integrators
@@ -548,6 +769,7 @@ struct reb_simulation {
     struct reb_simulation_integrator_whfast ri_whfast;  ///< The WHFast struct 
     struct reb_simulation_integrator_ias15 ri_ias15;    ///< The IAS15 struct
     struct reb_simulation_integrator_hermes ri_hermes;    ///< The HERMES struct
+    struct reb_simulation_integrator_leapfrog ri_leapfrog;  ///< The LEAPFROG struct
     /** @} */
 
     /**
@@ -634,6 +856,31 @@ void reb_step(struct reb_simulation* const r);
  */
 enum REB_STATUS reb_integrate(struct reb_simulation* const r, double tmax);
 
+/**
+ * @brief Integrates several small simulations in lockstep with WHFast
+ * @details This function advances M independent simulations together from their common 
+ * current time until time tmax. The state of all simulations is stored in one set of arrays 
+ * with the simulation index running fastest, so that every operation of the WHFast step 
+ * (Kepler drift, coordinate transformations, gravity and kick) is carried out by one loop over 
+ * all simulations. For systems with few particles this is considerably faster than calling 
+ * reb_integrate() for each simulation, for example when integrating an ensemble of planetary systems.
+ *
+ * All simulations need to use WHFast with Jacobi coordinates and no symplectic corrector, 
+ * REB_GRAVITY_BASIC without ghost boxes, no collisions, boundaries, variational particles, 
+ * additional forces, post timestep modifications, heartbeat or exit conditions. They need to 
+ * have the same number of particles and massive particles, the same time, timestep, 
+ * gravitational constant, softening and splitting. Masses and orbits can differ. 
+ *
+ * The integration behaves like reb_integrate() with safe_mode=0 and exact_finish_time=0: 
+ * the last timestep may overshoot tmax, and the particles are synchronized at the end. 
+ * The results are identical to integrating each simulation on its own in this way.
+ * @param sims Array of pointers to the M simulations.
+ * @param M Number of simulations.
+ * @param tmax The time to be integrated to.
+ * @return REB_EXIT_SUCCESS, or REB_EXIT_ERROR if the simulations cannot be integrated in a batch.
+ */
+enum REB_STATUS reb_integrate_whfast_batch(struct reb_simulation** const sims, const int M, const double tmax);
+
 /**
  * @brief Synchronize particles manually at end of timestep
  * @details This function should be called if the WHFAST integrator
@@ -791,6 +1038,8 @@ int reb_collision_resolve_hardsphere(struct reb_simulation* const r, struct reb_
  * @brief Merging collision resolving routine.
  * @details Merges particle with higher index into particle of lower index.
  *          Conserves mass, momentum and volume. Compatible with HERMES. 
+ *          If track_energy_offset is set, the energy lost in the merger is added 
+ *          to energy_offset, for all integrators.
  */
 int reb_collision_resolve_merge(struct reb_simulation* const r, struct reb_collision c);
 
@@ -807,6 +1056,8 @@ int reb_collision_resolve_merge(struct reb_simulation* const r, struct reb_colli
  */
 /**
  * @brief Return uniformly distributed random variable in a given range.
+ * @details Uses the generator of the C library, which is not thread-safe. 
+ * See reb_random_sim_uniform() for a generator that belongs to a simulation.
  * @param min Minimum value.
  * @param max Maximum value.
  * @return A random variable
@@ -838,6 +1089,84 @@ double reb_random_normal(double variance);
  */
 double reb_random_rayleigh(double sigma);
 
+/**
+ * @brief Return uniformly distributed random variable in a given range, drawn from the generator of a simulation.
+ * @details All reb_random_sim functions draw from the random number generator of the simulation r. 
+ * It is a counter-based generator: the result only depends on rand_seed and on rand_counter, 
+ * the number of random numbers drawn so far. Set rand_seed (and reset rand_counter to 0) to 
+ * get reproducible results. If r is NULL, the generator of the C library is used, which 
+ * is not thread-safe.
+ * @param r The rebound simulation to be considered (can be NULL).
+ * @param min Minimum value.
+ * @param max Maximum value.
+ * @return A random variable
+ */
+double reb_random_sim_uniform(struct reb_simulation* const r, double min, double max);
+
+/**
+ * @brief Returns a random variable drawn form a powerlaw distribution, drawn from the generator of a simulation.
+ * @param r The rebound simulation to be considered (can be NULL).
+ * @param min Minimum value.
+ * @param max Maximum value.
+ * @param slope Slope of powerlaw distribution.
+ * @return A random variable
+ */
+double reb_random_sim_powerlaw(struct reb_simulation* const r, double min, double max, double slope);
+
+/**
+ * @brief Return a random number with normal distribution, drawn from the generator of a simulation.
+ * @details Calculated with the Box-Muller transform from two uniform random numbers.
+ * @param r The rebound simulation to be considered (can be NULL).
+ * @param variance Variance of normal distribution.
+ * @return A random variable
+ */
+double reb_random_sim_normal(struct reb_simulation* const r, double variance);
+
+/**
+ * @brief Return a random variable drawn form a Rayleigh distribution, drawn from the generator of a simulation.  
+ * @details Calculated as described on Rayleigh distribution wikipedia page
+ * @param r The rebound simulation to be considered (can be NULL).
+ * @param sigma Scale parameter.
+ * @return A random variable
+ */
+double reb_random_sim_rayleigh(struct reb_simulation* const r, double sigma);
+
+/**
+ * @brief Fill an array with uniformly distributed random variables.
+ * @details The result is identical to N consecutive calls of reb_random_sim_uniform(). 
+ * Large arrays are filled in parallel if REBOUND is compiled with OpenMP.
+ * @param r The rebound simulation to be considered (can be NULL).
+ * @param values Array of size N to be filled.
+ * @param N Number of random variables.
+ * @param min Minimum value.
+ * @param max Maximum value.
+ */
+void reb_random_uniform_fill(struct reb_simulation* const r, double* const values, const int N, const double min, const double max);
+
+/**
+ * @brief Fill an array with random variables drawn from a powerlaw distribution.
+ * @details The result is identical to N consecutive calls of reb_random_sim_powerlaw(). 
+ * Large arrays are filled in parallel if REBOUND is compiled with OpenMP.
+ * @param r The rebound simulation to be considered (can be NULL).
+ * @param values Array of size N to be filled.
+ * @param N Number of random variables.
+ * @param min Minimum value.
+ * @param max Maximum value.
+ * @param slope Slope of powerlaw distribution.
+ */
+void reb_random_powerlaw_fill(struct reb_simulation* const r, double* const values, const int N, const double min, const double max, const double slope);
+
+/**
+ * @brief Fill an array with normally distributed random variables.
+ * @details The result is identical to N consecutive calls of reb_random_sim_normal(). 
+ * Large arrays are filled in parallel if REBOUND is compiled with OpenMP.
+ * @param r The rebound simulation to be considered (can be NULL).
+ * @param values Array of size N to be filled.
+ * @param N Number of random variables.
+ * @param variance Variance of normal distribution.
+ */
+void reb_random_normal_fill(struct reb_simulation* const r, double* const values, const int N, const double variance);
+
 /**
  * @brief Move to center of momentum and center of mass frame.
  * @details This function moved all particles to the center of mass 
@@ -1336,6 +1665,26 @@ double reb_tools_calculate_megno(struct reb_simulation* r);
  */
 double reb_tools_calculate_lyapunov(struct reb_simulation* r);
 
+/**
+ * @brief Calculates MEGNO and the largest Lyapunov characteristic number for an ensemble of simulations.
+ * @details Each member of the ensemble is a copy of the simulation r (its integrator, timestep, 
+ * and all other settings) in which the real particles are replaced by the particles of that member. 
+ * MEGNO is initialized with reb_tools_megno_init() and every member is integrated up to tmax. 
+ * The members are integrated in parallel if REBOUND is compiled with OpenMP. The simulation r 
+ * itself is not modified. Function pointers such as additional_forces are shared by all members 
+ * and must therefore be thread-safe. 
+ * @param r The rebound simulation used as a template.
+ * @param particles Array of N_members*N particles, where N is the number of real particles in r. 
+ * The particles of member k start at index k*N.
+ * @param N_members Number of members in the ensemble.
+ * @param tmax Time up to which each member is integrated.
+ * @param megno Array of size N_members which is filled with the MEGNO of each member. Can be NULL.
+ * @param lyapunov Array of size N_members which is filled with the Lyapunov characteristic number of each member. Can be NULL.
+ * @return Number of members whose integration did not finish successfully (e.g. because of an escape 
+ * or close encounter). MEGNO and the Lyapunov characteristic number of these members are set to NAN.
+ */
+int reb_tools_megno_ensemble(const struct reb_simulation* const r, const struct reb_particle* const particles, const int N_members, const double tmax, double* const megno, double* const lyapunov);
+
 /**
  * @brief Returns hash for passed string.
  * @param str String key. 
@@ -41,6 +41,58 @@ void reb_tools_init_srand(void){
 	srand ( tim.tv_usec + getpid());
 }
 
+/**
+ * @brief Minimum number of samples for which the bulk random number functions run in parallel.
+ */
+#define REB_RANDOM_OMP_MIN_N 1000
+
+// Counter-based random numbers. The n-th number of a stream is a hash of the stream's key and n, 
+// calculated with the mixing function of SplitMix64. The key of a simulation is derived from 
+// rand_seed and the position in the stream is rand_counter. Because no other state is needed, 
+// the bulk functions can split a vector among threads and still return exactly the numbers 
+// that consecutive calls to the scalar functions would return.
+static inline uint64_t reb_random_mix(uint64_t z){
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static inline uint64_t reb_random_bits(const uint64_t key, const uint64_t n){
+	return reb_random_mix(key + (n+1)*0x9e3779b97f4a7c15ULL);
+}
+
+// Uniform in [0,1).
+static inline double reb_random_double(const uint64_t key, const uint64_t n){
+	return (double)(reb_random_bits(key, n) >> 11) * 0x1.0p-53;
+}
+
+static inline uint64_t reb_random_key(const struct reb_simulation* const r){
+	return reb_random_mix(r->rand_seed);
+}
+
+// Returns the next uniform random number in [0,1) of r. Uses the C library generator if r is NULL.
+static double reb_random_next(struct reb_simulation* const r){
+	if (r==NULL){
+		return ((double)rand())/((double)(RAND_MAX)+1.);
+	}
+	return reb_random_double(reb_random_key(r), r->rand_counter++);
+}
+
+// Transformations of uniform random numbers in [0,1) used by both the scalar and the bulk functions.
+static inline double reb_random_to_uniform(const double u, const double min, const double max){
+	return u*(max-min)+min;
+}
+
+static inline double reb_random_to_powerlaw(const double u, const double min, const double max, const double slope){
+	if(slope == -1) return exp(u*log(max/min) + log(min));
+	else return pow( (pow(max,slope+1.)-pow(min,slope+1.))*u+pow(min,slope+1.), 1./(slope+1.));
+}
+
+static inline double reb_random_to_normal(const double u1, const double u2, const double variance){
+	// Box-Muller transform. 1-u1 is in (0,1].
+	return sqrt(-2.*log(1.-u1)*variance)*cos(2.*M_PI*u2);
+}
+
 double reb_random_uniform(double min, double max){
 	return ((double)rand())/((double)(RAND_MAX))*(max-min)+min;
 }
@@ -68,6 +120,74 @@ double reb_random_rayleigh(double sigma){
 	return sigma*sqrt(-2*log(y));
 }
 
+double reb_random_sim_uniform(struct reb_simulation* const r, double min, double max){
+	return reb_random_to_uniform(reb_random_next(r), min, max);
+}
+
+double reb_random_sim_powerlaw(struct reb_simulation* const r, double min, double max, double slope){
+	return reb_random_to_powerlaw(reb_random_next(r), min, max, slope);
+}
+
+double reb_random_sim_normal(struct reb_simulation* const r, double variance){
+	const double u1 = reb_random_next(r);
+	const double u2 = reb_random_next(r);
+	return reb_random_to_normal(u1, u2, variance);
+}
+
+double reb_random_sim_rayleigh(struct reb_simulation* const r, double sigma){
+	const double y = 1.-reb_random_next(r);
+	return sigma*sqrt(-2*log(y));
+}
+
+void reb_random_uniform_fill(struct reb_simulation* const r, double* const values, const int N, const double min, const double max){
+	if (r==NULL){
+		for (int i=0;i<N;i++){
+			values[i] = reb_random_sim_uniform(NULL, min, max);
+		}
+		return;
+	}
+	const uint64_t key = reb_random_key(r);
+	const uint64_t n0 = r->rand_counter;
+#pragma omp parallel for schedule(guided) if(N>REB_RANDOM_OMP_MIN_N)
+	for (int i=0;i<N;i++){
+		values[i] = reb_random_to_uniform(reb_random_double(key, n0+i), min, max);
+	}
+	r->rand_counter += N;
+}
+
+void reb_random_powerlaw_fill(struct reb_simulation* const r, double* const values, const int N, const double min, const double max, const double slope){
+	if (r==NULL){
+		for (int i=0;i<N;i++){
+			values[i] = reb_random_sim_powerlaw(NULL, min, max, slope);
+		}
+		return;
+	}
+	const uint64_t key = reb_random_key(r);
+	const uint64_t n0 = r->rand_counter;
+#pragma omp parallel for schedule(guided) if(N>REB_RANDOM_OMP_MIN_N)
+	for (int i=0;i<N;i++){
+		values[i] = reb_random_to_powerlaw(reb_random_double(key, n0+i), min, max, slope);
+	}
+	r->rand_counter += N;
+}
+
+void reb_random_normal_fill(struct reb_simulation* const r, double* const values, const int N, const double variance){
+	if (r==NULL){
+		for (int i=0;i<N;i++){
+			values[i] = reb_random_sim_normal(NULL, variance);
+		}
+		return;
+	}
+	const uint64_t key = reb_random_key(r);
+	const uint64_t n0 = r->rand_counter;
+#pragma omp parallel for schedule(guided) if(N>REB_RANDOM_OMP_MIN_N)
+	for (int i=0;i<N;i++){
+		const uint64_t n = n0+2*(uint64_t)i;
+		values[i] = reb_random_to_normal(reb_random_double(key, n), reb_random_double(key, n+1), variance);
+	}
+	r->rand_counter += 2*(uint64_t)N;
+}
+
 /// Other helper routines
 double reb_tools_energy(const struct reb_simulation* const r){
     const int N = r->N;
@@ -350,25 +470,33 @@ void reb_tools_init_plummer(struct reb_simulation* r, int _N, double M, double R
 	// Algorithm from:	
 	// http://adsabs.harvard.edu/abs/1974A%26A....37..183A
 	
+	// Each star draws from its own stream (the number of draws varies because of the rejection 
+	// sampling), so the stars can be generated in parallel and do not depend on the number of threads.
+	const uint64_t key = reb_random_key(r);
+	const uint64_t n0 = r->rand_counter;
+	struct reb_particle* const stars = malloc(sizeof(struct reb_particle)*_N);
 	double E = 3./64.*M_PI*M*M/R;
+#pragma omp parallel for schedule(guided) if(_N>REB_RANDOM_OMP_MIN_N)
 	for (int i=0;i<_N;i++){
+		const uint64_t key_i = reb_random_bits(key, n0+i);
+		uint64_t n = 0;
 		struct reb_particle star = {0};
-		double _r = pow(pow(reb_random_uniform(0,1),-2./3.)-1.,-1./2.);
-		double x2 = reb_random_uniform(0,1);
-		double x3 = reb_random_uniform(0,2.*M_PI);
+		double _r = pow(pow(reb_random_double(key_i, n++),-2./3.)-1.,-1./2.);
+		double x2 = reb_random_double(key_i, n++);
+		double x3 = reb_random_to_uniform(reb_random_double(key_i, n++),0.,2.*M_PI);
 		star.z = (1.-2.*x2)*_r;
 		star.x = sqrt(_r*_r-star.z*star.z)*cos(x3);
 		star.y = sqrt(_r*_r-star.z*star.z)*sin(x3);
 		double x5,g,q;
 		do{
-			x5 = reb_random_uniform(0.,1.);
-			q = reb_random_uniform(0.,1.);
+			x5 = reb_random_double(key_i, n++);
+			q = reb_random_double(key_i, n++);
 			g = q*q*pow(1.-q*q,7./2.);
 		}while(0.1*x5>g);
 		double ve = pow(2.,1./2.)*pow(1.+_r*_r,-1./4.);
 		double v = q*ve;
-		double x6 = reb_random_uniform(0.,1.);
-		double x7 = reb_random_uniform(0.,2.*M_PI);
+		double x6 = reb_random_double(key_i, n++);
+		double x7 = reb_random_to_uniform(reb_random_double(key_i, n++),0.,2.*M_PI);
 		star.vz = (1.-2.*x6)*v;
 		star.vx = sqrt(v*v-star.vz*star.vz)*cos(x7);
 		star.vy = sqrt(v*v-star.vz*star.vz)*sin(x7);
@@ -383,8 +511,13 @@ void reb_tools_init_plummer(struct reb_simulation* r, int _N, double M, double R
 
 		star.m = M/(double)_N;
 
-		reb_add(r, star);
+		stars[i] = star;
+	}
+	r->rand_counter += _N;
+	for (int i=0;i<_N;i++){
+		reb_add(r, stars[i]);
 	}
+	free(stars);
 }
 
 static double mod2pi(double f){
@@ -826,12 +959,12 @@ void reb_tools_megno_init(struct reb_simulation* const r){
     struct reb_particle* const particles = r->particles;
     for (;i<imax;i++){ 
         particles[i].m  = 0.;
-		particles[i].x  = reb_random_normal(1.);
-		particles[i].y  = reb_random_normal(1.);
-		particles[i].z  = reb_random_normal(1.);
-		particles[i].vx = reb_random_normal(1.);
-		particles[i].vy = reb_random_normal(1.);
-		particles[i].vz = reb_random_normal(1.);
+		particles[i].x  = reb_random_sim_normal(r, 1.);
+		particles[i].y  = reb_random_sim_normal(r, 1.);
+		particles[i].z  = reb_random_sim_normal(r, 1.);
+		particles[i].vx = reb_random_sim_normal(r, 1.);
+		particles[i].vy = reb_random_sim_normal(r, 1.);
+		particles[i].vz = reb_random_sim_normal(r, 1.);
 		double deltad = 1./sqrt(
                 particles[i].x*particles[i].x 
                 + particles[i].y*particles[i].y 
@@ -855,6 +988,67 @@ double reb_tools_calculate_lyapunov(struct reb_simulation* r){ // Returns the la
 	if (r->t==0.) return 0.;
 	return r->megno_cov_Yt/r->megno_var_t;
 }
+// Creates a copy of the settings of r with the N particles given in particles. 
+// The same approach as in reb_create_simulation_from_binary() is used.
+static struct reb_simulation* reb_tools_megno_ensemble_member(const struct reb_simulation* const r, const struct reb_particle* const particles, const int N){
+    struct reb_simulation* const m = malloc(sizeof(struct reb_simulation));
+    memcpy(m, r, sizeof(struct reb_simulation));
+    reb_reset_temporary_pointers(m);
+    m->tree_root = NULL;
+    m->particle_lookup_table = NULL;
+    m->N_lookup = 0;
+    m->allocatedN_lookup = 0;
+    m->var_config = NULL;
+    m->var_config_N = 0;
+    m->N_var = 0;
+    m->calculate_megno = 0;
+    m->usleep = -1;
+    m->ri_whfast.recalculate_jacobi_this_timestep = 1;
+    m->ri_whfast.is_synchronized = 1;
+    // The mini simulation of HERMES belongs to r. Every member creates its own.
+    m->ri_hermes.mini = NULL;
+    m->ri_hermes.global = NULL;
+    m->ri_hermes.mini_active = 0;
+    m->ri_hermes.collision_this_global_dt = 0;
+    m->N = N;
+    m->allocatedN = N;
+    m->particles = malloc(sizeof(struct reb_particle)*N);
+    for (int i=0;i<N;i++){
+        m->particles[i] = particles[i];
+        m->particles[i].c = NULL;
+        m->particles[i].ap = NULL;
+        m->particles[i].sim = m;
+    }
+    return m;
+}
+
+int reb_tools_megno_ensemble(const struct reb_simulation* const r, const struct reb_particle* const particles, const int N_members, const double tmax, double* const megno, double* const lyapunov){
+    const int N = r->N - r->N_var;
+    struct reb_simulation** members = malloc(sizeof(struct reb_simulation*)*N_members);
+    for (int k=0;k<N_members;k++){
+        members[k] = reb_tools_megno_ensemble_member(r, particles+k*N, N);
+    }
+    int N_failed = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+:N_failed)
+    for (int k=0;k<N_members;k++){
+        struct reb_simulation* const m = members[k];
+        // Members inherit the random number generator of r, so all start with the same deviation vector.
+        reb_tools_megno_init(m);
+        const enum REB_STATUS status = reb_integrate(m, tmax);
+        const int success = status==REB_EXIT_SUCCESS;
+        if (megno){
+            megno[k] = success?reb_tools_calculate_megno(m):NAN;
+        }
+        if (lyapunov){
+            lyapunov[k] = success?reb_tools_calculate_lyapunov(m):NAN;
+        }
+        N_failed += !success;
+        reb_free_simulation(m);
+    }
+    free(members);
+    return N_failed;
+}
+
 double reb_tools_megno_deltad_delta(struct reb_simulation* const r){
 	const struct reb_particle* restrict const particles = r->particles;
     double deltad = 0;